@@ -75,6 +75,32 @@ typedef struct {
   bool valid;
 } k_quirc_result_t;
 
+/* Threshold estimation modes */
+typedef enum {
+  /* Full histogram of the central region on every frame */
+  K_QUIRC_THRESHOLD_FULL = 0,
+  /* Sparse histogram blended with previous frames; a full histogram is only
+   * rebuilt when the mean luma jumps. Suited to consecutive camera frames.
+   */
+  K_QUIRC_THRESHOLD_SAMPLED,
+} k_quirc_threshold_mode_t;
+
+/* Luminance statistics of the histogram region (the central 60% of the
+ * image) from the last k_quirc_end(). Fractions are in permille.
+ */
+typedef struct {
+  uint8_t mean;        /* mean luma */
+  uint8_t threshold;   /* binarization level applied */
+  uint8_t dark_mean;   /* mean of the samples below the threshold */
+  uint8_t light_mean;  /* mean of the samples at or above it */
+  uint16_t clip_low;   /* samples at or below K_QUIRC_CLIP_LOW */
+  uint16_t clip_high;  /* samples at or above K_QUIRC_CLIP_HIGH */
+  uint16_t bimodality; /* between-class share of the variance */
+} k_quirc_histogram_stats_t;
+
+#define K_QUIRC_CLIP_LOW 8
+#define K_QUIRC_CLIP_HIGH 247
+
 /* Opaque decoder context */
 typedef struct k_quirc k_quirc_t;
 
@@ -118,6 +144,36 @@ uint8_t *k_quirc_begin(k_quirc_t *q, int *w, int *h);
  */
 void k_quirc_end(k_quirc_t *q, bool find_inverted);
 
+/**
+ * Select how k_quirc_end() estimates the binarization threshold.
+ * Full mode leaves the sampled mode's history untouched, so it can be used
+ * for a one-off retry.
+ * @param q Decoder instance
+ * @param mode Threshold estimation mode (default K_QUIRC_THRESHOLD_FULL)
+ */
+void k_quirc_set_threshold_mode(k_quirc_t *q, k_quirc_threshold_mode_t mode);
+
+/**
+ * Get luminance statistics of the last processed image, for exposure
+ * control. In sampled threshold mode they come from the sparse histogram.
+ * @param q Decoder instance
+ * @param stats Pointer to receive the statistics
+ * @return 0 on success, -1 if no image has been processed yet
+ */
+int k_quirc_get_histogram_stats(const k_quirc_t *q,
+                                k_quirc_histogram_stats_t *stats);
+
+/**
+ * Meter the image filled in since k_quirc_begin() without detecting codes,
+ * from a sparse histogram. The sampled mode's threshold history is left
+ * untouched, and k_quirc_get_histogram_stats() returns the same statistics
+ * afterwards.
+ * @param q Decoder instance
+ * @param stats Pointer to receive the statistics
+ * @return 0 on success, -1 if the image is empty
+ */
+int k_quirc_meter(k_quirc_t *q, k_quirc_histogram_stats_t *stats);
+
 /**
  * Get the number of QR codes detected.
  * @param q Decoder instance
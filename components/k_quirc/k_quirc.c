@@ -121,6 +121,7 @@ struct quirc_grid {
   int hscan;
   int vscan;
   int grid_size;
+  bool version_confirmed;
   float c[QUIRC_PERSPECTIVE_PARAMS];
 };
 
@@ -151,6 +152,12 @@ struct k_quirc {
   struct quirc_capstone capstones[QUIRC_MAX_CAPSTONES];
   int num_grids;
   struct quirc_grid grids[QUIRC_MAX_GRIDS];
+  k_quirc_threshold_mode_t threshold_mode;
+  bool threshold_valid;
+  uint8_t threshold_mean;
+  uint16_t threshold_avg; /* 8.8 fixed point */
+  bool hist_stats_valid;
+  k_quirc_histogram_stats_t hist_stats;
 };
 
 /*
@@ -652,35 +659,39 @@ static void flood_fill_seed(struct k_quirc *q, int x, int y,
  * Thresholding with Otsu's method
  * Uses 32-bit histogram counters to handle larger images without overflow
  */
-static uint8_t otsu_threshold(uint32_t *histogram, uint32_t total) {
-  // Calculate weighted sum of histogram values
-  double sum = 0;
-  for (int i = 0; i < 256; i++) {
-    sum += (double)i * histogram[i];
-  }
+static uint8_t otsu_threshold(const uint32_t *histogram, uint32_t total,
+                              uint8_t *mean) {
+  uint32_t sum = 0;
+  for (int i = 0; i < 256; i++)
+    sum += (uint32_t)i * histogram[i];
 
-  double sumB = 0;
+  *mean = total ? sum / total : 0;
+
+  uint32_t sumB = 0;
   uint32_t wB = 0;
-  double varMax = 0;
+  uint64_t varMax = 0;
   uint8_t threshold = 0;
 
   for (int i = 0; i < 256; i++) {
-    // Weighted background
     wB += histogram[i];
     if (wB == 0)
       continue;
 
-    // Weighted foreground
     uint32_t wF = total - wB;
     if (wF == 0)
       break;
 
-    sumB += (double)i * histogram[i];
-    double mB = sumB / wB;
-    double mF = (sum - sumB) / wF;
-    double mDiff = mB - mF;
+    sumB += (uint32_t)i * histogram[i];
+
+    /* Class means in 8.8 fixed point; the class weight product is divided
+     * by the total first so that the variance fits in 64 bits.
+     */
+    uint32_t mB = (uint32_t)(((uint64_t)sumB << 8) / wB);
+    uint32_t mF = (uint32_t)(((uint64_t)(sum - sumB) << 8) / wF);
+    uint64_t mDiff = mB > mF ? mB - mF : mF - mB;
+    uint64_t weight = (uint64_t)wB * wF / total;
 
-    double varBetween = (double)wB * (double)wF * mDiff * mDiff;
+    uint64_t varBetween = weight * mDiff * mDiff;
     if (varBetween >= varMax) {
       varMax = varBetween;
       threshold = i;
@@ -693,33 +704,131 @@ static uint8_t otsu_threshold(uint32_t *histogram, uint32_t total) {
 /* Percentage of image edges to ignore for histogram calculation */
 #define OTSU_MARGIN_PERCENT 20
 
-HOT_FUNC
-static void threshold(struct k_quirc *q, bool inverted) {
+/* Sampled mode: histogram stride in both directions, EMA weight of the
+ * newest estimate (1/2^shift), and the mean luma change that counts as a
+ * new scene and forces a full histogram.
+ */
+#define OTSU_SAMPLE_STEP 4
+#define THRESHOLD_EMA_SHIFT 2
+#define THRESHOLD_MEAN_JUMP 12
+
+static uint32_t build_histogram(const struct k_quirc *q, int step,
+                                uint32_t *histogram) {
   int width = q->w;
   int height = q->h;
-  quirc_pixel_t *restrict pixels = q->pixels;
-  uint32_t total_pixels = (uint32_t)width * height;
+  const uint8_t *image = q->image;
 
   /* Calculate margins - ignore outer 20% on each side for histogram */
   int margin_x = width * OTSU_MARGIN_PERCENT / 100;
   int margin_y = height * OTSU_MARGIN_PERCENT / 100;
-  int start_x = margin_x;
-  int end_x = width - margin_x;
-  int start_y = margin_y;
-  int end_y = height - margin_y;
-
-  /* Build histogram over central region only */
-  uint32_t histogram[256] = {0};
-  uint32_t hist_pixels = (uint32_t)(end_x - start_x) * (end_y - start_y);
-
-  for (int y = start_y; y < end_y; y++) {
-    quirc_pixel_t *row = pixels + y * width + start_x;
-    for (int x = start_x; x < end_x; x++) {
-      histogram[*row++]++;
+  uint32_t count = 0;
+
+  memset(histogram, 0, 256 * sizeof(*histogram));
+
+  for (int y = margin_y; y < height - margin_y; y += step) {
+    const uint8_t *row = image + y * width;
+    for (int x = margin_x; x < width - margin_x; x += step) {
+      histogram[row[x]]++;
+      count++;
     }
   }
 
-  uint8_t o_threshold = otsu_threshold(histogram, hist_pixels);
+  return count;
+}
+
+/* Exposure statistics of the histogram the level was picked from. The
+ * bimodality is Otsu's separability: the between-class variance at the
+ * chosen level over the total variance.
+ */
+static void histogram_stats(struct k_quirc *q, const uint32_t *histogram,
+                            uint32_t total, uint8_t level) {
+  k_quirc_histogram_stats_t *stats = &q->hist_stats;
+  uint32_t sum = 0, sum_dark = 0, count_dark = 0;
+  uint32_t clip_low = 0, clip_high = 0;
+  uint64_t sum_sq = 0;
+
+  if (!total)
+    return;
+
+  for (int i = 0; i < 256; i++) {
+    uint32_t h = histogram[i];
+    sum += (uint32_t)i * h;
+    sum_sq += (uint64_t)i * i * h;
+    if (i < level) {
+      sum_dark += (uint32_t)i * h;
+      count_dark += h;
+    }
+    if (i <= K_QUIRC_CLIP_LOW)
+      clip_low += h;
+    if (i >= K_QUIRC_CLIP_HIGH)
+      clip_high += h;
+  }
+
+  uint32_t count_light = total - count_dark;
+  float mean = (float)sum / total;
+  float dark_mean = count_dark ? (float)sum_dark / count_dark : 0;
+  float light_mean = count_light ? (float)(sum - sum_dark) / count_light : 0;
+  float var_total = (float)sum_sq / total - mean * mean;
+  float diff = light_mean - dark_mean;
+  float var_between =
+      (float)count_dark * count_light / ((float)total * total) * diff * diff;
+
+  stats->mean = (uint8_t)fast_roundf(mean);
+  stats->threshold = level;
+  stats->dark_mean = (uint8_t)fast_roundf(dark_mean);
+  stats->light_mean = (uint8_t)fast_roundf(light_mean);
+  stats->clip_low = (uint16_t)((uint64_t)clip_low * 1000 / total);
+  stats->clip_high = (uint16_t)((uint64_t)clip_high * 1000 / total);
+  stats->bimodality =
+      var_total > 0 ? (uint16_t)fast_roundf(1000 * var_between / var_total)
+                    : 0;
+  if (stats->bimodality > 1000)
+    stats->bimodality = 1000;
+  q->hist_stats_valid = true;
+}
+
+/* Pick the binarization level for the current image. Computed once per
+ * k_quirc_end() so that the inverted pass reuses it.
+ */
+static uint8_t compute_threshold(struct k_quirc *q) {
+  uint32_t histogram[256];
+  uint32_t count;
+  uint8_t mean;
+  uint8_t level;
+
+  if (q->threshold_mode == K_QUIRC_THRESHOLD_FULL) {
+    count = build_histogram(q, 1, histogram);
+    level = otsu_threshold(histogram, count, &mean);
+    histogram_stats(q, histogram, count, level);
+    return level;
+  }
+
+  count = build_histogram(q, OTSU_SAMPLE_STEP, histogram);
+  level = otsu_threshold(histogram, count, &mean);
+
+  if (q->threshold_valid &&
+      abs(mean - q->threshold_mean) <= THRESHOLD_MEAN_JUMP) {
+    int32_t avg = q->threshold_avg;
+    avg += (((int32_t)level << 8) - avg) >> THRESHOLD_EMA_SHIFT;
+    q->threshold_avg = (uint16_t)avg;
+  } else {
+    /* Scene changed: start over from a full histogram */
+    count = build_histogram(q, 1, histogram);
+    level = otsu_threshold(histogram, count, &mean);
+    q->threshold_avg = (uint16_t)level << 8;
+    q->threshold_valid = true;
+  }
+
+  q->threshold_mean = mean;
+  level = (q->threshold_avg + 0x80) >> 8;
+  histogram_stats(q, histogram, count, level);
+  return level;
+}
+
+HOT_FUNC
+static void threshold(struct k_quirc *q, uint8_t o_threshold, bool inverted) {
+  quirc_pixel_t *restrict pixels = q->pixels;
+  uint32_t total_pixels = (uint32_t)q->w * q->h;
 
   /* Apply threshold to ALL pixels using branchless operations */
   if (inverted) {
@@ -1263,6 +1372,84 @@ static void measure_grid_size(struct k_quirc *q, int index) {
   qr->grid_size = 4 * ver + 17;
 }
 
+/*
+ * Version information blocks (version 7 and up)
+ *
+ * 18 bits: 6-bit version followed by a BCH(18,6) remainder. Codewords are
+ * at least 8 bits apart, so up to 3 bit errors are corrected by picking the
+ * nearest valid codeword.
+ */
+#define VERSION_INFO_MIN_VERSION 7
+#define VERSION_INFO_MIN_GRID_SIZE (VERSION_INFO_MIN_VERSION * 4 + 17)
+#define VERSION_INFO_BITS 18
+#define VERSION_INFO_POLY 0x1F25
+#define VERSION_INFO_MAX_ERROR 3
+#define VERSION_INFO_MAX_DRIFT 2
+
+static uint32_t version_info_codeword(int version) {
+  uint32_t rem = (uint32_t)version << 12;
+
+  for (int i = VERSION_INFO_BITS - 1; i >= 12; i--)
+    if (rem & (1u << i))
+      rem ^= (uint32_t)VERSION_INFO_POLY << (i - 12);
+
+  return ((uint32_t)version << 12) | rem;
+}
+
+/* Sample a module relative to a capstone's own 7x7 perspective */
+static int capstone_module(const struct k_quirc *q,
+                           const struct quirc_capstone *cap, int u, int v) {
+  struct quirc_point p;
+
+  perspective_map(cap->c, u + 0.5f, v + 0.5f, &p);
+  if (p.y < 0 || p.y >= q->h || p.x < 0 || p.x >= q->w)
+    return -1;
+
+  return q->pixels[p.y * q->w + p.x] ? 1 : 0;
+}
+
+/* Read both version blocks next to the top-right (caps[2]) and bottom-left
+ * (caps[0]) capstones. Returns the corrected version, or -1 if neither
+ * block is readable or close to the capstone spacing estimate.
+ */
+static int read_version_info(const struct k_quirc *q, int index) {
+  const struct quirc_grid *qr = &q->grids[index];
+  int estimate = (qr->grid_size - 17) / 4;
+  int best_version = -1;
+  int best_errors = VERSION_INFO_MAX_ERROR + 1;
+
+  for (int block = 0; block < 2; block++) {
+    const struct quirc_capstone *cap =
+        &q->capstones[qr->caps[block ? 0 : 2]];
+    uint32_t bits = 0;
+    int i;
+
+    for (i = VERSION_INFO_BITS - 1; i >= 0; i--) {
+      int across = i / 3;
+      int along = i % 3 - 4;
+      int bit = block ? capstone_module(q, cap, across, along)
+                      : capstone_module(q, cap, along, across);
+
+      if (bit < 0)
+        break;
+      bits = (bits << 1) | bit;
+    }
+    if (i >= 0)
+      continue;
+
+    for (int v = VERSION_INFO_MIN_VERSION; v <= QUIRC_MAX_VERSION; v++) {
+      int errors = __builtin_popcount(bits ^ version_info_codeword(v));
+
+      if (errors < best_errors && abs(v - estimate) <= VERSION_INFO_MAX_DRIFT) {
+        best_errors = errors;
+        best_version = v;
+      }
+    }
+  }
+
+  return best_version;
+}
+
 /* Rotate the capstone so that corner 0 is the leftmost with respect
  * to the given reference line.
  */
@@ -1340,6 +1527,16 @@ static void record_qr_grid(struct k_quirc *q, int a, int b, int c) {
   if (qr->grid_size > 177)
     return;
 
+  /* Version 7+ symbols carry their version; trust it over the estimate */
+  if (qr->grid_size >= VERSION_INFO_MIN_GRID_SIZE) {
+    int version = read_version_info(q, q->num_grids);
+
+    if (version > 0) {
+      qr->grid_size = version * 4 + 17;
+      qr->version_confirmed = true;
+    }
+  }
+
   line_intersect(&q->capstones[a].corners[0], &q->capstones[a].corners[1],
                  &q->capstones[c].corners[0], &q->capstones[c].corners[3],
                  &qr->align);
@@ -2179,51 +2376,95 @@ done:
   return K_QUIRC_SUCCESS;
 }
 
-static k_quirc_error_t quirc_decode_internal(const struct quirc_code *code,
-                                             struct quirc_data *data) {
-  k_quirc_error_t err;
-  struct datastream *ds;
+/* Mirror the sampled grid about its main diagonal in place. A mirrored
+ * symbol is detected with its top-right and bottom-left capstones swapped,
+ * so its cells come out transposed.
+ */
+static void transpose_grid(struct quirc_code *code) {
+  struct quirc_point corner = code->corners[1];
+
+  for (int y = 0; y < code->size; y++) {
+    for (int x = y + 1; x < code->size; x++) {
+      int a = y * code->size + x;
+      int b = x * code->size + y;
+      int diff = ((code->cell_bitmap[a >> 3] >> (a & 7)) ^
+                  (code->cell_bitmap[b >> 3] >> (b & 7))) &
+                 1;
+
+      code->cell_bitmap[a >> 3] ^= diff << (a & 7);
+      code->cell_bitmap[b >> 3] ^= diff << (b & 7);
+    }
+  }
 
-  if ((code->size - 17) % 4)
-    return K_QUIRC_ERROR_INVALID_GRID_SIZE;
+  code->corners[1] = code->corners[3];
+  code->corners[3] = corner;
+}
 
-  ds = K_MALLOC(sizeof(*ds));
-  if (!ds)
-    return K_QUIRC_ERROR_ALLOC_FAILED;
+static k_quirc_error_t decode_grid(const struct quirc_code *code,
+                                   struct quirc_data *data,
+                                   struct datastream *ds) {
+  k_quirc_error_t err;
 
   memset(ds, 0, sizeof(*ds));
   memset(data, 0, sizeof(*data));
 
   data->version = (code->size - 17) / 4;
 
-  if (data->version < 1 || data->version > QUIRC_MAX_VERSION) {
-    K_FREE(ds);
-    return K_QUIRC_ERROR_INVALID_VERSION;
-  }
-
   err = read_format(code, data, 0);
-  if (err) {
+  if (err)
     err = read_format(code, data, 1);
-    if (err) {
-      K_FREE(ds);
-      return err;
-    }
-  }
+  if (err)
+    return err;
 
   read_data(code, data, ds);
   err = codestream_ecc(data, ds);
-  if (err) {
-    K_FREE(ds);
+  if (err)
     return err;
+
+  return decode_payload(data, ds);
+}
+
+static k_quirc_error_t quirc_decode_internal(struct quirc_code *code,
+                                             struct quirc_data *data) {
+  k_quirc_error_t err;
+  struct datastream *ds;
+  int version = (code->size - 17) / 4;
+
+  if ((code->size - 17) % 4)
+    return K_QUIRC_ERROR_INVALID_GRID_SIZE;
+
+  if (version < 1 || version > QUIRC_MAX_VERSION)
+    return K_QUIRC_ERROR_INVALID_VERSION;
+
+  ds = K_MALLOC(sizeof(*ds));
+  if (!ds)
+    return K_QUIRC_ERROR_ALLOC_FAILED;
+
+  err = decode_grid(code, data, ds);
+
+  /* A transposed format word still lands within BCH range of some valid
+   * codeword about half the time, so a mirror image surfaces as either a
+   * format or a data ECC failure. Retrying on the transposed bitmap costs
+   * far less than another detection pass.
+   */
+  if (err == K_QUIRC_ERROR_FORMAT_ECC || err == K_QUIRC_ERROR_DATA_ECC) {
+    transpose_grid(code);
+    if (decode_grid(code, data, ds) == K_QUIRC_SUCCESS)
+      err = K_QUIRC_SUCCESS;
+    else
+      transpose_grid(code);
   }
 
-  err = decode_payload(data, ds);
   K_FREE(ds);
   return err;
 }
 
+/* Sample the code on a grid_size x grid_size lattice. The homography was
+ * fitted for qr->grid_size; other sizes reuse it by rescaling module
+ * coordinates so that the capstone anchors stay fixed.
+ */
 static void quirc_extract_internal(const struct k_quirc *q, int index,
-                                   struct quirc_code *code) {
+                                   int grid_size, struct quirc_code *code) {
   const struct quirc_grid *qr = &q->grids[index];
 
   if (index < 0 || index >= q->num_grids)
@@ -2231,19 +2472,22 @@ static void quirc_extract_internal(const struct k_quirc *q, int index,
 
   memset(code, 0, sizeof(*code));
 
+  float scale = (float)(qr->grid_size - 7) / (float)(grid_size - 7);
+  float edge = grid_size * scale;
+
   perspective_map(qr->c, 0.0f, 0.0f, &code->corners[0]);
-  perspective_map(qr->c, qr->grid_size, 0.0f, &code->corners[1]);
-  perspective_map(qr->c, qr->grid_size, qr->grid_size, &code->corners[2]);
-  perspective_map(qr->c, 0.0f, qr->grid_size, &code->corners[3]);
+  perspective_map(qr->c, edge, 0.0f, &code->corners[1]);
+  perspective_map(qr->c, edge, edge, &code->corners[2]);
+  perspective_map(qr->c, 0.0f, edge, &code->corners[3]);
 
-  code->size = qr->grid_size;
+  code->size = grid_size;
 
   int i = 0;
-  for (int y = 0; y < qr->grid_size; y++) {
-    for (int x = 0; x < qr->grid_size; x++) {
+  for (int y = 0; y < grid_size; y++) {
+    for (int x = 0; x < grid_size; x++) {
       struct quirc_point p;
 
-      perspective_map(qr->c, x + 0.5f, y + 0.5f, &p);
+      perspective_map(qr->c, (x + 0.5f) * scale, (y + 0.5f) * scale, &p);
 
       if (p.y >= 0 && p.y < q->h && p.x >= 0 && p.x < q->w) {
         if (q->pixels[p.y * q->w + p.x])
@@ -2315,9 +2559,15 @@ uint8_t *k_quirc_begin(k_quirc_t *q, int *w, int *h) {
   return q->image;
 }
 
+void k_quirc_set_threshold_mode(k_quirc_t *q, k_quirc_threshold_mode_t mode) {
+  q->threshold_mode = mode;
+}
+
 void k_quirc_end(k_quirc_t *q, bool find_inverted) {
+  uint8_t level = compute_threshold(q);
+
   pixels_setup(q);
-  threshold(q, false);
+  threshold(q, level, false);
 
   for (int i = 0; i < q->h; i++)
     finder_scan(q, i);
@@ -2331,7 +2581,7 @@ void k_quirc_end(k_quirc_t *q, bool find_inverted) {
     q->num_grids = 0;
 
     pixels_setup(q);
-    threshold(q, true);
+    threshold(q, level, true);
 
     for (int i = 0; i < q->h; i++)
       finder_scan(q, i);
@@ -2341,6 +2591,25 @@ void k_quirc_end(k_quirc_t *q, bool find_inverted) {
   }
 }
 
+int k_quirc_get_histogram_stats(const k_quirc_t *q,
+                                k_quirc_histogram_stats_t *stats) {
+  if (!q->hist_stats_valid)
+    return -1;
+  *stats = q->hist_stats;
+  return 0;
+}
+
+int k_quirc_meter(k_quirc_t *q, k_quirc_histogram_stats_t *stats) {
+  uint32_t histogram[256];
+  uint8_t mean;
+
+  uint32_t count = build_histogram(q, OTSU_SAMPLE_STEP, histogram);
+  if (!count)
+    return -1;
+  histogram_stats(q, histogram, count, otsu_threshold(histogram, count, &mean));
+  return k_quirc_get_histogram_stats(q, stats);
+}
+
 int k_quirc_count(const k_quirc_t *q) { return q->num_grids; }
 
 k_quirc_error_t k_quirc_decode(k_quirc_t *q, int index,
@@ -2365,9 +2634,29 @@ k_quirc_error_t k_quirc_decode(k_quirc_t *q, int index,
     return K_QUIRC_ERROR_INVALID_GRID_SIZE;
   }
 
-  quirc_extract_internal(q, index, code);
+  const struct quirc_grid *qr = &q->grids[index];
+  quirc_extract_internal(q, index, qr->grid_size, code);
 
   k_quirc_error_t err = quirc_decode_internal(code, data);
+
+  /* An unconfirmed version may be off by one: resample the neighbouring
+   * sizes with the same homography instead of losing the frame.
+   */
+  if ((err == K_QUIRC_ERROR_FORMAT_ECC || err == K_QUIRC_ERROR_DATA_ECC) &&
+      !qr->version_confirmed) {
+    static const int size_steps[] = {-4, 4};
+
+    for (int i = 0; i < 2 && err != K_QUIRC_SUCCESS; i++) {
+      int grid_size = qr->grid_size + size_steps[i];
+
+      if (grid_size < 21 || grid_size > 177)
+        continue;
+
+      quirc_extract_internal(q, index, grid_size, code);
+      err = quirc_decode_internal(code, data);
+    }
+  }
+
   if (err == K_QUIRC_SUCCESS) {
     result->valid = true;
     for (int i = 0; i < 4; i++) {
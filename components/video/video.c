@@ -1,5 +1,6 @@
 /* System includes */
 #include <fcntl.h>
+#include <inttypes.h>
 #include <string.h>
 #include <sys/errno.h>
 #include <sys/ioctl.h>
@@ -42,8 +43,11 @@ typedef struct {
   uint8_t
       *camera_buffer[MAX_BUFFER_COUNT]; /**< Array of camera frame buffers */
   size_t camera_buf_size;               /**< Size of each camera buffer */
+  uint32_t camera_buf_num;              /**< Number of camera buffers */
+  bool requeue_buffers;                 /**< Stream was stopped before */
   uint32_t camera_buf_hes;              /**< Horizontal resolution (width) */
   uint32_t camera_buf_ves;              /**< Vertical resolution (height) */
+  video_fmt_t pixel_format;             /**< Format set by app_video_open */
   struct v4l2_buffer v4l2_buf;          /**< V4L2 buffer structure */
   uint8_t camera_mem_mode;              /**< Memory mode (MMAP or USERPTR) */
   int video_fd;                         /**< Video device file descriptor */
@@ -108,6 +112,7 @@ static bool s_video_initialized = false;
 static esp_err_t video_receive_video_frame(int video_fd);
 static void video_operation_video_frame(int video_fd);
 static esp_err_t video_free_video_frame(int video_fd);
+static esp_err_t video_queue_buffers(int video_fd);
 static esp_err_t video_stream_start(int video_fd);
 static esp_err_t video_stream_stop(int video_fd);
 static void video_stream_task(void *arg);
@@ -195,6 +200,7 @@ int app_video_open(char *dev, video_fmt_t init_fmt) {
 
   app_camera_video.camera_buf_hes = default_format.fmt.pix.width;
   app_camera_video.camera_buf_ves = default_format.fmt.pix.height;
+  app_camera_video.pixel_format = init_fmt;
 
   if (default_format.fmt.pix.pixelformat != init_fmt) {
     struct v4l2_format format = {
@@ -306,6 +312,7 @@ esp_err_t app_video_set_bufs(int video_fd, uint32_t fb_num, const void **fb) {
     }
 
     app_camera_video.camera_buf_size = buf.length;
+    app_camera_video.camera_buf_num = i + 1;
 
     if (ioctl(video_fd, VIDIOC_QBUF, &buf) != 0) {
       ESP_LOGE(TAG, "queue frame buffer failed");
@@ -344,11 +351,23 @@ esp_err_t app_video_get_bufs(int fb_num, void **fb) {
 }
 
 uint32_t app_video_get_buf_size(void) {
-  uint32_t buf_size = app_camera_video.camera_buf_hes *
-                      app_camera_video.camera_buf_ves *
-                      (APP_VIDEO_FMT == APP_VIDEO_FMT_RGB565 ? 2 : 3);
-
-  return buf_size;
+  uint32_t pixels =
+      app_camera_video.camera_buf_hes * app_camera_video.camera_buf_ves;
+
+  switch (app_camera_video.pixel_format) {
+  case APP_VIDEO_FMT_RAW8:
+  case APP_VIDEO_FMT_GREY:
+    return pixels;
+  case APP_VIDEO_FMT_YUV420:
+    return pixels * 3 / 2;
+  case APP_VIDEO_FMT_RAW10:
+  case APP_VIDEO_FMT_RGB565:
+  case APP_VIDEO_FMT_YUV422:
+    return pixels * 2;
+  case APP_VIDEO_FMT_RGB888:
+  default:
+    return pixels * 3;
+  }
 }
 
 esp_err_t app_video_get_resolution(uint32_t *width, uint32_t *height) {
@@ -434,6 +453,37 @@ errout:
   return ESP_FAIL;
 }
 
+/**
+ * @brief Queue every buffer to the driver again
+ *
+ * Needed before restarting a stream that was stopped, since stopping it
+ * dequeued all buffers.
+ *
+ * @param video_fd File descriptor for the video device
+ * @return ESP_OK on success, ESP_FAIL on failure
+ */
+static esp_err_t video_queue_buffers(int video_fd) {
+  for (uint32_t i = 0; i < app_camera_video.camera_buf_num; i++) {
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = app_camera_video.camera_mem_mode;
+    buf.index = i;
+    if (buf.memory == V4L2_MEMORY_USERPTR) {
+      buf.m.userptr = (unsigned long)app_camera_video.camera_buffer[i];
+      buf.length = app_camera_video.camera_buf_size;
+    }
+
+    if (ioctl(video_fd, VIDIOC_QBUF, &buf) != 0) {
+      ESP_LOGE(TAG, "queue frame buffer failed");
+      return ESP_FAIL;
+    }
+  }
+
+  app_camera_video.requeue_buffers = false;
+  return ESP_OK;
+}
+
 /**
  * @brief Start video streaming
  *
@@ -484,6 +534,9 @@ static esp_err_t video_stream_stop(int video_fd) {
     goto errout;
   }
 
+  // STREAMOFF returns every buffer to the application
+  app_camera_video.requeue_buffers = true;
+
   xEventGroupSetBits(app_camera_video.video_event_group,
                      VIDEO_TASK_DELETE_DONE);
 
@@ -510,6 +563,8 @@ static void video_stream_task(void *arg) {
   ESP_LOGI(TAG, "Video stream task starting with fd: %d", video_fd);
 
   // Start the video stream now that buffers are set up
+  if (app_camera_video.requeue_buffers)
+    ESP_ERROR_CHECK(video_queue_buffers(video_fd));
   ESP_ERROR_CHECK(video_stream_start(video_fd));
 
   while (1) {
@@ -572,6 +627,75 @@ esp_err_t app_video_stream_task_stop(int video_fd) {
   return ESP_OK;
 }
 
+esp_err_t app_video_stream_task_stop_sync(int video_fd, uint32_t timeout_ms) {
+  if (!app_camera_video.video_event_group)
+    return ESP_OK;
+
+  app_video_stream_task_stop(video_fd);
+
+  EventBits_t bits = xEventGroupWaitBits(
+      app_camera_video.video_event_group, VIDEO_TASK_DELETE_DONE, pdFALSE,
+      pdFALSE, pdMS_TO_TICKS(timeout_ms));
+  if (!(bits & VIDEO_TASK_DELETE_DONE)) {
+    ESP_LOGE(TAG, "Timeout waiting for video stream task");
+    return ESP_ERR_TIMEOUT;
+  }
+
+  app_camera_video.video_stream_task_handle = NULL;
+  return ESP_OK;
+}
+
+esp_err_t app_video_query_control(int video_fd, uint32_t id, int32_t *min,
+                                  int32_t *max) {
+  struct v4l2_query_ext_ctrl query = {
+      .id = id,
+  };
+
+  if (ioctl(video_fd, VIDIOC_QUERY_EXT_CTRL, &query) != 0 ||
+      (query.flags & V4L2_CTRL_FLAG_DISABLED)) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  *min = (int32_t)query.minimum;
+  *max = (int32_t)query.maximum;
+  return ESP_OK;
+}
+
+esp_err_t app_video_get_control(int video_fd, uint32_t id, int32_t *value) {
+  struct v4l2_ext_controls controls = {0};
+  struct v4l2_ext_control control[1] = {0};
+
+  controls.ctrl_class = V4L2_CTRL_ID2CLASS(id);
+  controls.count = 1;
+  controls.controls = control;
+  control[0].id = id;
+  if (ioctl(video_fd, VIDIOC_G_EXT_CTRLS, &controls) != 0) {
+    ESP_LOGE(TAG, "failed to get control 0x%" PRIx32, id);
+    return ESP_FAIL;
+  }
+
+  *value = control[0].value;
+  return ESP_OK;
+}
+
+esp_err_t app_video_set_control(int video_fd, uint32_t id, int32_t value) {
+  struct v4l2_ext_controls controls = {0};
+  struct v4l2_ext_control control[1] = {0};
+
+  controls.ctrl_class = V4L2_CTRL_ID2CLASS(id);
+  controls.count = 1;
+  controls.controls = control;
+  control[0].id = id;
+  control[0].value = value;
+  if (ioctl(video_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
+    ESP_LOGE(TAG, "failed to set control 0x%" PRIx32 " to %" PRId32, id,
+             value);
+    return ESP_FAIL;
+  }
+
+  return ESP_OK;
+}
+
 esp_err_t app_video_register_frame_operation_cb(
     app_video_frame_operation_cb_t operation_cb) {
   app_camera_video.user_camera_video_frame_operation_cb = operation_cb;
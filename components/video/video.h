@@ -43,6 +43,18 @@ typedef void (*app_video_frame_operation_cb_t)(uint8_t *camera_buf,
                                                uint32_t camera_buf_ves,
                                                size_t camera_buf_len);
 
+/**
+ * @brief Virtual camera delivery statistics
+ */
+typedef struct {
+  uint32_t frames;          /**< Frames handed to the callback */
+  uint32_t late_frames;     /**< Frames whose callback overran the deadline */
+  uint32_t max_callback_us; /**< Longest callback duration */
+  uint64_t callback_us;     /**< Total time spent in the callback */
+  uint32_t exposure_steps;  /**< Changes of V4L2_CID_EXPOSURE_ABSOLUTE */
+  uint32_t exposure_frame;  /**< Frames delivered before the last change */
+} app_video_virtual_stats_t;
+
 /* ----------------------- Macros and Constants ----------------------- */
 
 #define CAM_DEV_PATH                                                           \
@@ -113,7 +125,7 @@ esp_err_t app_video_get_bufs(int fb_num, void **fb);
  * @brief Get the size of the video buffer.
  *
  * Calculates and returns the size of the video buffer based on the
- * camera's width, height, and pixel format (RGB565 or RGB888).
+ * camera's width, height, and the pixel format passed to app_video_open().
  *
  * @return Size of the video buffer in bytes.
  */
@@ -155,6 +167,54 @@ esp_err_t app_video_stream_task_start(int video_fd, int core_id);
  */
 esp_err_t app_video_stream_task_stop(int video_fd);
 
+/**
+ * @brief Stop the video stream task and wait for it to exit.
+ *
+ * Unlike app_video_stream_task_stop(), the device stays usable: buffers
+ * remain allocated and app_video_stream_task_start() resumes streaming.
+ * With the stream off the sensor sits in standby.
+ *
+ * @param video_fd File descriptor for the video device.
+ * @param timeout_ms Time to wait for the task to exit.
+ * @return ESP_OK on success, or ESP_ERR_TIMEOUT if the task did not exit.
+ */
+esp_err_t app_video_stream_task_stop_sync(int video_fd, uint32_t timeout_ms);
+
+/**
+ * @brief Query the range of a camera control.
+ *
+ * @param video_fd File descriptor for the video device.
+ * @param id V4L2 control ID (e.g. V4L2_CID_EXPOSURE_ABSOLUTE).
+ * @param min Pointer to receive the lowest accepted value.
+ * @param max Pointer to receive the highest accepted value.
+ * @return ESP_OK on success, or ESP_ERR_NOT_SUPPORTED if the device has no
+ * such control.
+ */
+esp_err_t app_video_query_control(int video_fd, uint32_t id, int32_t *min,
+                                  int32_t *max);
+
+/**
+ * @brief Read a camera control.
+ *
+ * @param video_fd File descriptor for the video device.
+ * @param id V4L2 control ID.
+ * @param value Pointer to receive the current value.
+ * @return ESP_OK on success, or ESP_FAIL on failure.
+ */
+esp_err_t app_video_get_control(int video_fd, uint32_t id, int32_t *value);
+
+/**
+ * @brief Set a camera control.
+ *
+ * Can be called while streaming; the new value applies to a later frame.
+ *
+ * @param video_fd File descriptor for the video device.
+ * @param id V4L2 control ID.
+ * @param value New value.
+ * @return ESP_OK on success, or ESP_FAIL on failure.
+ */
+esp_err_t app_video_set_control(int video_fd, uint32_t id, int32_t value);
+
 /**
  * @brief Register a callback for video frame operations
  *
@@ -186,3 +246,16 @@ esp_err_t app_video_close(int video_fd);
  * @return ESP_OK on success, or ESP_FAIL on failure.
  */
 esp_err_t app_video_deinit(void);
+
+#if CONFIG_APP_VIDEO_VIRTUAL_CAMERA
+/**
+ * @brief Get virtual camera delivery statistics.
+ *
+ * Counters are reset by app_video_stream_task_start() and logged when the
+ * stream stops.
+ *
+ * @param stats Pointer to receive the statistics.
+ * @return ESP_OK on success, or ESP_FAIL if stats is NULL.
+ */
+esp_err_t app_video_virtual_get_stats(app_video_virtual_stats_t *stats);
+#endif
@@ -0,0 +1,648 @@
+/* System includes */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+/* ESP-IDF includes */
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+/* Component includes */
+#if !CONFIG_APP_VIDEO_VIRTUAL_SOURCE_FILE
+#include "../../managed_components/lvgl__lvgl/src/libs/qrcode/qrcodegen.h"
+#endif
+#include "video.h"
+
+/* -------------------- Private Macros -------------------- */
+
+static const char *TAG = "video_virtual";
+
+#define MAX_BUFFER_COUNT (6)
+#define MIN_BUFFER_COUNT (2)
+#define VIDEO_TASK_STACK_SIZE (8 * 1024)
+#define VIDEO_TASK_PRIORITY (3)
+#define VIRTUAL_FD (0)
+#define BUFFER_ALIGN (64)
+#define QR_AREA_PERCENT (80)
+#define QR_QUIET_ZONE_MODULES (4)
+#define EXPOSURE_MIN (1)
+#define EXPOSURE_MAX (4000)
+#define EXPOSURE_DEFAULT (1000)
+#define SCREEN_CONTRAST (8)  /**< Screen white over screen black */
+#define SURROUND_DIMMING (4) /**< Screen white over the room around it */
+
+/* -------------------- Private Types --------------------- */
+
+/**
+ * @brief Video event IDs for task synchronization
+ */
+typedef enum {
+  VIDEO_TASK_DELETE = BIT(0),      /**< Signal to delete video task */
+  VIDEO_TASK_DELETE_DONE = BIT(1), /**< Video task deletion complete */
+} video_event_id_t;
+
+/**
+ * @brief Virtual camera context structure
+ */
+typedef struct {
+  uint8_t
+      *camera_buffer[MAX_BUFFER_COUNT]; /**< Array of camera frame buffers */
+  bool owns_buffers;                    /**< Buffers allocated here */
+  uint32_t buffer_count;                /**< Number of frame buffers */
+  size_t camera_buf_size;               /**< Size of each camera buffer */
+  uint32_t camera_buf_hes;              /**< Horizontal resolution (width) */
+  uint32_t camera_buf_ves;              /**< Vertical resolution (height) */
+  video_fmt_t pixel_format;             /**< Format set by app_video_open */
+  int video_fd;                         /**< Virtual file descriptor */
+  app_video_frame_operation_cb_t
+      user_camera_video_frame_operation_cb; /**< User callback */
+  TaskHandle_t video_stream_task_handle;    /**< Video streaming task handle */
+  EventGroupHandle_t video_event_group;     /**< Event group for task sync */
+  app_video_virtual_stats_t stats;          /**< Delivery statistics */
+  int32_t exposure;                         /**< V4L2_CID_EXPOSURE_ABSOLUTE */
+#if CONFIG_APP_VIDEO_VIRTUAL_SOURCE_FILE
+  FILE *frame_file; /**< Raw frame file being replayed */
+#else
+  uint8_t *qr_code;     /**< Encoded symbol of the current part */
+  uint32_t qr_part;     /**< Index of the part on screen */
+  uint32_t part_frames; /**< Frames the current part has been shown */
+#endif
+} app_video_virtual_t;
+
+/* ------------------ Private Variables ------------------ */
+
+static app_video_virtual_t app_virtual_video = {
+    .video_fd = -1,
+};
+
+static bool s_video_initialized = false;
+
+/* -------------- Static Function Declarations -------------- */
+
+static uint32_t video_bytes_per_pixel(video_fmt_t format);
+static void video_fill_frame(uint8_t *buf);
+static void video_stream_task(void *arg);
+
+/* ------------ Public Function Implementations ------------ */
+
+esp_err_t app_video_main(i2c_master_bus_handle_t i2c_bus_handle) {
+  (void)i2c_bus_handle;
+
+  if (s_video_initialized) {
+    ESP_LOGW(TAG, "Video system already initialized");
+    return ESP_OK;
+  }
+
+  s_video_initialized = true;
+  return ESP_OK;
+}
+
+int app_video_open(char *dev, video_fmt_t init_fmt) {
+  ESP_LOGI(TAG, "Opening virtual camera in place of %s", dev);
+
+  app_virtual_video.camera_buf_hes = CONFIG_APP_VIDEO_VIRTUAL_WIDTH;
+  app_virtual_video.camera_buf_ves = CONFIG_APP_VIDEO_VIRTUAL_HEIGHT;
+  app_virtual_video.pixel_format = init_fmt;
+
+#if CONFIG_APP_VIDEO_VIRTUAL_SOURCE_FILE
+  app_virtual_video.frame_file =
+      fopen(CONFIG_APP_VIDEO_VIRTUAL_FRAME_FILE, "rb");
+  if (!app_virtual_video.frame_file) {
+    ESP_LOGE(TAG, "failed to open %s", CONFIG_APP_VIDEO_VIRTUAL_FRAME_FILE);
+    return -1;
+  }
+#else
+  if (init_fmt != APP_VIDEO_FMT_RGB565 && init_fmt != APP_VIDEO_FMT_GREY) {
+    ESP_LOGE(TAG, "synthetic frames support RGB565 and GREY only");
+    return -1;
+  }
+
+  app_virtual_video.qr_code = malloc(qrcodegen_BUFFER_LEN_MAX);
+  if (!app_virtual_video.qr_code) {
+    ESP_LOGE(TAG, "failed to allocate QR buffer");
+    return -1;
+  }
+  app_virtual_video.qr_part = UINT32_MAX;
+  app_virtual_video.part_frames = 0;
+#endif
+  app_virtual_video.exposure = EXPOSURE_DEFAULT;
+
+  ESP_LOGI(TAG, "width=%d height=%d fps=%d jitter=%dms",
+           CONFIG_APP_VIDEO_VIRTUAL_WIDTH, CONFIG_APP_VIDEO_VIRTUAL_HEIGHT,
+           CONFIG_APP_VIDEO_VIRTUAL_FPS, CONFIG_APP_VIDEO_VIRTUAL_JITTER_MS);
+
+  app_virtual_video.video_fd = VIRTUAL_FD;
+  return VIRTUAL_FD;
+}
+
+esp_err_t app_video_set_bufs(int video_fd, uint32_t fb_num, const void **fb) {
+  if (fb_num > MAX_BUFFER_COUNT) {
+    ESP_LOGE(TAG, "buffer num is too large");
+    return ESP_FAIL;
+  } else if (fb_num < MIN_BUFFER_COUNT) {
+    ESP_LOGE(TAG, "At least two buffers are required");
+    return ESP_FAIL;
+  }
+
+  app_virtual_video.camera_buf_size = app_video_get_buf_size();
+  app_virtual_video.owns_buffers = !fb;
+
+  for (int i = 0; i < fb_num; i++) {
+    if (fb) {
+      if (!fb[i]) {
+        ESP_LOGE(TAG, "frame buffer is NULL");
+        goto errout_req_bufs;
+      }
+      app_virtual_video.camera_buffer[i] = (uint8_t *)fb[i];
+    } else {
+      app_virtual_video.camera_buffer[i] = heap_caps_aligned_calloc(
+          BUFFER_ALIGN, 1, app_virtual_video.camera_buf_size,
+          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (!app_virtual_video.camera_buffer[i]) {
+        ESP_LOGE(TAG, "failed to allocate frame buffer %d", i);
+        goto errout_req_bufs;
+      }
+    }
+  }
+  app_virtual_video.buffer_count = fb_num;
+
+  ESP_LOGI(TAG, "Video buffers setup successfully, fd: %d", video_fd);
+  return ESP_OK;
+
+errout_req_bufs:
+  if (app_virtual_video.owns_buffers) {
+    for (int i = 0; i < MAX_BUFFER_COUNT; i++) {
+      heap_caps_free(app_virtual_video.camera_buffer[i]);
+      app_virtual_video.camera_buffer[i] = NULL;
+    }
+  }
+  return ESP_FAIL;
+}
+
+esp_err_t app_video_get_bufs(int fb_num, void **fb) {
+  if (fb_num > MAX_BUFFER_COUNT) {
+    ESP_LOGE(TAG, "buffer num is too large");
+    return ESP_FAIL;
+  } else if (fb_num < MIN_BUFFER_COUNT) {
+    ESP_LOGE(TAG, "At least two buffers are required");
+    return ESP_FAIL;
+  }
+
+  for (int i = 0; i < fb_num; i++) {
+    if (app_virtual_video.camera_buffer[i] != NULL) {
+      fb[i] = app_virtual_video.camera_buffer[i];
+    } else {
+      ESP_LOGE(TAG, "frame buffer is NULL");
+      return ESP_FAIL;
+    }
+  }
+
+  return ESP_OK;
+}
+
+uint32_t app_video_get_buf_size(void) {
+  uint32_t pixels =
+      app_virtual_video.camera_buf_hes * app_virtual_video.camera_buf_ves;
+
+  if (app_virtual_video.pixel_format == APP_VIDEO_FMT_YUV420)
+    return pixels * 3 / 2;
+
+  return pixels * video_bytes_per_pixel(app_virtual_video.pixel_format);
+}
+
+esp_err_t app_video_get_resolution(uint32_t *width, uint32_t *height) {
+  if (!width || !height) {
+    ESP_LOGE(TAG, "Width or height pointer is NULL");
+    return ESP_FAIL;
+  }
+
+  *width = app_virtual_video.camera_buf_hes;
+  *height = app_virtual_video.camera_buf_ves;
+
+  return ESP_OK;
+}
+
+esp_err_t app_video_stream_task_start(int video_fd, int core_id) {
+  if (app_virtual_video.video_event_group == NULL) {
+    app_virtual_video.video_event_group = xEventGroupCreate();
+  }
+  xEventGroupClearBits(app_virtual_video.video_event_group,
+                       VIDEO_TASK_DELETE_DONE);
+
+  app_virtual_video.video_fd = video_fd;
+  memset(&app_virtual_video.stats, 0, sizeof(app_virtual_video.stats));
+
+  BaseType_t result = xTaskCreatePinnedToCore(
+      video_stream_task, "video stream task", VIDEO_TASK_STACK_SIZE, NULL,
+      VIDEO_TASK_PRIORITY, &app_virtual_video.video_stream_task_handle,
+      core_id);
+
+  if (result != pdPASS) {
+    ESP_LOGE(TAG, "failed to create video stream task");
+    return ESP_FAIL;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t app_video_stream_task_stop(int video_fd) {
+  xEventGroupSetBits(app_virtual_video.video_event_group, VIDEO_TASK_DELETE);
+
+  return ESP_OK;
+}
+
+esp_err_t app_video_stream_task_stop_sync(int video_fd, uint32_t timeout_ms) {
+  if (!app_virtual_video.video_event_group)
+    return ESP_OK;
+
+  app_video_stream_task_stop(video_fd);
+
+  EventBits_t bits = xEventGroupWaitBits(
+      app_virtual_video.video_event_group, VIDEO_TASK_DELETE_DONE, pdFALSE,
+      pdFALSE, pdMS_TO_TICKS(timeout_ms));
+  if (!(bits & VIDEO_TASK_DELETE_DONE)) {
+    ESP_LOGE(TAG, "Timeout waiting for video stream task");
+    return ESP_ERR_TIMEOUT;
+  }
+
+  app_virtual_video.video_stream_task_handle = NULL;
+  return ESP_OK;
+}
+
+/* Both sources model a manually exposed sensor */
+
+esp_err_t app_video_query_control(int video_fd, uint32_t id, int32_t *min,
+                                  int32_t *max) {
+  switch (id) {
+  case V4L2_CID_EXPOSURE_AUTO:
+    *min = *max = V4L2_EXPOSURE_MANUAL;
+    return ESP_OK;
+  case V4L2_CID_EXPOSURE_ABSOLUTE:
+    *min = EXPOSURE_MIN;
+    *max = EXPOSURE_MAX;
+    return ESP_OK;
+  default:
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+}
+
+esp_err_t app_video_get_control(int video_fd, uint32_t id, int32_t *value) {
+  switch (id) {
+  case V4L2_CID_EXPOSURE_AUTO:
+    *value = V4L2_EXPOSURE_MANUAL;
+    return ESP_OK;
+  case V4L2_CID_EXPOSURE_ABSOLUTE:
+    *value = app_virtual_video.exposure;
+    return ESP_OK;
+  default:
+    return ESP_FAIL;
+  }
+}
+
+esp_err_t app_video_set_control(int video_fd, uint32_t id, int32_t value) {
+  switch (id) {
+  case V4L2_CID_EXPOSURE_AUTO:
+    return value == V4L2_EXPOSURE_MANUAL ? ESP_OK : ESP_FAIL;
+  case V4L2_CID_EXPOSURE_ABSOLUTE:
+    if (value < EXPOSURE_MIN || value > EXPOSURE_MAX)
+      return ESP_FAIL;
+    if (value != app_virtual_video.exposure) {
+      app_virtual_video.stats.exposure_steps++;
+      app_virtual_video.stats.exposure_frame = app_virtual_video.stats.frames;
+    }
+    app_virtual_video.exposure = value;
+    return ESP_OK;
+  default:
+    return ESP_FAIL;
+  }
+}
+
+esp_err_t app_video_register_frame_operation_cb(
+    app_video_frame_operation_cb_t operation_cb) {
+  app_virtual_video.user_camera_video_frame_operation_cb = operation_cb;
+
+  return ESP_OK;
+}
+
+esp_err_t app_video_virtual_get_stats(app_video_virtual_stats_t *stats) {
+  if (!stats)
+    return ESP_FAIL;
+
+  *stats = app_virtual_video.stats;
+  return ESP_OK;
+}
+
+esp_err_t app_video_close(int video_fd) {
+  ESP_LOGI(TAG, "Closing video device, fd: %d", video_fd);
+
+  app_video_stream_task_stop(video_fd);
+
+  // Wait for task to complete cleanup
+  if (app_virtual_video.video_event_group) {
+    xEventGroupWaitBits(app_virtual_video.video_event_group,
+                        VIDEO_TASK_DELETE_DONE, pdFALSE, pdFALSE,
+                        pdMS_TO_TICKS(1000));
+    vEventGroupDelete(app_virtual_video.video_event_group);
+    app_virtual_video.video_event_group = NULL;
+  }
+
+  if (app_virtual_video.owns_buffers) {
+    for (int i = 0; i < MAX_BUFFER_COUNT; i++)
+      heap_caps_free(app_virtual_video.camera_buffer[i]);
+  }
+
+#if CONFIG_APP_VIDEO_VIRTUAL_SOURCE_FILE
+  if (app_virtual_video.frame_file)
+    fclose(app_virtual_video.frame_file);
+#else
+  free(app_virtual_video.qr_code);
+#endif
+
+  // Reset global state
+  memset(&app_virtual_video, 0, sizeof(app_virtual_video));
+  app_virtual_video.video_fd = -1;
+
+  return ESP_OK;
+}
+
+esp_err_t app_video_deinit(void) {
+  if (!s_video_initialized) {
+    ESP_LOGW(TAG, "Video system not initialized");
+    return ESP_OK;
+  }
+
+  s_video_initialized = false;
+  return ESP_OK;
+}
+
+/* ----------- Static Function Implementations ----------- */
+
+static uint32_t video_bytes_per_pixel(video_fmt_t format) {
+  switch (format) {
+  case APP_VIDEO_FMT_RAW8:
+  case APP_VIDEO_FMT_GREY:
+    return 1;
+  case APP_VIDEO_FMT_RGB888:
+    return 3;
+  default:
+    return 2;
+  }
+}
+
+#if CONFIG_APP_VIDEO_VIRTUAL_SOURCE_FILE
+
+/**
+ * @brief Scale a replayed frame to the current exposure
+ *
+ * The file holds what the sensor sees at the default exposure, so every
+ * channel scales with the exposure and clips at full scale. Highlights
+ * already clipped in the file stay clipped.
+ *
+ * @param buf Frame buffer
+ * @param size Frame size in bytes
+ */
+static void video_apply_exposure(uint8_t *buf, size_t size) {
+  uint32_t exposure = (uint32_t)app_virtual_video.exposure;
+
+  if (exposure == EXPOSURE_DEFAULT)
+    return;
+
+  if (video_bytes_per_pixel(app_virtual_video.pixel_format) != 2) {
+    for (size_t i = 0; i < size; i++)
+      buf[i] = MIN(255, buf[i] * exposure / EXPOSURE_DEFAULT);
+    return;
+  }
+
+  uint16_t *pixels = (uint16_t *)buf;
+  for (size_t i = 0; i < size / 2; i++) {
+    uint32_t r = MIN(0x1F, (pixels[i] >> 11) * exposure / EXPOSURE_DEFAULT);
+    uint32_t g =
+        MIN(0x3F, ((pixels[i] >> 5) & 0x3F) * exposure / EXPOSURE_DEFAULT);
+    uint32_t b = MIN(0x1F, (pixels[i] & 0x1F) * exposure / EXPOSURE_DEFAULT);
+    pixels[i] = (r << 11) | (g << 5) | b;
+  }
+}
+
+/**
+ * @brief Copy the next frame of the replay file, looping at the end
+ *
+ * @param buf Frame buffer to fill
+ */
+static void video_fill_frame(uint8_t *buf) {
+  size_t size = app_virtual_video.camera_buf_size;
+  FILE *file = app_virtual_video.frame_file;
+
+  if (fread(buf, 1, size, file) != size) {
+    rewind(file);
+    if (fread(buf, 1, size, file) != size) {
+      ESP_LOGW(TAG, "frame file shorter than one frame");
+      memset(buf, 0, size);
+      return;
+    }
+  }
+  video_apply_exposure(buf, size);
+}
+
+#else
+
+/**
+ * @brief Encode the current part of the synthetic pMofN sequence
+ */
+static void video_encode_part(uint32_t part) {
+  static char text[CONFIG_APP_VIDEO_VIRTUAL_QR_PART_CHARS + 16];
+  static uint8_t temp_buf[qrcodegen_BUFFER_LEN_MAX];
+
+  int len = snprintf(text, sizeof(text), "p%" PRIu32 "of%d ", part + 1,
+                     CONFIG_APP_VIDEO_VIRTUAL_QR_PARTS);
+  for (int i = 0; i < CONFIG_APP_VIDEO_VIRTUAL_QR_PART_CHARS; i++)
+    text[len + i] = 'A' + (part * 31 + i * 7) % 26;
+  text[len + CONFIG_APP_VIDEO_VIRTUAL_QR_PART_CHARS] = '\0';
+
+  if (!qrcodegen_encodeText(text, temp_buf, app_virtual_video.qr_code,
+                            qrcodegen_Ecc_MEDIUM, qrcodegen_VERSION_MIN,
+                            qrcodegen_VERSION_MAX, qrcodegen_Mask_AUTO,
+                            true)) {
+    ESP_LOGE(TAG, "failed to encode part %" PRIu32, part + 1);
+    app_virtual_video.qr_code[0] = 0;
+  }
+}
+
+/**
+ * @brief Sensor response to a scene radiance at the current exposure
+ *
+ * Linear up to full scale, then clipped.
+ *
+ * @param radiance Scene radiance, where 255 is full scale at the default
+ * exposure
+ * @return Pixel luminance
+ */
+static uint8_t video_expose(uint32_t radiance) {
+  uint32_t level =
+      radiance * (uint32_t)app_virtual_video.exposure / EXPOSURE_DEFAULT;
+  return level > 255 ? 255 : level;
+}
+
+/**
+ * @brief Fill a run of pixels with one luminance
+ *
+ * @param buf Frame buffer
+ * @param offset Index of the first pixel
+ * @param count Number of pixels
+ * @param luma Luminance, written as grey in RGB565 frames
+ */
+static void video_fill_span(uint8_t *buf, uint32_t offset, uint32_t count,
+                            uint8_t luma) {
+  if (app_virtual_video.pixel_format == APP_VIDEO_FMT_GREY) {
+    memset(buf + offset, luma, count);
+    return;
+  }
+
+  uint16_t pixel = ((luma >> 3) << 11) | ((luma >> 2) << 5) | (luma >> 3);
+  uint16_t *pixels = (uint16_t *)buf + offset;
+  for (uint32_t i = 0; i < count; i++)
+    pixels[i] = pixel;
+}
+
+/**
+ * @brief Render the current symbol, centred, as a screen in a dimmer room
+ *
+ * Every luminance goes through video_expose(), so the frame responds to
+ * V4L2_CID_EXPOSURE_ABSOLUTE the way a manually exposed sensor would: the
+ * default screen brightness clips the whites at the default exposure.
+ * Advances to the next part every CONFIG_APP_VIDEO_VIRTUAL_FRAMES_PER_PART
+ * frames.
+ *
+ * @param buf Frame buffer to fill
+ */
+static void video_fill_frame(uint8_t *buf) {
+  uint32_t width = app_virtual_video.camera_buf_hes;
+  uint32_t height = app_virtual_video.camera_buf_ves;
+  uint32_t screen = CONFIG_APP_VIDEO_VIRTUAL_SCREEN_BRIGHTNESS;
+  uint8_t white = video_expose(screen);
+  uint8_t black = video_expose(screen / SCREEN_CONTRAST);
+
+  if (app_virtual_video.part_frames == 0) {
+    app_virtual_video.qr_part =
+        (app_virtual_video.qr_part + 1) % CONFIG_APP_VIDEO_VIRTUAL_QR_PARTS;
+    video_encode_part(app_virtual_video.qr_part);
+  }
+  app_virtual_video.part_frames =
+      (app_virtual_video.part_frames + 1) %
+      CONFIG_APP_VIDEO_VIRTUAL_FRAMES_PER_PART;
+
+  video_fill_span(buf, 0, width * height,
+                  video_expose(screen / SURROUND_DIMMING));
+
+  int32_t qr_size = qrcodegen_getSize(app_virtual_video.qr_code);
+  if (qr_size <= 0)
+    return;
+
+  uint32_t area = MIN(width, height) * QR_AREA_PERCENT / 100;
+  int32_t scale = area / (qr_size + 2 * QR_QUIET_ZONE_MODULES);
+  if (scale < 1)
+    scale = 1;
+  uint32_t left = (width - qr_size * scale) / 2;
+  uint32_t top = (height - qr_size * scale) / 2;
+  uint32_t quiet = QR_QUIET_ZONE_MODULES * scale;
+
+  for (uint32_t y = top - quiet; y < top + qr_size * scale + quiet; y++) {
+    video_fill_span(buf, y * width + left - quiet,
+                    qr_size * scale + 2 * quiet, white);
+  }
+
+  for (int32_t qy = 0; qy < qr_size; qy++) {
+    for (int32_t qx = 0; qx < qr_size; qx++) {
+      if (!qrcodegen_getModule(app_virtual_video.qr_code, qx, qy))
+        continue;
+
+      for (int32_t dy = 0; dy < scale; dy++) {
+        uint32_t row = (top + qy * scale + dy) * width + left + qx * scale;
+        video_fill_span(buf, row, scale, black);
+      }
+    }
+  }
+}
+
+#endif
+
+/**
+ * @brief Virtual video streaming task
+ *
+ * Fills the buffers round-robin at the configured frame rate, plus or
+ * minus a random jitter, and hands each one to the user callback. Frames
+ * whose callback overruns the next deadline are counted as late.
+ *
+ * @param arg Task argument (unused)
+ */
+static void video_stream_task(void *arg) {
+  const int64_t period_us = 1000000 / CONFIG_APP_VIDEO_VIRTUAL_FPS;
+  int64_t next_frame_us = esp_timer_get_time();
+  uint8_t buf_index = 0;
+
+  ESP_LOGI(TAG, "Video stream task starting with fd: %d",
+           app_virtual_video.video_fd);
+
+  while (1) {
+    if (xEventGroupGetBits(app_virtual_video.video_event_group) &
+        VIDEO_TASK_DELETE) {
+      xEventGroupClearBits(app_virtual_video.video_event_group,
+                           VIDEO_TASK_DELETE);
+      ESP_LOGI(TAG,
+               "frames=%" PRIu32 " late=%" PRIu32 " avg_cb=%" PRIu32
+               "us max_cb=%" PRIu32 "us",
+               app_virtual_video.stats.frames,
+               app_virtual_video.stats.late_frames,
+               app_virtual_video.stats.frames
+                   ? (uint32_t)(app_virtual_video.stats.callback_us /
+                                app_virtual_video.stats.frames)
+                   : 0,
+               app_virtual_video.stats.max_callback_us);
+      xEventGroupSetBits(app_virtual_video.video_event_group,
+                         VIDEO_TASK_DELETE_DONE);
+      vTaskDelete(NULL);
+    }
+
+    uint8_t *buf = app_virtual_video.camera_buffer[buf_index];
+    video_fill_frame(buf);
+
+    int64_t start_us = esp_timer_get_time();
+    if (app_virtual_video.user_camera_video_frame_operation_cb) {
+      app_virtual_video.user_camera_video_frame_operation_cb(
+          buf, buf_index, app_virtual_video.camera_buf_hes,
+          app_virtual_video.camera_buf_ves, app_virtual_video.camera_buf_size);
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    uint32_t callback_us = (uint32_t)(now_us - start_us);
+    app_virtual_video.stats.frames++;
+    app_virtual_video.stats.callback_us += callback_us;
+    app_virtual_video.stats.max_callback_us =
+        MAX(app_virtual_video.stats.max_callback_us, callback_us);
+
+    buf_index = (buf_index + 1) % app_virtual_video.buffer_count;
+
+    int32_t jitter_ms = 0;
+    if (CONFIG_APP_VIDEO_VIRTUAL_JITTER_MS > 0) {
+      jitter_ms = (int32_t)(esp_random() %
+                            (2 * CONFIG_APP_VIDEO_VIRTUAL_JITTER_MS + 1)) -
+                  CONFIG_APP_VIDEO_VIRTUAL_JITTER_MS;
+    }
+    next_frame_us += period_us + jitter_ms * 1000;
+
+    if (next_frame_us <= now_us) {
+      app_virtual_video.stats.late_frames++;
+      next_frame_us = now_us;
+      taskYIELD();
+    } else {
+      vTaskDelay(MAX(1, pdMS_TO_TICKS((next_frame_us - now_us) / 1000)));
+    }
+  }
+}
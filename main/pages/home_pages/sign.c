@@ -4,7 +4,6 @@
  */
 
 #include "sign.h"
-#include "../../../components/cUR/src/types/psbt.h"
 #include "../../key/key.h"
 #include "../../psbt/psbt.h"
 #include "../../ui_components/flash_error.h"
@@ -16,6 +15,7 @@
 #include <esp_log.h>
 #include <lvgl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wally_core.h>
 #include <wally_psbt.h>
@@ -45,15 +45,13 @@ static void (*saved_return_callback)(void) = NULL;
 
 // PSBT data
 static struct wally_psbt *current_psbt = NULL;
-static char *psbt_base64 = NULL;
-static char *signed_psbt_base64 = NULL;
 static bool is_testnet = false;
 static int scanned_qr_format = FORMAT_NONE;
 
 // Forward declarations
 static void back_button_cb(lv_event_t *e);
 static void return_from_qr_scanner_cb(void);
-static bool parse_and_display_psbt(const char *base64_data);
+static bool parse_psbt(int format, uint8_t *payload, size_t payload_len);
 static void cleanup_psbt_data(void);
 static bool create_psbt_info_display(void);
 static output_type_t classify_output(size_t output_index,
@@ -108,30 +106,21 @@ static void return_from_qr_scanner_cb(void) {
     const uint8_t *cbor_data = NULL;
     size_t cbor_len = 0;
 
+    // The CBOR is parsed where the scanner's decoder holds it; it is only
+    // written for text payloads
     if (qr_scanner_get_ur_result(&ur_type, &cbor_data, &cbor_len)) {
-      // Decode PSBT from UR CBOR
-      psbt_data_t *psbt_data = psbt_from_cbor(cbor_data, cbor_len);
-      if (psbt_data) {
-        // Get raw PSBT bytes
-        size_t psbt_len;
-        const uint8_t *psbt_bytes = psbt_get_data(psbt_data, &psbt_len);
-
-        // Convert to base64
-        char *psbt_b64 = NULL;
-        if (psbt_bytes && wally_base64_from_bytes(psbt_bytes, psbt_len, 0,
-                                                  &psbt_b64) == WALLY_OK) {
-          parse_success = parse_and_display_psbt(psbt_b64);
-          wally_free_string(psbt_b64);
-        }
-        psbt_free(psbt_data);
-      }
+      parse_success = parse_psbt(FORMAT_UR, (uint8_t *)cbor_data, cbor_len);
     }
-  } else {
-    qr_content = qr_scanner_get_completed_content();
+  } else if (detected_format != FORMAT_BBQR ||
+             qr_scanner_get_bbqr_file_type() == 'P') {
+    // Base64 or binary text, or a BBQr file decoded by the parser
+    size_t content_len = 0;
+    qr_content = qr_scanner_get_completed_content_with_len(&content_len);
     if (qr_content) {
-      parse_success = parse_and_display_psbt(qr_content);
-      free(qr_content);
+      parse_success =
+          parse_psbt(detected_format, (uint8_t *)qr_content, content_len);
     }
+    free(qr_content);
   }
 
   qr_scanner_page_hide();
@@ -147,25 +136,11 @@ static void return_from_qr_scanner_cb(void) {
   }
 }
 
-static bool parse_and_display_psbt(const char *base64_data) {
-  if (!base64_data) {
-    return false;
-  }
-
+static bool parse_psbt(int format, uint8_t *payload, size_t payload_len) {
   cleanup_psbt_data();
 
-  psbt_base64 = strdup(base64_data);
-  if (!psbt_base64) {
-    return false;
-  }
-
-  int ret = wally_psbt_from_base64(base64_data, 0, &current_psbt);
-  if (ret != WALLY_OK) {
-    cleanup_psbt_data();
-    return false;
-  }
-
-  return true;
+  current_psbt = psbt_from_payload(format, payload, payload_len);
+  return current_psbt != NULL;
 }
 
 static bool create_psbt_info_display(void) {
@@ -438,33 +413,26 @@ static void sign_button_cb(lv_event_t *e) {
     return;
   }
 
-  if (signed_psbt_base64) {
-    wally_free_string(signed_psbt_base64);
-    signed_psbt_base64 = NULL;
-  }
-
   struct wally_psbt *trimmed_psbt = psbt_trim(current_psbt);
   struct wally_psbt *export_psbt = trimmed_psbt ? trimmed_psbt : current_psbt;
 
-  int ret = wally_psbt_to_base64(export_psbt, 0, &signed_psbt_base64);
+  saved_return_callback = return_callback;
+
+  // A single static QR says nothing about what the recipient can read
+  int export_format =
+      (scanned_qr_format == -1 || scanned_qr_format == FORMAT_NONE)
+          ? FORMAT_AUTO
+          : scanned_qr_format;
+
+  bool shown = qr_viewer_page_create_with_psbt(
+      lv_screen_active(), export_format, export_psbt, "Signed PSBT",
+      return_from_qr_viewer_cb);
 
   if (trimmed_psbt) {
     wally_psbt_free(trimmed_psbt);
   }
 
-  if (ret != WALLY_OK) {
-    show_flash_error("Failed to encode PSBT", NULL, 2000);
-    return;
-  }
-
-  saved_return_callback = return_callback;
-
-  int export_format =
-      (scanned_qr_format == -1) ? FORMAT_NONE : scanned_qr_format;
-
-  if (!qr_viewer_page_create_with_format(lv_screen_active(), export_format,
-                                         signed_psbt_base64, "Signed PSBT",
-                                         return_from_qr_viewer_cb)) {
+  if (!shown) {
     show_flash_error("Failed to create QR viewer", return_callback, 2000);
     return;
   }
@@ -490,16 +458,6 @@ static void cleanup_psbt_data(void) {
     current_psbt = NULL;
   }
 
-  if (psbt_base64) {
-    free(psbt_base64);
-    psbt_base64 = NULL;
-  }
-
-  if (signed_psbt_base64) {
-    wally_free_string(signed_psbt_base64);
-    signed_psbt_base64 = NULL;
-  }
-
   is_testnet = false;
   scanned_qr_format = FORMAT_NONE;
 }
@@ -9,6 +9,7 @@
 #include "../../components/video/video.h"
 #include <lvgl.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * @brief Create the QR scanner page
@@ -45,7 +46,8 @@ char *qr_scanner_get_completed_content(void);
  * @brief Get completed QR content with length information
  *
  * This function is useful for binary QR codes (like Compact SeedQRs)
- * where the content may contain null bytes.
+ * where the content may contain null bytes. The assembled buffer is handed
+ * over rather than copied, so it can be taken only once per scan.
  *
  * @param content_len Pointer to store the content length (can be NULL)
  * @return Completed QR content (caller must free), or NULL if no completed
@@ -60,6 +62,18 @@ char *qr_scanner_get_completed_content_with_len(size_t *content_len);
  */
 bool qr_scanner_is_ready(void);
 
+/**
+ * @brief Get the sharpness of the most recent camera frame
+ *
+ * Mean squared luminance gradient over a sparse grid of the decoder image.
+ * Frames much blurrier than the recent best are not decoded. Higher is
+ * sharper, so the value can also drive a focus search on boards with a
+ * focus motor (CONFIG_CAM_MOTOR_DW9714).
+ *
+ * @return Sharpness metric of the last converted frame, 0 if none yet
+ */
+uint32_t qr_scanner_get_frame_sharpness(void);
+
 /**
  * @brief Get the detected QR code format
  *
@@ -68,6 +82,14 @@ bool qr_scanner_is_ready(void);
  */
 int qr_scanner_get_format(void);
 
+/**
+ * @brief Get the file type of a BBQr scan
+ *
+ * @return BBQr file type character ('P' for PSBT, 'U' for text, ...), or
+ *         '\0' if the scanned format is not BBQr
+ */
+char qr_scanner_get_bbqr_file_type(void);
+
 /**
  * @brief Get UR result data (for UR format QR codes only)
  *
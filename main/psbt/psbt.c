@@ -1,5 +1,7 @@
 #include "psbt.h"
 #include "../key/key.h"
+#include "../utils/base_codecs.h"
+#include "../utils/qr_codes.h"
 #include "../wallet/wallet.h"
 #include <esp_log.h>
 #include <stdio.h>
@@ -14,6 +16,12 @@
 
 static const char *TAG = "PSBT";
 
+// "psbt" followed by 0xff, as sent in a byte-mode QR
+static const uint8_t PSBT_MAGIC[5] = {'p', 's', 'b', 't', 0xff};
+
+// CBOR tag 310 (crypto-psbt), which some encoders put before the bytes
+static const uint8_t CBOR_TAG_PSBT[3] = {0xD9, 0x01, 0x36};
+
 uint64_t psbt_get_input_value(const struct wally_psbt *psbt, size_t index) {
   struct wally_tx_output *utxo = NULL;
   uint64_t value = 0;
@@ -404,3 +412,75 @@ struct wally_psbt *psbt_trim(const struct wally_psbt *psbt) {
 
   return trimmed;
 }
+
+// Contents of the CBOR byte string that makes up the whole buffer
+static const uint8_t *cbor_byte_string(const uint8_t *cbor, size_t len,
+                                       size_t *out_len) {
+  if (len >= sizeof(CBOR_TAG_PSBT) &&
+      memcmp(cbor, CBOR_TAG_PSBT, sizeof(CBOR_TAG_PSBT)) == 0) {
+    cbor += sizeof(CBOR_TAG_PSBT);
+    len -= sizeof(CBOR_TAG_PSBT);
+  }
+
+  // Major type 2, length inline or in the following 1, 2, 4 or 8 bytes
+  if (len < 1 || (cbor[0] >> 5) != 2) {
+    return NULL;
+  }
+
+  uint8_t info = cbor[0] & 0x1F;
+  size_t header_len = 1;
+  uint64_t value = info;
+  if (info >= 24) {
+    if (info > 27) {
+      return NULL;
+    }
+    size_t size = (size_t)1 << (info - 24);
+    if (len < 1 + size) {
+      return NULL;
+    }
+    value = 0;
+    for (size_t i = 0; i < size; i++) {
+      value = (value << 8) | cbor[1 + i];
+    }
+    header_len += size;
+  }
+
+  if (value != len - header_len) {
+    return NULL;
+  }
+  *out_len = (size_t)value;
+  return cbor + header_len;
+}
+
+struct wally_psbt *psbt_from_payload(int format, uint8_t *data, size_t len) {
+  const uint8_t *bytes = data;
+  size_t bytes_len = len;
+
+  if (!data) {
+    return NULL;
+  }
+
+  if (format == FORMAT_UR) {
+    bytes = cbor_byte_string(data, len, &bytes_len);
+  } else if (format != FORMAT_BBQR &&
+             (len < sizeof(PSBT_MAGIC) ||
+              memcmp(data, PSBT_MAGIC, sizeof(PSBT_MAGIC)) != 0)) {
+    // Base64 text; binary from a byte-mode QR is used as it is
+    if (!base64_decode_in_place(data, len, &bytes_len)) {
+      bytes = NULL;
+    }
+  }
+
+  if (!bytes) {
+    ESP_LOGW(TAG, "No PSBT in %lu-byte payload (format %d)",
+             (unsigned long)len, format);
+    return NULL;
+  }
+
+  struct wally_psbt *psbt = NULL;
+  if (wally_psbt_from_bytes(bytes, bytes_len, 0, &psbt) != WALLY_OK) {
+    ESP_LOGW(TAG, "Invalid %lu-byte PSBT", (unsigned long)bytes_len);
+    return NULL;
+  }
+  return psbt;
+}
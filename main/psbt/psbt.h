@@ -25,6 +25,12 @@ bool psbt_get_output_derivation(const struct wally_psbt *psbt,
 // Returns number of signatures added (0 if none)
 size_t psbt_sign(struct wally_psbt *psbt, bool is_testnet);
 
+// Parse a PSBT from a completed scan of the given FORMAT_* without copying
+// the payload: UR crypto-psbt CBOR, a decoded BBQr file, base64 text
+// (decoded in place, so data is overwritten) or binary from a byte-mode QR
+// Returns new PSBT on success (caller must free), NULL on failure
+struct wally_psbt *psbt_from_payload(int format, uint8_t *data, size_t len);
+
 // Create a trimmed PSBT containing only signatures and minimal validation data
 // Returns new PSBT on success (caller must free), NULL on failure
 struct wally_psbt *psbt_trim(const struct wally_psbt *psbt);
@@ -0,0 +1,78 @@
+// Exposure Control
+
+#include "exposure_control.h"
+
+// Highlights clipped, in permille of the metered area
+#define CLIP_HIGH_ENTER 20
+#define CLIP_HIGH_EXIT 5
+#define CLIP_HIGH_SEVERE 200
+// Mean of the light class (screen white) on the 0-255 scale
+#define LIGHT_MEAN_ENTER 110
+#define LIGHT_MEAN_EXIT 150
+// Well separated: no correction started at or above this bimodality
+#define BIMODALITY_GOOD 800
+#define SETTLE_FRAMES 3
+
+enum {
+  EXPOSURE_HOLD,
+  EXPOSURE_DECREASE,
+  EXPOSURE_INCREASE,
+};
+
+void exposure_control_init(exposure_control_t *ctl, int32_t value,
+                           int32_t min, int32_t max) {
+  ctl->min = min;
+  ctl->max = max;
+  ctl->value = value < min ? min : value > max ? max : value;
+  ctl->settle = 0;
+  ctl->state = EXPOSURE_HOLD;
+}
+
+bool exposure_control_step(exposure_control_t *ctl,
+                           const k_quirc_histogram_stats_t *stats) {
+  if (ctl->settle > 0) {
+    ctl->settle--;
+    return false;
+  }
+
+  switch (ctl->state) {
+  case EXPOSURE_DECREASE:
+    if (stats->clip_high < CLIP_HIGH_EXIT)
+      ctl->state = EXPOSURE_HOLD;
+    break;
+  case EXPOSURE_INCREASE:
+    if (stats->light_mean > LIGHT_MEAN_EXIT || stats->clip_high > 0)
+      ctl->state = EXPOSURE_HOLD;
+    break;
+  default:
+    if (stats->bimodality >= BIMODALITY_GOOD && stats->clip_high == 0)
+      break;
+    if (stats->clip_high > CLIP_HIGH_ENTER)
+      ctl->state = EXPOSURE_DECREASE;
+    else if (stats->light_mean < LIGHT_MEAN_ENTER)
+      ctl->state = EXPOSURE_INCREASE;
+    break;
+  }
+
+  int32_t value = ctl->value;
+  if (ctl->state == EXPOSURE_DECREASE) {
+    // Clipping hides how far over we are, so halve when most of it is
+    value = stats->clip_high > CLIP_HIGH_SEVERE ? value / 2 : value * 3 / 4;
+  } else if (ctl->state == EXPOSURE_INCREASE) {
+    value = value * 5 / 4 + 1;
+  }
+
+  if (value < ctl->min)
+    value = ctl->min;
+  if (value > ctl->max)
+    value = ctl->max;
+  if (value == ctl->value) {
+    // Pinned at a limit: nothing more this correction can do
+    ctl->state = EXPOSURE_HOLD;
+    return false;
+  }
+
+  ctl->value = value;
+  ctl->settle = SETTLE_FRAMES;
+  return true;
+}
@@ -0,0 +1,59 @@
+/*
+ * Exposure Control
+ * Closed-loop camera exposure driven by the decoder's luminance histogram
+ *
+ * The sensor's own auto exposure meters the whole scene, so a bright phone
+ * screen in a dim room comes out blown out, its dark modules swamped by
+ * bloom, while a dim screen in daylight comes out too dark to separate. This
+ * controller meters only the symbol area instead, using the histogram
+ * k_quirc already builds to pick its threshold: it backs off while the
+ * highlights clip, opens up while the light class is too dark, and leaves
+ * the exposure alone once the histogram is cleanly two-peaked.
+ *
+ * Entering and leaving each correction use separate limits (hysteresis) and
+ * every change is followed by a few frames without adjustment, so the
+ * sensor's new setting shows up in the statistics before the next step.
+ */
+
+#ifndef EXPOSURE_CONTROL_H
+#define EXPOSURE_CONTROL_H
+
+#include <k_quirc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Controller state
+ *
+ * value is in the units of the camera control being driven.
+ */
+typedef struct {
+  int32_t value;
+  int32_t min;
+  int32_t max;
+  uint8_t settle; // frames left before the next adjustment
+  uint8_t state;  // correction in progress
+} exposure_control_t;
+
+/**
+ * @brief Start the controller from the camera's current exposure
+ *
+ * @param ctl Controller
+ * @param value Current exposure
+ * @param min Lowest exposure the camera accepts
+ * @param max Highest exposure the camera accepts
+ */
+void exposure_control_init(exposure_control_t *ctl, int32_t value,
+                           int32_t min, int32_t max);
+
+/**
+ * @brief Feed the statistics of one metered frame
+ *
+ * @param ctl Controller
+ * @param stats Histogram statistics of the frame
+ * @return true if ctl->value changed and should be applied to the camera
+ */
+bool exposure_control_step(exposure_control_t *ctl,
+                           const k_quirc_histogram_stats_t *stats);
+
+#endif // EXPOSURE_CONTROL_H
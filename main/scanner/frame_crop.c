@@ -0,0 +1,173 @@
+// Frame Crop
+
+#include "frame_crop.h"
+#include <esp_log.h>
+#include <sdkconfig.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CONFIG_SOC_PPA_SUPPORTED
+#include <driver/ppa.h>
+#endif
+
+static const char *TAG = "FRAME_CROP";
+
+struct frame_crop {
+  uint32_t src_width;
+  uint32_t src_height;
+  uint32_t dst_width;
+  uint32_t dst_height;
+  size_t bytes_per_pixel;
+#if CONFIG_SOC_PPA_SUPPORTED
+  ppa_client_handle_t ppa;
+#endif
+};
+
+#if CONFIG_SOC_PPA_SUPPORTED
+// The PPA has no 8-bit greyscale mode, but at scale 1 with the same input
+// and output format it moves pixels verbatim. Greyscale frames are therefore
+// cropped as RGB565 images of half the width, which needs even widths and
+// an even crop offset.
+static bool ppa_geometry_supported(const frame_crop_t *crop) {
+  if (crop->bytes_per_pixel == 2)
+    return true;
+  uint32_t offset = (crop->src_width - crop->dst_width) / 2;
+  return crop->bytes_per_pixel == 1 && crop->src_width % 2 == 0 &&
+         crop->dst_width % 2 == 0 && offset % 2 == 0;
+}
+
+static bool ppa_crop_init(frame_crop_t *crop) {
+  if (!ppa_geometry_supported(crop))
+    return false;
+
+  ppa_client_config_t config = {
+      .oper_type = PPA_OPERATION_SRM,
+      .max_pending_trans_num = 1,
+  };
+  esp_err_t err = ppa_register_client(&config, &crop->ppa);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "PPA unavailable (%s), cropping on the CPU",
+             esp_err_to_name(err));
+    crop->ppa = NULL;
+    return false;
+  }
+  return true;
+}
+
+static bool ppa_crop_run(frame_crop_t *crop, const uint8_t *src, uint8_t *dst,
+                         size_t dst_size) {
+  // Widths in 16-bit units, see ppa_geometry_supported()
+  uint32_t units = crop->bytes_per_pixel == 2 ? 1 : 2;
+  uint32_t src_width = crop->src_width / units;
+  uint32_t dst_width = crop->dst_width / units;
+
+  ppa_srm_oper_config_t srm = {
+      .in =
+          {
+              .buffer = src,
+              .pic_w = src_width,
+              .pic_h = crop->src_height,
+              .block_w = dst_width,
+              .block_h = crop->dst_height,
+              .block_offset_x = (src_width - dst_width) / 2,
+              .block_offset_y = (crop->src_height - crop->dst_height) / 2,
+              .srm_cm = PPA_SRM_COLOR_MODE_RGB565,
+          },
+      .out =
+          {
+              .buffer = dst,
+              .buffer_size = dst_size,
+              .pic_w = dst_width,
+              .pic_h = crop->dst_height,
+              .srm_cm = PPA_SRM_COLOR_MODE_RGB565,
+          },
+      .rotation_angle = PPA_SRM_ROTATION_ANGLE_0,
+      .scale_x = 1,
+      .scale_y = 1,
+      .mode = PPA_TRANS_MODE_BLOCKING,
+  };
+  return ppa_do_scale_rotate_mirror(crop->ppa, &srm) == ESP_OK;
+}
+#endif
+
+static void cpu_crop_run(const frame_crop_t *crop, const uint8_t *src,
+                         uint8_t *dst) {
+  size_t bpp = crop->bytes_per_pixel;
+  size_t src_stride = crop->src_width * bpp;
+  size_t dst_stride = crop->dst_width * bpp;
+  uint32_t offset_x = (crop->src_width - crop->dst_width) / 2;
+  uint32_t offset_y = (crop->src_height - crop->dst_height) / 2;
+  const uint8_t *row = src + offset_y * src_stride + offset_x * bpp;
+
+  if (src_stride == dst_stride) {
+    memcpy(dst, row, dst_stride * crop->dst_height);
+    return;
+  }
+  for (uint32_t y = 0; y < crop->dst_height; y++)
+    memcpy(dst + y * dst_stride, row + y * src_stride, dst_stride);
+}
+
+frame_crop_t *frame_crop_create(uint32_t src_width, uint32_t src_height,
+                                uint32_t dst_width, uint32_t dst_height,
+                                size_t bytes_per_pixel) {
+  if (dst_width == 0 || dst_height == 0 || dst_width > src_width ||
+      dst_height > src_height ||
+      (bytes_per_pixel != 1 && bytes_per_pixel != 2)) {
+    ESP_LOGE(TAG, "Invalid crop %lux%lu -> %lux%lu", (unsigned long)src_width,
+             (unsigned long)src_height, (unsigned long)dst_width,
+             (unsigned long)dst_height);
+    return NULL;
+  }
+
+  frame_crop_t *crop = calloc(1, sizeof(*crop));
+  if (!crop)
+    return NULL;
+
+  crop->src_width = src_width;
+  crop->src_height = src_height;
+  crop->dst_width = dst_width;
+  crop->dst_height = dst_height;
+  crop->bytes_per_pixel = bytes_per_pixel;
+
+#if CONFIG_SOC_PPA_SUPPORTED
+  ppa_crop_init(crop);
+#endif
+
+  ESP_LOGI(TAG, "Cropping %lux%lu -> %lux%lu with %s",
+           (unsigned long)src_width, (unsigned long)src_height,
+           (unsigned long)dst_width, (unsigned long)dst_height,
+           frame_crop_backend(crop));
+  return crop;
+}
+
+void frame_crop_destroy(frame_crop_t *crop) {
+  if (!crop)
+    return;
+#if CONFIG_SOC_PPA_SUPPORTED
+  if (crop->ppa)
+    ppa_unregister_client(crop->ppa);
+#endif
+  free(crop);
+}
+
+bool frame_crop_run(frame_crop_t *crop, const uint8_t *src, uint8_t *dst,
+                    size_t dst_size) {
+  if (dst_size < crop->dst_width * crop->dst_height * crop->bytes_per_pixel)
+    return false;
+
+#if CONFIG_SOC_PPA_SUPPORTED
+  if (crop->ppa)
+    return ppa_crop_run(crop, src, dst, dst_size);
+#endif
+
+  cpu_crop_run(crop, src, dst);
+  return true;
+}
+
+const char *frame_crop_backend(const frame_crop_t *crop) {
+#if CONFIG_SOC_PPA_SUPPORTED
+  if (crop->ppa)
+    return "PPA";
+#endif
+  return "CPU";
+}
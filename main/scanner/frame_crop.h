@@ -0,0 +1,64 @@
+/*
+ * Frame Crop
+ * Centre crop of camera frames into display-sized buffers
+ *
+ * On targets with a PPA the crop is a single scale-rotate-mirror transfer at
+ * scale 1, so the CPU never touches the pixels. Elsewhere (other targets,
+ * host builds, odd geometries) rows are copied with memcpy.
+ */
+
+#ifndef FRAME_CROP_H
+#define FRAME_CROP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Alignment and size granularity required of destination buffers
+ *
+ * The PPA writes through DMA, which needs whole cache lines.
+ */
+#define FRAME_CROP_BUFFER_ALIGN 128
+
+typedef struct frame_crop frame_crop_t;
+
+/**
+ * @brief Create a centre crop
+ *
+ * @param src_width Source frame width in pixels
+ * @param src_height Source frame height in pixels
+ * @param dst_width Cropped width (at most src_width)
+ * @param dst_height Cropped height (at most src_height)
+ * @param bytes_per_pixel 1 (greyscale) or 2 (RGB565)
+ * @return Crop, or NULL on invalid geometry or allocation failure
+ */
+frame_crop_t *frame_crop_create(uint32_t src_width, uint32_t src_height,
+                                uint32_t dst_width, uint32_t dst_height,
+                                size_t bytes_per_pixel);
+
+/**
+ * @brief Destroy a crop
+ *
+ * @param crop Crop (can be NULL)
+ */
+void frame_crop_destroy(frame_crop_t *crop);
+
+/**
+ * @brief Crop one frame
+ *
+ * @param crop Crop
+ * @param src Source frame
+ * @param dst Destination, FRAME_CROP_BUFFER_ALIGN aligned
+ * @param dst_size Destination size, a multiple of FRAME_CROP_BUFFER_ALIGN
+ * @return true on success
+ */
+bool frame_crop_run(frame_crop_t *crop, const uint8_t *src, uint8_t *dst,
+                    size_t dst_size);
+
+/**
+ * @brief Name of the backend in use, for logging
+ */
+const char *frame_crop_backend(const frame_crop_t *crop);
+
+#endif // FRAME_CROP_H
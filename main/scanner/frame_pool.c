@@ -0,0 +1,165 @@
+// Frame Pool
+
+#include "frame_pool.h"
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct frame_pool {
+  frame_buf_t *bufs;
+  int count;
+  frame_buf_t *latest; // mailbox for frame_pool_take_latest()
+  frame_buf_t *newest; // last published, for frame_pool_peek_newest()
+  uint32_t next_sequence;
+  portMUX_TYPE lock;
+  SemaphoreHandle_t published;
+};
+
+static uint8_t *allocate_buffer_with_fallback(size_t size) {
+  uint8_t *buffer = heap_caps_aligned_alloc(
+      FRAME_POOL_ALIGN, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!buffer) {
+    buffer = heap_caps_aligned_alloc(FRAME_POOL_ALIGN, size,
+                                     MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  return buffer;
+}
+
+frame_pool_t *frame_pool_create(int count, size_t size) {
+  frame_pool_t *pool = calloc(1, sizeof(*pool));
+  if (!pool)
+    return NULL;
+
+  size = (size + FRAME_POOL_ALIGN - 1) & ~(size_t)(FRAME_POOL_ALIGN - 1);
+  pool->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+  pool->count = count;
+
+  pool->bufs = calloc(count, sizeof(frame_buf_t));
+  if (!pool->bufs)
+    goto error;
+
+  for (int i = 0; i < count; i++) {
+    pool->bufs[i].data = allocate_buffer_with_fallback(size);
+    if (!pool->bufs[i].data)
+      goto error;
+    pool->bufs[i].size = size;
+  }
+
+  pool->published = xSemaphoreCreateBinary();
+  if (!pool->published)
+    goto error;
+
+  return pool;
+
+error:
+  frame_pool_destroy(pool);
+  return NULL;
+}
+
+void frame_pool_destroy(frame_pool_t *pool) {
+  if (!pool)
+    return;
+
+  if (pool->bufs) {
+    for (int i = 0; i < pool->count; i++)
+      heap_caps_free(pool->bufs[i].data);
+    free(pool->bufs);
+  }
+  if (pool->published)
+    vSemaphoreDelete(pool->published);
+  free(pool);
+}
+
+frame_buf_t *frame_pool_acquire(frame_pool_t *pool) {
+  frame_buf_t *buf = NULL;
+
+  taskENTER_CRITICAL(&pool->lock);
+  for (int i = 0; i < pool->count; i++) {
+    if (pool->bufs[i].refs == 0) {
+      buf = &pool->bufs[i];
+      buf->refs = 1;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&pool->lock);
+
+  return buf;
+}
+
+void frame_pool_publish(frame_pool_t *pool, frame_buf_t *buf) {
+  taskENTER_CRITICAL(&pool->lock);
+  frame_buf_t *stale = pool->latest;
+  frame_buf_t *previous = pool->newest;
+  buf->sequence = pool->next_sequence++;
+  buf->refs++; // one reference for the mailbox, one for newest
+  pool->latest = buf;
+  pool->newest = buf;
+  if (stale)
+    stale->refs--;
+  if (previous)
+    previous->refs--;
+  taskEXIT_CRITICAL(&pool->lock);
+
+  xSemaphoreGive(pool->published);
+}
+
+frame_buf_t *frame_pool_take_latest(frame_pool_t *pool, uint32_t timeout_ms) {
+  frame_buf_t *buf;
+
+  if (xSemaphoreTake(pool->published, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+    return NULL;
+
+  taskENTER_CRITICAL(&pool->lock);
+  buf = pool->latest;
+  pool->latest = NULL;
+  taskEXIT_CRITICAL(&pool->lock);
+
+  return buf;
+}
+
+frame_buf_t *frame_pool_peek_newest(frame_pool_t *pool,
+                                    const frame_buf_t *seen) {
+  frame_buf_t *buf = NULL;
+
+  taskENTER_CRITICAL(&pool->lock);
+  // seen is still held by the caller, so it cannot have been reused
+  if (pool->newest && pool->newest != seen) {
+    buf = pool->newest;
+    buf->refs++;
+  }
+  taskEXIT_CRITICAL(&pool->lock);
+
+  return buf;
+}
+
+void frame_pool_retain(frame_pool_t *pool, frame_buf_t *buf) {
+  taskENTER_CRITICAL(&pool->lock);
+  buf->refs++;
+  taskEXIT_CRITICAL(&pool->lock);
+}
+
+void frame_pool_release(frame_pool_t *pool, frame_buf_t *buf) {
+  if (!buf)
+    return;
+
+  taskENTER_CRITICAL(&pool->lock);
+  buf->refs--;
+  taskEXIT_CRITICAL(&pool->lock);
+}
+
+void frame_pool_flush(frame_pool_t *pool) {
+  taskENTER_CRITICAL(&pool->lock);
+  frame_buf_t *stale = pool->latest;
+  frame_buf_t *previous = pool->newest;
+  pool->latest = NULL;
+  pool->newest = NULL;
+  if (stale)
+    stale->refs--;
+  if (previous)
+    previous->refs--;
+  taskEXIT_CRITICAL(&pool->lock);
+
+  xSemaphoreTake(pool->published, 0);
+}
@@ -0,0 +1,129 @@
+/*
+ * Frame Pool
+ * Reference-counted camera frame buffers with a latest-frame mailbox
+ *
+ * The camera callback writes into a buffer nobody holds and publishes it.
+ * The decoder takes frames out of a single-slot mailbox. The preview peeks
+ * at the newest frame without consuming it. Each consumer holds its own
+ * reference and releases it when done, so a buffer is never overwritten
+ * while in use.
+ */
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Buffer alignment and size granularity
+ *
+ * Whole cache lines, so DMA engines such as the PPA can write into buffers.
+ */
+#define FRAME_POOL_ALIGN 128
+
+/**
+ * @brief A pooled frame buffer
+ *
+ * data and size are fixed for the lifetime of the pool. The reference count
+ * is owned by the pool and must only be changed through the functions below.
+ */
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  uint32_t width;
+  uint32_t height;
+  uint32_t sequence;
+  int refs;
+} frame_buf_t;
+
+typedef struct frame_pool frame_pool_t;
+
+/**
+ * @brief Create a pool of equally sized frame buffers
+ *
+ * @param count Number of buffers (one per concurrent holder plus one to
+ * write into)
+ * @param size Size of each buffer in bytes (rounded up to FRAME_POOL_ALIGN)
+ * @return Pool, or NULL on allocation failure
+ */
+frame_pool_t *frame_pool_create(int count, size_t size);
+
+/**
+ * @brief Destroy a pool and free its buffers
+ *
+ * All references must have been released.
+ *
+ * @param pool Pool (can be NULL)
+ */
+void frame_pool_destroy(frame_pool_t *pool);
+
+/**
+ * @brief Get a buffer nobody holds, for the producer to write into
+ *
+ * Never blocks. The caller holds the only reference.
+ *
+ * @param pool Pool
+ * @return Free buffer, or NULL if every buffer is held (drop the frame)
+ */
+frame_buf_t *frame_pool_acquire(frame_pool_t *pool);
+
+/**
+ * @brief Publish a written buffer as the latest frame
+ *
+ * Transfers the caller's reference to the mailbox, replacing (and
+ * releasing) any frame nobody took yet, and wakes a waiting consumer. The
+ * pool keeps one more reference for frame_pool_peek_newest() until the
+ * next publish.
+ *
+ * @param pool Pool
+ * @param buf Buffer returned by frame_pool_acquire()
+ */
+void frame_pool_publish(frame_pool_t *pool, frame_buf_t *buf);
+
+/**
+ * @brief Take the latest published frame out of the mailbox
+ *
+ * @param pool Pool
+ * @param timeout_ms Time to wait for a frame to be published
+ * @return Frame with a reference owned by the caller, or NULL on timeout
+ */
+frame_buf_t *frame_pool_take_latest(frame_pool_t *pool, uint32_t timeout_ms);
+
+/**
+ * @brief Get the newest published frame if it is newer than one already seen
+ *
+ * Does not consume the frame from the mailbox.
+ *
+ * @param pool Pool
+ * @param seen Frame the caller already has (can be NULL)
+ * @return Newer frame with a reference owned by the caller, or NULL
+ */
+frame_buf_t *frame_pool_peek_newest(frame_pool_t *pool,
+                                    const frame_buf_t *seen);
+
+/**
+ * @brief Add a reference to a buffer the caller already holds
+ *
+ * @param pool Pool
+ * @param buf Buffer
+ */
+void frame_pool_retain(frame_pool_t *pool, frame_buf_t *buf);
+
+/**
+ * @brief Drop a reference
+ *
+ * @param pool Pool
+ * @param buf Buffer (can be NULL)
+ */
+void frame_pool_release(frame_pool_t *pool, frame_buf_t *buf);
+
+/**
+ * @brief Empty the mailbox and the newest frame, releasing their references
+ *
+ * @param pool Pool
+ */
+void frame_pool_flush(frame_pool_t *pool);
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,282 @@
+// Frame Recorder
+
+#include "frame_recorder.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
+
+#define RECORDER_PARTITION_LABEL "storage"
+#define RECORDER_BUFFER_COUNT 2
+#define RECORDER_TASK_STACK_SIZE 4096
+#define RECORDER_TASK_PRIORITY 1
+#define RECORDER_POLL_MS 100
+#define RECORDER_MAX_PIXELS                                                    \
+  (FRAME_RECORDER_SLOT_SIZE - FRAME_RECORDER_HEADER_SIZE)
+
+struct frame_record {
+  frame_record_header_t header;
+  uint8_t pixels[RECORDER_MAX_PIXELS];
+  bool in_use;
+};
+
+static const char *TAG = "FRAME_RECORDER";
+
+static const esp_partition_t *partition = NULL;
+static frame_record_t *records = NULL;
+static QueueHandle_t record_queue = NULL;
+static TaskHandle_t recorder_task_handle = NULL;
+static SemaphoreHandle_t recorder_done_sem = NULL;
+static volatile bool recorder_running = false;
+static portMUX_TYPE records_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t slot_count = 0;
+static uint32_t next_slot = 0;
+static uint32_t next_sequence = 0;
+static bool next_slot_erased = false;
+static uint32_t dropped_frames = 0; // since the last queued record
+
+static void release_record(frame_record_t *record) {
+  taskENTER_CRITICAL(&records_lock);
+  record->in_use = false;
+  taskEXIT_CRITICAL(&records_lock);
+}
+
+// Continues the ring after the newest valid slot left by earlier sessions
+static void find_resume_point(void) {
+  frame_record_header_t header;
+  bool found = false;
+
+  next_slot = 0;
+  next_sequence = 0;
+
+  for (uint32_t slot = 0; slot < slot_count; slot++) {
+    if (esp_partition_read(partition, slot * FRAME_RECORDER_SLOT_SIZE,
+                           &header, sizeof(header)) != ESP_OK)
+      continue;
+    if (header.magic != FRAME_RECORDER_MAGIC ||
+        header.version != FRAME_RECORDER_VERSION)
+      continue;
+    if (!found || header.sequence >= next_sequence) {
+      found = true;
+      next_sequence = header.sequence + 1;
+      next_slot = (slot + 1) % slot_count;
+    }
+  }
+}
+
+static void write_record(frame_record_t *record) {
+  size_t offset = next_slot * FRAME_RECORDER_SLOT_SIZE;
+  size_t payload_len = record->header.width * record->header.height;
+
+  if (!next_slot_erased &&
+      esp_partition_erase_range(partition, offset, FRAME_RECORDER_SLOT_SIZE) !=
+          ESP_OK) {
+    ESP_LOGE(TAG, "Failed to erase slot %lu", (unsigned long)next_slot);
+    return;
+  }
+
+  record->header.sequence = next_sequence;
+  record->header.payload_crc32 =
+      esp_rom_crc32_le(0, record->pixels, payload_len);
+
+  // Pixels first: the header makes the slot valid once it is on flash
+  if (esp_partition_write(partition, offset + FRAME_RECORDER_HEADER_SIZE,
+                          record->pixels, payload_len) != ESP_OK ||
+      esp_partition_write(partition, offset, &record->header,
+                          FRAME_RECORDER_HEADER_SIZE) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write slot %lu", (unsigned long)next_slot);
+  }
+
+  next_sequence++;
+  next_slot = (next_slot + 1) % slot_count;
+  next_slot_erased = false;
+}
+
+static void recorder_task(void *pvParameters) {
+  frame_record_t *record;
+
+  while (recorder_running) {
+    // Erase ahead while idle so a write only costs the program time
+    if (!next_slot_erased) {
+      size_t offset = next_slot * FRAME_RECORDER_SLOT_SIZE;
+      esp_err_t err = esp_partition_erase_range(partition, offset,
+                                                FRAME_RECORDER_SLOT_SIZE);
+      next_slot_erased = err == ESP_OK;
+    }
+
+    if (xQueueReceive(record_queue, &record, pdMS_TO_TICKS(RECORDER_POLL_MS)) !=
+        pdTRUE)
+      continue;
+
+    write_record(record);
+    release_record(record);
+  }
+
+  xSemaphoreGive(recorder_done_sem);
+  vTaskSuspend(NULL);
+}
+
+bool frame_recorder_start(void) {
+  if (recorder_running)
+    return true;
+
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                       ESP_PARTITION_SUBTYPE_ANY,
+                                       RECORDER_PARTITION_LABEL);
+  if (!partition) {
+    ESP_LOGE(TAG, "Partition '%s' not found", RECORDER_PARTITION_LABEL);
+    return false;
+  }
+
+  slot_count = partition->size / FRAME_RECORDER_SLOT_SIZE;
+  if (slot_count < 2) {
+    ESP_LOGE(TAG, "Partition too small for recording");
+    return false;
+  }
+
+  records = heap_caps_calloc(RECORDER_BUFFER_COUNT, sizeof(frame_record_t),
+                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!records) {
+    ESP_LOGE(TAG, "Failed to allocate record buffers");
+    goto error;
+  }
+
+  record_queue = xQueueCreate(RECORDER_BUFFER_COUNT, sizeof(frame_record_t *));
+  if (!record_queue) {
+    ESP_LOGE(TAG, "Failed to create record queue");
+    goto error;
+  }
+
+  recorder_done_sem = xSemaphoreCreateBinary();
+  if (!recorder_done_sem) {
+    ESP_LOGE(TAG, "Failed to create recorder semaphore");
+    goto error;
+  }
+
+  find_resume_point();
+  next_slot_erased = false;
+  dropped_frames = 0;
+
+  recorder_running = true;
+  if (xTaskCreate(recorder_task, "frame_recorder", RECORDER_TASK_STACK_SIZE,
+                  NULL, RECORDER_TASK_PRIORITY,
+                  &recorder_task_handle) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create recorder task");
+    recorder_running = false;
+    goto error;
+  }
+
+  ESP_LOGI(TAG, "Recording to '%s': %lu slots, resuming at slot %lu",
+           RECORDER_PARTITION_LABEL, (unsigned long)slot_count,
+           (unsigned long)next_slot);
+  return true;
+
+error:
+  if (recorder_done_sem) {
+    vSemaphoreDelete(recorder_done_sem);
+    recorder_done_sem = NULL;
+  }
+  if (record_queue) {
+    vQueueDelete(record_queue);
+    record_queue = NULL;
+  }
+  if (records) {
+    heap_caps_free(records);
+    records = NULL;
+  }
+  return false;
+}
+
+void frame_recorder_stop(void) {
+  if (!recorder_running)
+    return;
+
+  recorder_running = false;
+
+  if (xSemaphoreTake(recorder_done_sem, pdMS_TO_TICKS(2000)) != pdTRUE)
+    ESP_LOGW(TAG, "Timeout waiting for recorder task");
+  vTaskDelete(recorder_task_handle);
+  recorder_task_handle = NULL;
+
+  vSemaphoreDelete(recorder_done_sem);
+  recorder_done_sem = NULL;
+  vQueueDelete(record_queue);
+  record_queue = NULL;
+  heap_caps_free(records);
+  records = NULL;
+}
+
+frame_record_t *frame_recorder_capture(const uint8_t *gray, uint32_t width,
+                                       uint32_t height) {
+  frame_record_t *record = NULL;
+  uint32_t out_width = width / FRAME_RECORDER_SCALE;
+  uint32_t out_height = height / FRAME_RECORDER_SCALE;
+
+  if (!recorder_running || out_width * out_height > RECORDER_MAX_PIXELS)
+    return NULL;
+
+  taskENTER_CRITICAL(&records_lock);
+  for (int i = 0; i < RECORDER_BUFFER_COUNT; i++) {
+    if (!records[i].in_use) {
+      record = &records[i];
+      record->in_use = true;
+      break;
+    }
+  }
+  if (!record)
+    dropped_frames++;
+  taskEXIT_CRITICAL(&records_lock);
+
+  if (!record)
+    return NULL;
+
+  for (uint32_t y = 0; y < out_height; y++) {
+    const uint8_t *src = gray + y * FRAME_RECORDER_SCALE * width;
+    uint8_t *dst = record->pixels + y * out_width;
+    for (uint32_t x = 0; x < out_width; x++)
+      dst[x] = src[x * FRAME_RECORDER_SCALE];
+  }
+
+  memset(&record->header, 0, sizeof(record->header));
+  record->header.magic = FRAME_RECORDER_MAGIC;
+  record->header.version = FRAME_RECORDER_VERSION;
+  record->header.header_size = FRAME_RECORDER_HEADER_SIZE;
+  record->header.timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000);
+  record->header.width = out_width;
+  record->header.height = out_height;
+
+  return record;
+}
+
+void frame_recorder_commit(frame_record_t *record,
+                           const frame_record_info_t *info) {
+  if (!record)
+    return;
+
+  record->header.sharpness = info->sharpness;
+  record->header.outcome = info->outcome;
+  record->header.strategy = info->strategy;
+  record->header.detected = info->detected;
+  record->header.decoded = info->decoded;
+
+  // Several decode workers commit; the count moves into exactly one header
+  taskENTER_CRITICAL(&records_lock);
+  record->header.dropped = dropped_frames;
+  dropped_frames = 0;
+  taskEXIT_CRITICAL(&records_lock);
+
+  if (xQueueSend(record_queue, &record, 0) != pdTRUE) {
+    // Not queued after all: the frames it carried and itself count as dropped
+    taskENTER_CRITICAL(&records_lock);
+    dropped_frames += record->header.dropped + 1;
+    taskEXIT_CRITICAL(&records_lock);
+    release_record(record);
+  }
+}
@@ -0,0 +1,113 @@
+/*
+ * Frame Recorder
+ * Debug capture of decoder frames to the raw storage partition
+ *
+ * Each recorded frame is the decoder's luminance image, downsampled by
+ * FRAME_RECORDER_SCALE, with its decode outcome. Frames go into fixed-size
+ * slots used as a ring, so the partition always holds the most recent
+ * window. Export with tools/frame_recorder_export.py.
+ *
+ * Flash writes run in a low-priority task that erases the next slot while
+ * idle. Frames arriving while both record buffers are busy are dropped and
+ * counted in the next slot's header. When the recorder is not started,
+ * capture returns NULL and commit does nothing.
+ */
+
+#ifndef FRAME_RECORDER_H
+#define FRAME_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FRAME_RECORDER_MAGIC 0x5246514B /* "KQFR" */
+#define FRAME_RECORDER_VERSION 1
+#define FRAME_RECORDER_SLOT_SIZE (32 * 1024)
+#define FRAME_RECORDER_HEADER_SIZE 64
+#define FRAME_RECORDER_SCALE 2
+
+/**
+ * @brief Decode outcome of a recorded frame
+ */
+typedef enum {
+  FRAME_OUTCOME_BLURRY = 0,     // rejected by the sharpness gate
+  FRAME_OUTCOME_REPEATED = 1,   // unchanged failed scene, not decoded
+  FRAME_OUTCOME_NO_CODE = 2,    // no symbol detected
+  FRAME_OUTCOME_UNREADABLE = 3, // detected but no symbol decoded
+  FRAME_OUTCOME_DECODED = 4,    // at least one symbol decoded
+  FRAME_OUTCOME_COMPLETED = 5,  // decoded and completed the scan
+} frame_outcome_t;
+
+/**
+ * @brief On-flash slot header, followed by width * height luminance bytes
+ *
+ * Written after the pixels, so a slot with a valid magic is complete.
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t sequence;     // increases across sessions; oldest slot is lowest
+  uint32_t timestamp_ms; // since boot
+  uint16_t width;
+  uint16_t height;
+  uint32_t payload_crc32;
+  uint32_t dropped;   // frames the recorder had to skip before this one
+  uint32_t sharpness; // sharpness gate metric of the frame
+  uint8_t outcome;    // frame_outcome_t
+  uint8_t strategy;   // decode strategy index used
+  uint8_t detected;   // symbols detected
+  uint8_t decoded;    // symbols decoded
+  uint8_t reserved[FRAME_RECORDER_HEADER_SIZE - 36];
+} frame_record_header_t;
+
+/**
+ * @brief Metadata supplied with a recorded frame
+ */
+typedef struct {
+  uint32_t sharpness;
+  frame_outcome_t outcome;
+  uint8_t strategy;
+  uint8_t detected;
+  uint8_t decoded;
+} frame_record_info_t;
+
+typedef struct frame_record frame_record_t;
+
+/**
+ * @brief Start the recorder on the "storage" partition
+ *
+ * Resumes after the newest slot already on flash.
+ *
+ * @return true on success
+ */
+bool frame_recorder_start(void);
+
+/**
+ * @brief Stop the recorder, finishing the frame being written
+ */
+void frame_recorder_stop(void);
+
+/**
+ * @brief Capture a luminance frame before it is modified by decoding
+ *
+ * Never blocks. The frame is downsampled into a free record buffer.
+ *
+ * @param gray Decoder image
+ * @param width Image width
+ * @param height Image height
+ * @return Record to pass to frame_recorder_commit(), or NULL if the
+ * recorder is stopped or busy (counted as dropped)
+ */
+frame_record_t *frame_recorder_capture(const uint8_t *gray, uint32_t width,
+                                       uint32_t height);
+
+/**
+ * @brief Attach the decode outcome and queue the record for writing
+ *
+ * @param record Record from frame_recorder_capture() (can be NULL)
+ * @param info Decode outcome
+ */
+void frame_recorder_commit(frame_record_t *record,
+                           const frame_record_info_t *info);
+
+#endif // FRAME_RECORDER_H
@@ -0,0 +1,41 @@
+// Scan Progress
+
+#include "scan_progress.h"
+#include <string.h>
+
+#define RING_MASK (SCAN_PROGRESS_RING_SIZE - 1)
+
+void scan_progress_ring_reset(scan_progress_ring_t *ring) {
+  memset(ring, 0, sizeof(*ring));
+}
+
+// Each index is written by one side only. The release store publishes the
+// slot contents (or frees the slot) before the other side can see the new
+// index through its acquire load.
+bool scan_progress_ring_push(scan_progress_ring_t *ring,
+                             const scan_progress_event_t *event) {
+  uint32_t head = ring->head;
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if (head - tail >= SCAN_PROGRESS_RING_SIZE) {
+    ring->dropped++;
+    return false;
+  }
+
+  ring->events[head & RING_MASK] = *event;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool scan_progress_ring_pop(scan_progress_ring_t *ring,
+                            scan_progress_event_t *event) {
+  uint32_t tail = ring->tail;
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+  if (tail == head)
+    return false;
+
+  *event = ring->events[tail & RING_MASK];
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
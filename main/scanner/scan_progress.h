@@ -0,0 +1,66 @@
+/*
+ * Scan Progress
+ * Single-producer/single-consumer event ring from the decoder to the UI
+ *
+ * The parser stage pushes an event for every parsed part; the UI drains the
+ * ring from an LVGL timer. Neither side ever blocks: when the ring is full
+ * the event is dropped and counted, and since each event carries the full
+ * progress state the next one supersedes it anyway.
+ */
+
+#ifndef SCAN_PROGRESS_H
+#define SCAN_PROGRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCAN_PROGRESS_RING_SIZE 16 // power of two
+
+/**
+ * @brief Progress after one parsed part
+ */
+typedef struct {
+  int format;        // FORMAT_* of the sequence
+  int part_index;    // part just parsed, or -1
+  int total;         // parts in the sequence, 0 if not known
+  uint16_t permille; // estimated completion, 0-1000
+  bool complete;     // the scan is complete
+} scan_progress_event_t;
+
+typedef struct {
+  scan_progress_event_t events[SCAN_PROGRESS_RING_SIZE];
+  uint32_t head; // next slot to write, owned by the producer
+  uint32_t tail; // next slot to read, owned by the consumer
+  uint32_t dropped;
+} scan_progress_ring_t;
+
+/**
+ * @brief Empty the ring
+ *
+ * Only while neither side is using it.
+ *
+ * @param ring Ring
+ */
+void scan_progress_ring_reset(scan_progress_ring_t *ring);
+
+/**
+ * @brief Append an event (producer side)
+ *
+ * @param ring Ring
+ * @param event Event to copy in
+ * @return false if the ring was full and the event was dropped
+ */
+bool scan_progress_ring_push(scan_progress_ring_t *ring,
+                             const scan_progress_event_t *event);
+
+/**
+ * @brief Take the oldest event (consumer side)
+ *
+ * @param ring Ring
+ * @param event Receives the event
+ * @return false if the ring was empty
+ */
+bool scan_progress_ring_pop(scan_progress_ring_t *ring,
+                            scan_progress_event_t *event);
+
+#endif // SCAN_PROGRESS_H
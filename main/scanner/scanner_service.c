@@ -0,0 +1,866 @@
+// Scanner Service
+
+#include "scanner_service.h"
+#include "../../components/video/video.h"
+#include "exposure_control.h"
+#include "frame_crop.h"
+#include "frame_recorder.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <k_quirc.h>
+#include <sdkconfig.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DECODE_WORKERS CONFIG_SCANNER_DECODE_WORKERS
+// Camera write target, latest-frame mailbox, preview and one per worker
+#define FRAME_POOL_SIZE (3 + DECODE_WORKERS)
+#define FRAME_WAIT_TIMEOUT_MS 100
+#define QR_DECODE_TASK_STACK_SIZE 32768
+#define QR_DECODE_TASK_NAME_LEN 16
+#define QR_DECODE_TASK_PRIORITY 5
+#define QR_DECODE_SCALE_FACTOR 2
+#define STREAM_STOP_TIMEOUT_MS 1000
+#define RGB565_RED_BITS 5
+#define RGB565_GREEN_BITS 6
+#define RGB565_BLUE_BITS 5
+#define RGB565_RED_LEVELS (1 << RGB565_RED_BITS)
+#define RGB565_GREEN_LEVELS (1 << RGB565_GREEN_BITS)
+#define RGB565_BLUE_LEVELS (1 << RGB565_BLUE_BITS)
+#define FRAME_STATS_SAMPLE_STEP 4
+#define SHARPNESS_GATE_PERCENT 50
+#define SHARPNESS_PEAK_DECAY_SHIFT 5
+#define SHARPNESS_MAX_SKIPPED_FRAMES 4
+#define SCENE_GRID_COLS 16
+#define SCENE_GRID_ROWS 16
+#define SCENE_BLOCKS (SCENE_GRID_COLS * SCENE_GRID_ROWS)
+#define SCENE_CHANGE_THRESHOLD 8
+#define SCENE_RETRY_MS 500
+
+#if CONFIG_SCANNER_CAPTURE_GREY
+#define CAPTURE_VIDEO_FMT APP_VIDEO_FMT_GREY
+#define CAPTURE_BYTES_PER_PIXEL 1
+#else
+#define CAPTURE_VIDEO_FMT APP_VIDEO_FMT_RGB565
+#define CAPTURE_BYTES_PER_PIXEL 2
+#endif
+
+#if CONFIG_SCANNER_IDLE_STREAM
+#define DEFAULT_POWER_POLICY SCANNER_POWER_STREAM
+#elif CONFIG_SCANNER_IDLE_POWER_DOWN
+#define DEFAULT_POWER_POLICY SCANNER_POWER_OFF
+#else
+#define DEFAULT_POWER_POLICY SCANNER_POWER_STANDBY
+#endif
+
+typedef enum {
+  CAMERA_OFF,
+  CAMERA_STANDBY,
+  CAMERA_STREAMING,
+} camera_state_t;
+
+typedef struct {
+  uint32_t sharpness;
+  uint8_t signature[SCENE_BLOCKS];
+} frame_stats_t;
+
+// Pipeline counters, logged when a session ends
+typedef struct {
+  uint32_t captured;     // camera frames that reached the callback
+  uint32_t dropped;      // no free pool buffer to write into
+  uint32_t processed;    // frames taken by the decoder
+  uint32_t blurry;       // rejected by the sharpness gate
+  uint32_t repeated;     // unchanged scene with every strategy tried
+  uint32_t attempts;     // detection passes run
+  int64_t busy_us;       // decoder time spent on frames
+  int64_t start_us;      // session start
+  int64_t completion_us; // scan completed, 0 if it never did
+} scan_stats_t;
+
+// Attempts made, in order, on a scene that keeps failing to decode
+typedef enum {
+  DECODE_STRATEGY_NORMAL,
+  DECODE_STRATEGY_FULL_THRESHOLD,
+  DECODE_STRATEGY_INVERTED,
+  DECODE_STRATEGY_COUNT,
+} decode_strategy_t;
+
+// One per decode task, each with its own k_quirc context
+typedef struct {
+  k_quirc_t *decoder;
+  TaskHandle_t task;
+  SemaphoreHandle_t busy; // held while a frame is processed
+} decode_worker_t;
+
+static const char *TAG = "SCANNER";
+
+static bool service_initialized = false;
+static scanner_power_policy_t power_policy = DEFAULT_POWER_POLICY;
+static camera_state_t camera_state = CAMERA_OFF;
+static int camera_fd = -1;
+static bool video_system_initialized = false;
+
+static frame_pool_t *frame_pool = NULL;
+static frame_crop_t *frame_crop = NULL;
+
+static decode_worker_t workers[DECODE_WORKERS];
+static SemaphoreHandle_t gate_lock = NULL;   // gate, scene schedule, stats
+static SemaphoreHandle_t parser_lock = NULL; // parser stage
+static QRPartParser *qr_parser = NULL;
+static scan_progress_ring_t progress_ring;
+
+static volatile bool session_active = false;
+static volatile bool scan_completed = false;
+static volatile bool first_frame_pending = false;
+static const char *session_start_kind = "";
+static volatile uint32_t frame_sharpness = 0;
+static uint32_t sharpness_peak = 0;
+static int sharpness_skipped_frames = 0;
+static uint8_t failed_scene_signature[SCENE_BLOCKS];
+static int failed_scene_attempts = 0; // strategies handed out on that scene
+static int64_t failed_scene_exhausted_us = 0; // first frame held back, or 0
+static scan_stats_t scan_stats;
+#if CONFIG_SCANNER_AUTO_EXPOSURE
+static exposure_control_t exposure;
+static bool exposure_enabled = false; // camera accepted manual exposure
+#endif
+
+#if !CONFIG_SCANNER_CAPTURE_GREY
+static const uint8_t r5_to_gray[RGB565_RED_LEVELS] = {
+    0,  2,  4,  7,  9,  12, 14, 17, 19, 22, 24, 27, 29, 31, 34, 36,
+    39, 41, 44, 46, 49, 51, 53, 56, 58, 61, 63, 66, 68, 71, 73, 76};
+
+static const uint8_t g6_to_gray[RGB565_GREEN_LEVELS] = {
+    0,   2,   4,   7,   9,   11,  14,  16,  18,  21,  23,  25,  28,
+    30,  32,  35,  37,  39,  42,  44,  46,  49,  51,  53,  56,  58,
+    60,  63,  65,  67,  70,  72,  74,  77,  79,  81,  84,  86,  88,
+    91,  93,  95,  98,  100, 102, 105, 107, 109, 112, 114, 116, 119,
+    121, 123, 126, 128, 130, 133, 135, 137, 140, 142, 144, 147};
+
+static const uint8_t b5_to_gray[RGB565_BLUE_LEVELS] = {
+    0,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 29};
+#endif
+
+// Converts the frame and, on a sparse grid of the output, measures its
+// sharpness (mean squared gradient) and a block-luminance scene signature.
+// Greyscale captures are only subsampled.
+static void frame_to_grayscale_downsample(const uint8_t *frame_data,
+                                          uint8_t *gray_data,
+                                          uint32_t src_width,
+                                          uint32_t src_height,
+                                          frame_stats_t *stats) {
+#if CONFIG_SCANNER_CAPTURE_GREY
+  const uint8_t *pixels = frame_data;
+#else
+  const uint16_t *pixels = (const uint16_t *)frame_data;
+#endif
+  uint32_t dst_width = src_width / QR_DECODE_SCALE_FACTOR;
+  uint32_t dst_height = src_height / QR_DECODE_SCALE_FACTOR;
+  uint64_t gradient_energy = 0;
+  uint32_t gradient_samples = 0;
+  uint32_t block_sums[SCENE_BLOCKS] = {0};
+  uint16_t block_samples[SCENE_BLOCKS] = {0};
+
+  for (uint32_t dst_y = 0; dst_y < dst_height; dst_y++) {
+    uint32_t src_y = dst_y * QR_DECODE_SCALE_FACTOR;
+    uint8_t *dst_row = gray_data + dst_y * dst_width;
+    for (uint32_t dst_x = 0; dst_x < dst_width; dst_x++) {
+      uint32_t src_idx = src_y * src_width + dst_x * QR_DECODE_SCALE_FACTOR;
+#if CONFIG_SCANNER_CAPTURE_GREY
+      dst_row[dst_x] = pixels[src_idx];
+#else
+      uint16_t pixel = pixels[src_idx];
+
+      uint8_t r5 = (pixel >> 11) & 0x1F;
+      uint8_t g6 = (pixel >> 5) & 0x3F;
+      uint8_t b5 = pixel & 0x1F;
+
+      dst_row[dst_x] = r5_to_gray[r5] + g6_to_gray[g6] + b5_to_gray[b5];
+#endif
+    }
+
+    if (dst_y % FRAME_STATS_SAMPLE_STEP)
+      continue;
+
+    uint32_t block_base =
+        (dst_y * SCENE_GRID_ROWS / dst_height) * SCENE_GRID_COLS;
+    const uint8_t *row_above = dst_row - dst_width;
+    for (uint32_t x = 0; x < dst_width; x += FRAME_STATS_SAMPLE_STEP) {
+      uint32_t block = block_base + x * SCENE_GRID_COLS / dst_width;
+      block_sums[block] += dst_row[x];
+      block_samples[block]++;
+
+      if (dst_y == 0 || x == 0)
+        continue;
+      int dx = dst_row[x] - dst_row[x - 1];
+      int dy = dst_row[x] - row_above[x];
+      gradient_energy += dx * dx + dy * dy;
+      gradient_samples++;
+    }
+  }
+
+  stats->sharpness =
+      gradient_samples ? (uint32_t)(gradient_energy / gradient_samples) : 0;
+  for (int i = 0; i < SCENE_BLOCKS; i++)
+    stats->signature[i] =
+        block_samples[i] ? block_sums[i] / block_samples[i] : 0;
+}
+
+// Skips frames much blurrier than the recent best, which follows the scene
+// through a slowly decaying peak. Never starves the decoder for long.
+static bool sharpness_gate_pass(uint32_t sharpness) {
+  sharpness_peak -= sharpness_peak >> SHARPNESS_PEAK_DECAY_SHIFT;
+  if (sharpness > sharpness_peak)
+    sharpness_peak = sharpness;
+
+  if (sharpness * 100 >= sharpness_peak * SHARPNESS_GATE_PERCENT ||
+      sharpness_skipped_frames >= SHARPNESS_MAX_SKIPPED_FRAMES) {
+    sharpness_skipped_frames = 0;
+    return true;
+  }
+
+  sharpness_skipped_frames++;
+  return false;
+}
+
+// A scene counts as unchanged while no block drifted past the threshold
+// from the signature of the frame that first failed to decode
+static bool scene_unchanged(const uint8_t *signature) {
+  for (int i = 0; i < SCENE_BLOCKS; i++) {
+    if (abs(signature[i] - failed_scene_signature[i]) > SCENE_CHANGE_THRESHOLD)
+      return false;
+  }
+  return true;
+}
+
+// Once every strategy failed, the scene is held back from the decoder for
+// SCENE_RETRY_MS and then gets the whole schedule again: the coarse
+// signature also matches a code slowly coming into focus or being moved.
+// Called under gate_lock.
+static bool scene_retry_due(void) {
+  int64_t now_us = esp_timer_get_time();
+
+  if (!failed_scene_exhausted_us) {
+    failed_scene_exhausted_us = now_us;
+    return false;
+  }
+  return now_us - failed_scene_exhausted_us >= SCENE_RETRY_MS * 1000LL;
+}
+
+// Snapshot of the parser's progress for the UI
+static void push_progress(int part_index) {
+  scan_progress_event_t event = {
+      .format = qr_parser_get_format(qr_parser),
+      .part_index = part_index,
+      .total = qr_parser_total_count(qr_parser),
+      .permille = (uint16_t)qr_parser_progress_permille(qr_parser),
+      .complete = scan_completed,
+  };
+
+  scan_progress_ring_push(&progress_ring, &event);
+}
+
+// Parser stage. Workers decode in parallel but their payloads go through
+// the parser, completion and the progress ring one at a time, so the ring
+// has a single producer.
+static void parse_payload(const k_quirc_result_t *result) {
+  xSemaphoreTake(parser_lock, portMAX_DELAY);
+  if (qr_parser && session_active && !scan_completed) {
+    int part_index = qr_parser_parse_with_len(
+        qr_parser, (const char *)result->data.payload,
+        result->data.payload_len);
+
+    if (part_index >= 0) {
+      if (qr_parser_is_complete(qr_parser)) {
+        scan_stats.completion_us = esp_timer_get_time();
+        scan_completed = true;
+      }
+      push_progress(part_index);
+    }
+  }
+  xSemaphoreGive(parser_lock);
+}
+
+// Runs detection with the given strategy and feeds decoded payloads to the
+// parser stage. Returns the number of codes that decoded successfully.
+static int decode_frame(k_quirc_t *decoder, uint8_t *gray_data,
+                        decode_strategy_t strategy) {
+  k_quirc_result_t qr_result;
+  int decoded = 0;
+
+  if (strategy == DECODE_STRATEGY_INVERTED) {
+    size_t gray_len = (SCANNER_FRAME_WIDTH / QR_DECODE_SCALE_FACTOR) *
+                      (SCANNER_FRAME_HEIGHT / QR_DECODE_SCALE_FACTOR);
+    for (size_t i = 0; i < gray_len; i++)
+      gray_data[i] = ~gray_data[i];
+  }
+
+  // Retries use an exact per-frame threshold instead of the smoothed one
+  if (strategy != DECODE_STRATEGY_NORMAL)
+    k_quirc_set_threshold_mode(decoder, K_QUIRC_THRESHOLD_FULL);
+  k_quirc_end(decoder, false);
+  k_quirc_set_threshold_mode(decoder, K_QUIRC_THRESHOLD_SAMPLED);
+
+  int num_codes = k_quirc_count(decoder);
+  for (int i = 0; i < num_codes; i++) {
+    if (!session_active || scan_completed)
+      break;
+
+    k_quirc_error_t err = k_quirc_decode(decoder, i, &qr_result);
+    if (err != K_QUIRC_SUCCESS || !qr_result.valid)
+      continue;
+    decoded++;
+    parse_payload(&qr_result);
+  }
+
+  return decoded;
+}
+
+#if CONFIG_SCANNER_AUTO_EXPOSURE
+// Hands the exposure back to the camera's own auto exposure
+static void exposure_release(void) {
+  if (!exposure_enabled)
+    return;
+  exposure_enabled = false;
+  if (app_video_set_control(camera_fd, V4L2_CID_EXPOSURE_AUTO,
+                            V4L2_EXPOSURE_AUTO) != ESP_OK)
+    ESP_LOGW(TAG, "Camera did not take back auto exposure");
+}
+
+// Steps the exposure controller on the histogram of a frame that passed the
+// sharpness gate. A new exposure makes a new scene for the decoder, so a
+// failed scene gets its schedule afresh. Called under gate_lock.
+static void update_exposure(const k_quirc_histogram_stats_t *hist) {
+  if (!exposure_enabled || !exposure_control_step(&exposure, hist))
+    return;
+
+  failed_scene_attempts = 0;
+  failed_scene_exhausted_us = 0;
+  ESP_LOGD(TAG, "Exposure %ld (light %u, clipped %u permille, bimodality %u)",
+           (long)exposure.value, hist->light_mean, hist->clip_high,
+           hist->bimodality);
+  if (app_video_set_control(camera_fd, V4L2_CID_EXPOSURE_ABSOLUTE,
+                            exposure.value) != ESP_OK) {
+    ESP_LOGW(TAG, "Exposure control rejected, leaving it to the camera");
+    exposure_release();
+  }
+}
+
+// Takes manual control of the exposure, starting from what the camera has
+// settled on. Leaves the camera's auto exposure alone if anything fails.
+static void exposure_setup(void) {
+  int32_t min, max, value;
+
+  exposure_enabled = false;
+  if (app_video_query_control(camera_fd, V4L2_CID_EXPOSURE_ABSOLUTE, &min,
+                              &max) != ESP_OK) {
+    ESP_LOGI(TAG, "Camera has no exposure control, using its own");
+    return;
+  }
+  if (app_video_get_control(camera_fd, V4L2_CID_EXPOSURE_ABSOLUTE, &value) !=
+          ESP_OK ||
+      app_video_set_control(camera_fd, V4L2_CID_EXPOSURE_AUTO,
+                            V4L2_EXPOSURE_MANUAL) != ESP_OK) {
+    ESP_LOGW(TAG, "Manual exposure not accepted, using the camera's own");
+    return;
+  }
+
+  exposure_control_init(&exposure, value, min, max);
+  exposure_enabled = true;
+  ESP_LOGI(TAG, "Exposure control on: %ld in [%ld, %ld]", (long)value,
+           (long)min, (long)max);
+}
+
+// Meters a frame the decoder skips, so that the exposure keeps converging
+// on a static scene that failed to decode
+static void meter_frame(k_quirc_t *decoder) {
+  k_quirc_histogram_stats_t hist;
+
+  if (!exposure_enabled || k_quirc_meter(decoder, &hist) != 0)
+    return;
+  xSemaphoreTake(gate_lock, portMAX_DELAY);
+  update_exposure(&hist);
+  xSemaphoreGive(gate_lock);
+}
+#else
+static void update_exposure(const k_quirc_histogram_stats_t *hist) {
+  (void)hist;
+}
+static void meter_frame(k_quirc_t *decoder) { (void)decoder; }
+static void exposure_setup(void) {}
+static void exposure_release(void) {}
+#endif
+
+// Applies the sharpness gate and the failed-scene strategy schedule, then
+// decodes; fills in what the frame recorder needs. The gate state is shared
+// by all workers and only touched under gate_lock.
+static frame_outcome_t gate_and_decode(k_quirc_t *decoder, uint8_t *qr_buf,
+                                       const frame_stats_t *stats,
+                                       frame_record_info_t *record_info) {
+  xSemaphoreTake(gate_lock, portMAX_DELAY);
+  scan_stats.processed++;
+  frame_sharpness = stats->sharpness;
+  if (!sharpness_gate_pass(stats->sharpness)) {
+    scan_stats.blurry++;
+    xSemaphoreGive(gate_lock);
+    return FRAME_OUTCOME_BLURRY;
+  }
+
+  // A scene that already failed only gets attempts it has not had yet;
+  // once every strategy failed, wait for the scene to change or for the
+  // retry. Strategies are reserved here, so another worker on the same scene
+  // takes the next one rather than repeating one still in flight.
+  decode_strategy_t strategy = DECODE_STRATEGY_NORMAL;
+  if (failed_scene_attempts > 0 && scene_unchanged(stats->signature)) {
+    if (failed_scene_attempts < DECODE_STRATEGY_COUNT) {
+      strategy = (decode_strategy_t)failed_scene_attempts++;
+    } else if (!scene_retry_due()) {
+      scan_stats.repeated++;
+      xSemaphoreGive(gate_lock);
+      meter_frame(decoder);
+      return FRAME_OUTCOME_REPEATED;
+    } else {
+      failed_scene_attempts = 0;
+    }
+  } else {
+    failed_scene_attempts = 0;
+  }
+  if (failed_scene_attempts == 0)
+    failed_scene_exhausted_us = 0;
+  scan_stats.attempts++;
+  xSemaphoreGive(gate_lock);
+
+  int decoded = decode_frame(decoder, qr_buf, strategy);
+  record_info->strategy = strategy;
+  record_info->detected = k_quirc_count(decoder);
+  record_info->decoded = decoded;
+
+  xSemaphoreTake(gate_lock, portMAX_DELAY);
+  frame_outcome_t outcome;
+  if (decoded > 0) {
+    failed_scene_attempts = 0;
+    outcome = scan_completed ? FRAME_OUTCOME_COMPLETED : FRAME_OUTCOME_DECODED;
+  } else {
+    if (failed_scene_attempts == 0)
+      memcpy(failed_scene_signature, stats->signature, SCENE_BLOCKS);
+    if (failed_scene_attempts < strategy + 1)
+      failed_scene_attempts = strategy + 1;
+    outcome = record_info->detected ? FRAME_OUTCOME_UNREADABLE
+                                    : FRAME_OUTCOME_NO_CODE;
+  }
+  // The inverted attempt metered a negative of the frame
+  k_quirc_histogram_stats_t hist;
+  if (strategy != DECODE_STRATEGY_INVERTED &&
+      k_quirc_get_histogram_stats(decoder, &hist) == 0)
+    update_exposure(&hist);
+  xSemaphoreGive(gate_lock);
+  return outcome;
+}
+
+// Converts, gates and decodes one frame, releasing it as soon as the
+// grayscale copy is made
+static void process_frame(decode_worker_t *worker, frame_buf_t *frame) {
+  frame_stats_t stats;
+  int decode_width, decode_height;
+
+  uint8_t *qr_buf =
+      k_quirc_begin(worker->decoder, &decode_width, &decode_height);
+  if (!qr_buf) {
+    frame_pool_release(frame_pool, frame);
+    return;
+  }
+
+  frame_to_grayscale_downsample(frame->data, qr_buf, frame->width,
+                                frame->height, &stats);
+  frame_pool_release(frame_pool, frame);
+
+  // Captured before decoding, which may invert the buffer in place
+  frame_record_t *record =
+      frame_recorder_capture(qr_buf, decode_width, decode_height);
+  frame_record_info_t record_info = {.sharpness = stats.sharpness};
+
+  record_info.outcome =
+      gate_and_decode(worker->decoder, qr_buf, &stats, &record_info);
+  frame_recorder_commit(record, &record_info);
+}
+
+static void log_scan_stats(void) {
+  int64_t end_us = scan_stats.completion_us ? scan_stats.completion_us
+                                            : esp_timer_get_time();
+  int64_t elapsed_us = end_us - scan_stats.start_us;
+
+  ESP_LOGI(TAG,
+           "Scan %s after %lld ms: captured=%lu dropped=%lu processed=%lu "
+           "blurry=%lu repeated=%lu attempts=%lu decoder_busy=%lld%%",
+           scan_stats.completion_us ? "completed" : "closed",
+           (long long)elapsed_us / 1000, (unsigned long)scan_stats.captured,
+           (unsigned long)scan_stats.dropped,
+           (unsigned long)scan_stats.processed,
+           (unsigned long)scan_stats.blurry,
+           (unsigned long)scan_stats.repeated,
+           (unsigned long)scan_stats.attempts,
+           (long long)(elapsed_us > 0 ? scan_stats.busy_us * 100 / elapsed_us
+                                      : 0));
+}
+
+// Lives as long as the service. Workers take whichever frame is newest
+// when they become free, so with two workers successive frames alternate
+// between them. Frames outside a session, or after the scan completed, are
+// released unprocessed. worker->busy is held while a frame is processed so
+// a session can end without racing the parser.
+static void qr_decode_task(void *pvParameters) {
+  decode_worker_t *worker = pvParameters;
+
+  while (true) {
+    frame_buf_t *frame =
+        frame_pool_take_latest(frame_pool, FRAME_WAIT_TIMEOUT_MS);
+    if (!frame)
+      continue;
+
+    xSemaphoreTake(worker->busy, portMAX_DELAY);
+    if (session_active && !scan_completed) {
+      int64_t start_us = esp_timer_get_time();
+      process_frame(worker, frame);
+      int64_t busy_us = esp_timer_get_time() - start_us;
+
+      xSemaphoreTake(gate_lock, portMAX_DELAY);
+      scan_stats.busy_us += busy_us;
+      xSemaphoreGive(gate_lock);
+    } else {
+      frame_pool_release(frame_pool, frame);
+    }
+    xSemaphoreGive(worker->busy);
+  }
+}
+
+// Waits until no worker is in the middle of a frame
+static void wait_workers_idle(void) {
+  for (int i = 0; i < DECODE_WORKERS; i++) {
+    if (workers[i].busy) {
+      xSemaphoreTake(workers[i].busy, portMAX_DELAY);
+      xSemaphoreGive(workers[i].busy);
+    }
+  }
+}
+
+static void camera_video_frame_operation(uint8_t *camera_buf,
+                                         uint8_t camera_buf_index,
+                                         uint32_t camera_buf_hes,
+                                         uint32_t camera_buf_ves,
+                                         size_t camera_buf_len) {
+  if (!session_active || scan_completed)
+    return;
+
+  if (first_frame_pending) {
+    first_frame_pending = false;
+    ESP_LOGI(TAG, "First frame %lld ms after %s start",
+             (long long)(esp_timer_get_time() - scan_stats.start_us) / 1000,
+             session_start_kind);
+  }
+  scan_stats.captured++;
+
+  // Only ever write into a buffer that neither the preview nor the decoder
+  // holds; if all are busy this frame is dropped. The preview picks the
+  // frame up from the pool on its own schedule.
+  frame_buf_t *frame = frame_pool_acquire(frame_pool);
+  if (!frame) {
+    scan_stats.dropped++;
+    return;
+  }
+
+  if (!frame_crop ||
+      !frame_crop_run(frame_crop, camera_buf, frame->data, frame->size)) {
+    frame_pool_release(frame_pool, frame);
+    scan_stats.dropped++;
+    return;
+  }
+  frame->width = SCANNER_FRAME_WIDTH;
+  frame->height = SCANNER_FRAME_HEIGHT;
+
+  frame_pool_publish(frame_pool, frame);
+}
+
+static void camera_close(void) {
+  if (camera_fd >= 0) {
+    exposure_release();
+    app_video_close(camera_fd);
+    camera_fd = -1;
+  }
+  frame_crop_destroy(frame_crop);
+  frame_crop = NULL;
+  if (video_system_initialized) {
+    app_video_deinit();
+    video_system_initialized = false;
+  }
+  camera_state = CAMERA_OFF;
+}
+
+static bool camera_open(void) {
+  i2c_master_bus_handle_t i2c_handle = bsp_i2c_get_handle();
+  if (!i2c_handle) {
+    ESP_LOGE(TAG, "Failed to get I2C bus handle");
+    return false;
+  }
+
+  esp_err_t err = app_video_main(i2c_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to initialize camera: %s", esp_err_to_name(err));
+    return false;
+  }
+  video_system_initialized = true;
+
+  camera_fd = app_video_open(CAM_DEV_PATH, CAPTURE_VIDEO_FMT);
+  if (camera_fd < 0) {
+    ESP_LOGE(TAG, "Failed to open camera device");
+    goto error;
+  }
+
+  uint32_t camera_width, camera_height;
+  if (app_video_get_resolution(&camera_width, &camera_height) != ESP_OK)
+    goto error;
+  frame_crop =
+      frame_crop_create(camera_width, camera_height, SCANNER_FRAME_WIDTH,
+                        SCANNER_FRAME_HEIGHT, CAPTURE_BYTES_PER_PIXEL);
+  if (!frame_crop) {
+    ESP_LOGE(TAG, "Failed to set up frame crop");
+    goto error;
+  }
+
+  if (app_video_register_frame_operation_cb(camera_video_frame_operation) !=
+          ESP_OK ||
+      app_video_set_bufs(camera_fd, CAM_BUF_NUM, NULL) != ESP_OK) {
+    // app_video_set_bufs() closes the device on failure
+    camera_fd = -1;
+    goto error;
+  }
+
+  exposure_setup();
+  camera_state = CAMERA_STANDBY;
+  return true;
+
+error:
+  camera_close();
+  return false;
+}
+
+static bool camera_start(void) {
+  if (camera_state == CAMERA_STREAMING)
+    return true;
+  if (camera_state == CAMERA_OFF && !camera_open())
+    return false;
+
+  esp_err_t err = app_video_stream_task_start(camera_fd, 0);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start camera stream task: %s",
+             esp_err_to_name(err));
+    return false;
+  }
+  camera_state = CAMERA_STREAMING;
+  return true;
+}
+
+static void camera_idle(void) {
+  switch (power_policy) {
+  case SCANNER_POWER_STREAM:
+    break;
+  case SCANNER_POWER_STANDBY:
+    if (camera_state == CAMERA_STREAMING) {
+      if (app_video_stream_task_stop_sync(camera_fd,
+                                          STREAM_STOP_TIMEOUT_MS) == ESP_OK) {
+        camera_state = CAMERA_STANDBY;
+      } else {
+        ESP_LOGW(TAG, "Stream did not stop, closing the camera");
+        camera_close();
+      }
+    }
+    break;
+  case SCANNER_POWER_OFF:
+    camera_close();
+    break;
+  }
+}
+
+static bool service_init(void) {
+  size_t frame_size =
+      SCANNER_FRAME_WIDTH * SCANNER_FRAME_HEIGHT * CAPTURE_BYTES_PER_PIXEL;
+  frame_pool = frame_pool_create(FRAME_POOL_SIZE, frame_size);
+  if (!frame_pool) {
+    ESP_LOGE(TAG, "Failed to allocate frame pool");
+    goto error;
+  }
+
+  gate_lock = xSemaphoreCreateMutex();
+  parser_lock = xSemaphoreCreateMutex();
+  if (!gate_lock || !parser_lock) {
+    ESP_LOGE(TAG, "Failed to create scanner locks");
+    goto error;
+  }
+
+  for (int i = 0; i < DECODE_WORKERS; i++) {
+    decode_worker_t *worker = &workers[i];
+
+    worker->decoder = k_quirc_new();
+    if (!worker->decoder) {
+      ESP_LOGE(TAG, "Failed to create QR decoder");
+      goto error;
+    }
+    if (k_quirc_resize(worker->decoder,
+                       SCANNER_FRAME_WIDTH / QR_DECODE_SCALE_FACTOR,
+                       SCANNER_FRAME_HEIGHT / QR_DECODE_SCALE_FACTOR) < 0) {
+      ESP_LOGE(TAG, "Failed to resize QR decoder");
+      goto error;
+    }
+    k_quirc_set_threshold_mode(worker->decoder, K_QUIRC_THRESHOLD_SAMPLED);
+
+    worker->busy = xSemaphoreCreateMutex();
+    if (!worker->busy) {
+      ESP_LOGE(TAG, "Failed to create decode worker lock");
+      goto error;
+    }
+
+    // One worker per core when there are several; a single worker floats
+    char name[QR_DECODE_TASK_NAME_LEN];
+    snprintf(name, sizeof(name), "qr_decode%d", i);
+    BaseType_t core =
+        DECODE_WORKERS > 1 ? i % portNUM_PROCESSORS : tskNO_AFFINITY;
+    BaseType_t task_result = xTaskCreatePinnedToCore(
+        qr_decode_task, name, QR_DECODE_TASK_STACK_SIZE, worker,
+        QR_DECODE_TASK_PRIORITY, &worker->task, core);
+    if (task_result != pdPASS) {
+      ESP_LOGE(TAG, "Failed to create QR decode task");
+      goto error;
+    }
+  }
+
+  service_initialized = true;
+  return true;
+
+error:
+  scanner_service_shutdown();
+  return false;
+}
+
+bool scanner_service_begin_session(void) {
+  int64_t start_us = esp_timer_get_time();
+
+  if (!service_initialized && !service_init())
+    return false;
+  scanner_service_end_session();
+
+  QRPartParser *parser = qr_parser_create();
+  if (!parser) {
+    ESP_LOGE(TAG, "Failed to create QR parser");
+    return false;
+  }
+  if (qr_parser)
+    qr_parser_destroy(qr_parser);
+  qr_parser = parser;
+
+  scan_progress_ring_reset(&progress_ring);
+  scan_completed = false;
+  frame_sharpness = 0;
+  sharpness_peak = 0;
+  sharpness_skipped_frames = 0;
+  failed_scene_attempts = 0;
+  failed_scene_exhausted_us = 0;
+  scan_stats = (scan_stats_t){.start_us = start_us};
+  session_start_kind = camera_state == CAMERA_STREAMING ? "streaming"
+                       : camera_state == CAMERA_STANDBY ? "standby"
+                                                        : "cold";
+  first_frame_pending = true;
+
+  // Drop whatever the previous session left in the mailbox
+  frame_pool_flush(frame_pool);
+
+#if CONFIG_SCANNER_FRAME_RECORDER
+  if (!frame_recorder_start())
+    ESP_LOGW(TAG, "Frame recorder unavailable");
+#endif
+
+  session_active = true;
+  if (!camera_start()) {
+    scanner_service_end_session();
+    return false;
+  }
+  return true;
+}
+
+void scanner_service_end_session(void) {
+  if (!service_initialized || !session_active)
+    return;
+
+  // Once every worker was idle after this, they release anything else
+  // they take until the next session
+  session_active = false;
+  wait_workers_idle();
+
+  log_scan_stats();
+
+#if CONFIG_SCANNER_FRAME_RECORDER
+  frame_recorder_stop();
+#endif
+
+  camera_idle();
+  frame_pool_flush(frame_pool);
+}
+
+void scanner_service_shutdown(void) {
+  scanner_service_end_session();
+  camera_close();
+
+  for (int i = 0; i < DECODE_WORKERS; i++) {
+    decode_worker_t *worker = &workers[i];
+
+    if (worker->task) {
+      // Holding busy keeps the task out of the middle of a frame
+      xSemaphoreTake(worker->busy, portMAX_DELAY);
+      vTaskDelete(worker->task);
+      worker->task = NULL;
+      xSemaphoreGive(worker->busy);
+    }
+    if (worker->busy) {
+      vSemaphoreDelete(worker->busy);
+      worker->busy = NULL;
+    }
+    if (worker->decoder) {
+      k_quirc_destroy(worker->decoder);
+      worker->decoder = NULL;
+    }
+  }
+  if (gate_lock) {
+    vSemaphoreDelete(gate_lock);
+    gate_lock = NULL;
+  }
+  if (parser_lock) {
+    vSemaphoreDelete(parser_lock);
+    parser_lock = NULL;
+  }
+  if (qr_parser) {
+    qr_parser_destroy(qr_parser);
+    qr_parser = NULL;
+  }
+  frame_pool_destroy(frame_pool);
+  frame_pool = NULL;
+  service_initialized = false;
+}
+
+void scanner_service_set_power_policy(scanner_power_policy_t policy) {
+  power_policy = policy;
+}
+
+frame_pool_t *scanner_service_get_frame_pool(void) { return frame_pool; }
+
+QRPartParser *scanner_service_get_parser(void) { return qr_parser; }
+
+bool scanner_service_is_complete(void) { return scan_completed; }
+
+bool scanner_service_poll_progress(scan_progress_event_t *event) {
+  return scan_progress_ring_pop(&progress_ring, event);
+}
+
+uint32_t scanner_service_get_frame_sharpness(void) { return frame_sharpness; }
@@ -0,0 +1,102 @@
+/*
+ * Scanner Service
+ * Long-lived camera, frame pool, QR decoder and decode task
+ *
+ * Everything is brought up by the first session and then kept, so later
+ * scans only reset the part parser and wake the camera. Between sessions
+ * the decode task idles and the camera follows the power policy.
+ */
+
+#ifndef SCANNER_SERVICE_H
+#define SCANNER_SERVICE_H
+
+#include "../utils/qr_codes.h"
+#include "frame_pool.h"
+#include "scan_progress.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCANNER_FRAME_WIDTH 720
+#define SCANNER_FRAME_HEIGHT 640
+
+/**
+ * @brief What happens to the camera between sessions
+ */
+typedef enum {
+  SCANNER_POWER_STREAM = 0, // keep streaming; fastest restart
+  SCANNER_POWER_STANDBY,    // stop the stream, keep device and buffers open
+  SCANNER_POWER_OFF,        // close the device and the video system
+} scanner_power_policy_t;
+
+/**
+ * @brief Start a scan session
+ *
+ * Brings the service up on first use, starts the camera if the power
+ * policy stopped it, and gives the session a fresh parser and progress
+ * ring. The time to the first frame is logged.
+ *
+ * @return true if the camera and decoder are running
+ */
+bool scanner_service_begin_session(void);
+
+/**
+ * @brief End the current session
+ *
+ * Waits for the frame being decoded, logs the session statistics and
+ * applies the power policy. The parser and its result stay available until
+ * the next session begins.
+ */
+void scanner_service_end_session(void);
+
+/**
+ * @brief Release the camera, buffers, decoder and task
+ *
+ * Must not be called during a session.
+ */
+void scanner_service_shutdown(void);
+
+/**
+ * @brief Choose what happens to the camera between sessions
+ *
+ * Takes effect at the next scanner_service_end_session(). The default comes
+ * from CONFIG_SCANNER_IDLE_*.
+ *
+ * @param policy Power policy
+ */
+void scanner_service_set_power_policy(scanner_power_policy_t policy);
+
+/**
+ * @brief Get the pool frames are published to, for the preview
+ *
+ * @return Frame pool, or NULL before the first session
+ */
+frame_pool_t *scanner_service_get_frame_pool(void);
+
+/**
+ * @brief Get the parser of the current or last session
+ *
+ * @return Parser, or NULL before the first session
+ */
+QRPartParser *scanner_service_get_parser(void);
+
+/**
+ * @brief Check whether the current session completed its scan
+ */
+bool scanner_service_is_complete(void);
+
+/**
+ * @brief Take the oldest progress event of the session
+ *
+ * For a single consumer, normally an LVGL timer. Never blocks.
+ *
+ * @param event Receives the event
+ * @return false if there is none
+ */
+bool scanner_service_poll_progress(scan_progress_event_t *event);
+
+/**
+ * @brief Sharpness of the most recent decoder frame, 0 if none yet
+ */
+uint32_t scanner_service_get_frame_sharpness(void);
+
+#endif // SCANNER_SERVICE_H
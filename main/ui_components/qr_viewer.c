@@ -1,7 +1,8 @@
 #include "qr_viewer.h"
-#include "../../components/cUR/src/types/psbt.h"
 #include "../../components/cUR/src/ur_encoder.h"
 #include "../../managed_components/lvgl__lvgl/src/libs/qrcode/qrcodegen.h"
+#include "../utils/base_codecs.h"
+#include "../utils/deflate.h"
 #include "../utils/qr_codes.h"
 #include "theme.h"
 #include <lvgl.h>
@@ -9,21 +10,46 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wally_core.h>
+#include <wally_psbt.h>
 
-#define MAX_QR_CHARS_PER_FRAME 400
 #define ANIMATION_INTERVAL_MS 250
 #define PROGRESS_BAR_HEIGHT 20
 #define PROGRESS_FRAME_PADD 2
 #define PROGRESS_BLOC_PAD 1
 #define MAX_QR_PARTS 100
 
-#define UR_HEADER_OVERHEAD 30
-#define UR_MAX_FRAGMENT_LEN ((MAX_QR_CHARS_PER_FRAME - UR_HEADER_OVERHEAD) / 2)
+// Frames are planned for this version at the ECC level they are drawn with,
+// about 400 bytes each
+#define QR_VIEWER_VERSION 15
+#define QR_VIEWER_ECC QR_ECC_MEDIUM
+
+#define BBQR_MAX_PARTS (36 * 36 - 1) // two base36 digits
+
+// Room before the serialised PSBT for a CBOR byte string header (type byte
+// and up to a 4-byte length), so UR can wrap it in place
+#define CBOR_HEADROOM 5
+
+// Where the text of each frame comes from. Frames are encoded one at a time
+// from the content as they are shown.
+typedef enum {
+  SOURCE_TEXT,   // pMofN chunks of text
+  SOURCE_BASE64, // pMofN chunks of base64, encoded from bytes
+  SOURCE_UR,     // fountain parts from the UR encoder
+  SOURCE_BBQR,   // BBQr parts, base32 encoded from bytes
+} QRViewerSourceKind;
 
 typedef struct {
-  char *data;
-  size_t len;
-} QRViewerPart;
+  QRViewerSourceKind kind;
+  uint8_t *buffer;     // owned allocation holding data
+  const uint8_t *data; // text, PSBT or deflated PSBT
+  size_t len;          // length of data
+  size_t text_len;     // length of data once encoded as text
+  int part_size;       // text characters per part
+  int num_parts;       // distinct parts a receiver needs
+  int version;         // QR version every part is drawn at
+  char bbqr_encoding;  // 'Z' or '2'
+  ur_encoder_t *encoder;
+} QRViewerSource;
 
 static lv_obj_t *qr_viewer_screen = NULL;
 static lv_obj_t *qr_code_obj = NULL;
@@ -32,12 +58,13 @@ static lv_obj_t **progress_rectangles = NULL;
 static int progress_rectangles_count = 0;
 
 static void (*return_callback)(void) = NULL;
-static char *qr_content_copy = NULL;
 static lv_timer_t *message_timer = NULL;
 static lv_timer_t *animation_timer = NULL;
 
-static QRViewerPart *qr_parts = NULL;
-static int qr_parts_count = 0;
+static QRViewerSource source;
+static char *frame_text = NULL; // text of the frame on display
+static size_t frame_text_size = 0;
+static int qr_version = qrcodegen_VERSION_MIN;
 static int current_part_index = 0;
 
 static void back_button_cb(lv_event_t *e) {
@@ -74,9 +101,10 @@ static lv_result_t qr_update_alphanumeric(lv_obj_t *obj, const char *text) {
     return LV_RESULT_INVALID;
   }
 
-  bool ok = qrcodegen_encodeText(text, temp_buf, qr_code, qrcodegen_Ecc_MEDIUM,
-                                 qrcodegen_VERSION_MIN, qrcodegen_VERSION_MAX,
-                                 qrcodegen_Mask_AUTO, true);
+  // Start at the planned version so every frame of a sequence matches
+  bool ok = qrcodegen_encodeText(
+      text, temp_buf, qr_code, (enum qrcodegen_Ecc)QR_VIEWER_ECC, qr_version,
+      qrcodegen_VERSION_MAX, qrcodegen_Mask_AUTO, true);
   free(temp_buf);
   if (!ok) {
     free(qr_code);
@@ -173,84 +201,202 @@ static void cleanup_progress_indicators(void) {
   progress_frame = NULL;
 }
 
-static void split_content_into_parts(const char *content) {
-  size_t content_len = strlen(content);
-  size_t max_chars = MAX_QR_CHARS_PER_FRAME;
-
-  if (content_len <= max_chars) {
-    qr_parts_count = 1;
-    qr_parts = malloc(sizeof(QRViewerPart));
-    if (!qr_parts)
-      return;
+static void put_base36(char *out, int value) {
+  static const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  out[0] = digits[value / 36];
+  out[1] = digits[value % 36];
+}
 
-    qr_parts[0].data = strdup(content);
-    qr_parts[0].len = content_len;
-    return;
+static void cleanup_source(void) {
+  if (source.encoder) {
+    ur_encoder_free(source.encoder);
   }
+  free(source.buffer);
+  memset(&source, 0, sizeof(source));
 
-  qr_parts_count = (content_len + max_chars - 1) / max_chars;
-  if (qr_parts_count > MAX_QR_PARTS) {
-    qr_parts_count = MAX_QR_PARTS;
+  free(frame_text);
+  frame_text = NULL;
+  frame_text_size = 0;
+  qr_version = qrcodegen_VERSION_MIN;
+  current_part_index = 0;
+}
+
+// Encodes part index into frame_text. UR parts come from the fountain
+// encoder in its own order, whatever the index.
+static bool render_part(int index) {
+  if (source.kind == SOURCE_UR) {
+    char *part = NULL;
+    if (!ur_encoder_next_part(source.encoder, &part)) {
+      return false;
+    }
+    free(frame_text);
+    frame_text = part;
+    frame_text_size = strlen(part) + 1;
+    return true;
   }
 
-  int prefix_len = (qr_parts_count > 9) ? 8 : 6;
-  size_t chars_per_part = max_chars - prefix_len;
-  qr_parts_count = (content_len + chars_per_part - 1) / chars_per_part;
+  size_t offset = (size_t)index * source.part_size;
+  size_t chunk_len = source.text_len - offset;
+  if (chunk_len > (size_t)source.part_size) {
+    chunk_len = source.part_size;
+  }
+
+  char *out = frame_text;
+  if (source.kind == SOURCE_BBQR) {
+    out[0] = 'B';
+    out[1] = '$';
+    out[2] = source.bbqr_encoding;
+    out[3] = 'P';
+    put_base36(out + 4, source.num_parts);
+    put_base36(out + 6, index);
+    out += BBQR_PREFIX_LENGTH;
+  } else if (source.num_parts > 1) {
+    out += snprintf(out, frame_text_size, "p%dof%d ", index + 1,
+                    source.num_parts);
+  }
+
+  // Parts start on whole base64 quads and base32 groups, so their bytes
+  // encode on their own
+  if (source.kind == SOURCE_BASE64) {
+    size_t start = offset / 4 * 3;
+    size_t end = (offset + chunk_len) / 4 * 3;
+    if (end > source.len) {
+      end = source.len;
+    }
+    base64_encode(source.data + start, end - start, out);
+  } else if (source.kind == SOURCE_BBQR) {
+    size_t start = offset / 8 * 5;
+    size_t end = (offset + chunk_len + 7) / 8 * 5;
+    if (end > source.len) {
+      end = source.len;
+    }
+    base32_encode(source.data + start, end - start, out);
+  } else {
+    memcpy(out, source.data + offset, chunk_len);
+    out[chunk_len] = '\0';
+  }
+  return true;
+}
 
-  qr_parts = malloc(qr_parts_count * sizeof(QRViewerPart));
-  if (!qr_parts) {
-    qr_parts_count = 0;
-    return;
+// Plans the source's parts and sizes the frame buffer for them
+static bool plan_source(int qr_format, int encoding) {
+  QRPartPlan plan;
+  if (!qr_plan_parts(source.text_len, qr_format, encoding, QR_VIEWER_ECC,
+                     QR_VIEWER_VERSION, &plan)) {
+    return false;
   }
 
-  for (int i = 0; i < qr_parts_count; i++) {
-    size_t offset = i * chars_per_part;
-    size_t remaining = content_len - offset;
-    size_t chunk_size =
-        (remaining > chars_per_part) ? chars_per_part : remaining;
+  source.num_parts = plan.num_parts;
+  source.part_size = plan.part_size;
+  source.version = plan.version;
+  frame_text_size = qr_capacity(QR_CAPACITY_SIZE, encoding, QR_ECC_LOW) + 1;
+  frame_text = malloc(frame_text_size);
+  return frame_text != NULL;
+}
 
-    char header[16];
-    snprintf(header, sizeof(header), "p%dof%d ", i + 1, qr_parts_count);
-    size_t header_len = strlen(header);
+static bool setup_text_source(const char *content) {
+  source.kind = SOURCE_TEXT;
+  source.buffer = (uint8_t *)strdup(content);
+  if (!source.buffer) {
+    return false;
+  }
+  source.data = source.buffer;
+  source.len = strlen(content);
+  source.text_len = source.len;
+  return plan_source(FORMAT_PMOFN, QR_ENCODING_BYTE);
+}
 
-    qr_parts[i].len = header_len + chunk_size;
-    qr_parts[i].data = malloc(qr_parts[i].len + 1);
-    if (!qr_parts[i].data) {
-      for (int j = 0; j < i; j++) {
-        free(qr_parts[j].data);
-      }
-      free(qr_parts);
-      qr_parts = NULL;
-      qr_parts_count = 0;
-      return;
-    }
+// Takes ownership of buffer, holding the PSBT at psbt
+static bool setup_base64_source(uint8_t *buffer, const uint8_t *psbt,
+                                size_t psbt_len) {
+  source.kind = SOURCE_BASE64;
+  source.buffer = buffer;
+  source.data = psbt;
+  source.len = psbt_len;
+  source.text_len = BASE64_ENCODED_LEN(psbt_len);
+  return plan_source(FORMAT_PMOFN, QR_ENCODING_BYTE);
+}
 
-    strcpy(qr_parts[i].data, header);
-    memcpy(qr_parts[i].data + header_len, content + offset, chunk_size);
-    qr_parts[i].data[qr_parts[i].len] = '\0';
-  }
+// Raw deflate of the PSBT for BBQr's "Z" encoding, or NULL when it fails
+// or does not make the PSBT smaller
+static uint8_t *bbqr_deflate(const uint8_t *psbt, size_t psbt_len,
+                             size_t *deflated_len) {
+  uint8_t *deflated = NULL;
+  if (!deflate_raw(psbt, psbt_len, &deflated, deflated_len) ||
+      *deflated_len >= psbt_len) {
+    free(deflated);
+    return NULL;
+  }
+  return deflated;
 }
 
-static void cleanup_qr_parts(void) {
-  if (qr_parts) {
-    for (int i = 0; i < qr_parts_count; i++) {
-      if (qr_parts[i].data) {
-        free(qr_parts[i].data);
-      }
-    }
-    free(qr_parts);
-    qr_parts = NULL;
+// Deflated + base32 ("Z") when bbqr_deflate() gave a stream, otherwise
+// plain base32 ("2"). Takes ownership of buffer, holding the PSBT at psbt,
+// and of deflated.
+static bool setup_bbqr_source(uint8_t *buffer, const uint8_t *psbt,
+                              size_t psbt_len, uint8_t *deflated,
+                              size_t deflated_len) {
+  source.kind = SOURCE_BBQR;
+  if (deflated) {
+    free(buffer);
+    source.buffer = deflated;
+    source.data = deflated;
+    source.len = deflated_len;
+    source.bbqr_encoding = 'Z';
+  } else {
+    source.buffer = buffer;
+    source.data = psbt;
+    source.len = psbt_len;
+    source.bbqr_encoding = '2';
+  }
+  source.text_len = BASE32_ENCODED_LEN(source.len);
+  return plan_source(FORMAT_BBQR, QR_ENCODING_ALPHANUMERIC) &&
+         source.num_parts <= BBQR_MAX_PARTS;
+}
+
+// crypto-psbt, wrapped as a CBOR byte string in the headroom before psbt.
+// The encoder keeps its own fragments, so buffer is freed.
+static bool setup_ur_source(uint8_t *buffer, uint8_t *psbt, size_t psbt_len) {
+  // Length inline, or in the next 1, 2 or 4 bytes
+  uint8_t info = psbt_len < 24      ? psbt_len
+                 : psbt_len < 256   ? 24
+                 : psbt_len < 65536 ? 25
+                                    : 26;
+  int size_bytes = info < 24 ? 0 : 1 << (info - 24);
+  uint8_t *cbor = psbt - 1 - size_bytes;
+  cbor[0] = 0x40 | info;
+  for (int i = 0; i < size_bytes; i++) {
+    cbor[size_bytes - i] = (uint8_t)(psbt_len >> (8 * i));
+  }
+  size_t cbor_len = psbt_len + 1 + size_bytes;
+
+  source.kind = SOURCE_UR;
+  source.text_len = cbor_len;
+  bool planned = plan_source(FORMAT_UR, QR_ENCODING_BYTE);
+  if (planned) {
+    source.encoder = ur_encoder_new("crypto-psbt", cbor, cbor_len,
+                                    source.part_size, 0,
+                                    UR_MIN_FRAGMENT_LENGTH);
+  }
+  free(buffer);
+
+  if (!source.encoder) {
+    return false;
   }
-  qr_parts_count = 0;
-  current_part_index = 0;
+  source.num_parts = ur_encoder_is_single_part(source.encoder)
+                         ? 1
+                         : ur_encoder_seq_len(source.encoder);
+  return true;
 }
 
 static void animation_timer_cb(lv_timer_t *timer) {
-  if (!qr_code_obj || !qr_parts || qr_parts_count <= 1) {
+  if (!qr_code_obj || !frame_text || source.num_parts <= 1) {
     return;
   }
-  current_part_index = (current_part_index + 1) % qr_parts_count;
-  qr_update_alphanumeric(qr_code_obj, qr_parts[current_part_index].data);
+  current_part_index = (current_part_index + 1) % source.num_parts;
+  if (render_part(current_part_index)) {
+    qr_update_alphanumeric(qr_code_obj, frame_text);
+  }
   update_progress_indicator(current_part_index);
 }
 
@@ -265,7 +411,7 @@ static bool setup_qr_viewer_ui(lv_obj_t *parent, const char *title) {
   lv_obj_update_layout(qr_viewer_screen);
   int32_t w = lv_obj_get_content_width(qr_viewer_screen);
   int32_t h = lv_obj_get_content_height(qr_viewer_screen);
-  if (qr_parts_count > 1) {
+  if (source.num_parts > 1) {
     h -= PROGRESS_BAR_HEIGHT + 20;
   }
   int32_t qr_size = (w < h) ? w : h;
@@ -275,11 +421,15 @@ static bool setup_qr_viewer_ui(lv_obj_t *parent, const char *title) {
     return false;
   }
   lv_qrcode_set_size(qr_code_obj, qr_size);
-  qr_update_alphanumeric(qr_code_obj, qr_parts[0].data);
+  qr_version = source.version;
+  if (!render_part(0)) {
+    return false;
+  }
+  qr_update_alphanumeric(qr_code_obj, frame_text);
   lv_obj_center(qr_code_obj);
 
-  if (qr_parts_count > 1) {
-    create_progress_indicators(qr_parts_count);
+  if (source.num_parts > 1) {
+    create_progress_indicators(source.num_parts);
     update_progress_indicator(0);
     animation_timer =
         lv_timer_create(animation_timer_cb, ANIMATION_INTERVAL_MS, NULL);
@@ -311,29 +461,27 @@ static bool setup_qr_viewer_ui(lv_obj_t *parent, const char *title) {
   return true;
 }
 
-void qr_viewer_page_create(lv_obj_t *parent, const char *qr_content,
+bool qr_viewer_page_create(lv_obj_t *parent, const char *qr_content,
                            const char *title, void (*return_cb)(void)) {
   if (!parent || !qr_content) {
-    return;
+    return false;
   }
 
   return_callback = return_cb;
   message_timer = NULL;
   animation_timer = NULL;
 
-  qr_content_copy = strdup(qr_content);
-  if (!qr_content_copy) {
-    return;
+  if (!setup_text_source(qr_content)) {
+    cleanup_source();
+    return false;
   }
 
-  split_content_into_parts(qr_content_copy);
-  if (!qr_parts || qr_parts_count == 0) {
-    free(qr_content_copy);
-    qr_content_copy = NULL;
-    return;
+  // A half-built screen would stay on top of whatever the caller shows next
+  if (!setup_qr_viewer_ui(parent, title)) {
+    qr_viewer_page_destroy();
+    return false;
   }
-
-  setup_qr_viewer_ui(parent, title);
+  return true;
 }
 
 void qr_viewer_page_show(void) {
@@ -359,14 +507,9 @@ void qr_viewer_page_destroy(void) {
     message_timer = NULL;
   }
 
-  cleanup_qr_parts();
+  cleanup_source();
   cleanup_progress_indicators();
 
-  if (qr_content_copy) {
-    free(qr_content_copy);
-    qr_content_copy = NULL;
-  }
-
   if (qr_viewer_screen) {
     lv_obj_del(qr_viewer_screen);
     qr_viewer_screen = NULL;
@@ -376,98 +519,112 @@ void qr_viewer_page_destroy(void) {
   return_callback = NULL;
 }
 
-bool qr_viewer_page_create_with_format(lv_obj_t *parent, int qr_format,
-                                       const char *content, const char *title,
-                                       void (*return_cb)(void)) {
-  if (!parent || !content) {
-    return false;
+// Frames each encoding needs, to pick the shortest in auto mode
+static int base64_frames(size_t psbt_len) {
+  QRPartPlan plan;
+  if (!qr_plan_parts(BASE64_ENCODED_LEN(psbt_len), FORMAT_PMOFN,
+                     QR_ENCODING_BYTE, QR_VIEWER_ECC, QR_VIEWER_VERSION,
+                     &plan)) {
+    return 0;
   }
+  return plan.num_parts;
+}
 
-  if (qr_format != FORMAT_UR) {
-    qr_viewer_page_create(parent, content, title, return_cb);
-    return true;
+static int ur_frames(size_t psbt_len) {
+  QRPartPlan plan;
+  if (!qr_plan_parts(psbt_len + CBOR_HEADROOM, FORMAT_UR, QR_ENCODING_BYTE,
+                     QR_VIEWER_ECC, QR_VIEWER_VERSION, &plan)) {
+    return 0;
   }
+  return plan.num_parts;
+}
 
-  size_t max_decoded_len = (strlen(content) * 3) / 4 + 1;
-  uint8_t *psbt_bytes = (uint8_t *)malloc(max_decoded_len);
-  if (!psbt_bytes) {
-    return false;
+// data_len is the length of the deflated stream, or of the PSBT for "2"
+static int bbqr_frames(size_t data_len) {
+  QRPartPlan plan;
+  if (!qr_plan_parts(BASE32_ENCODED_LEN(data_len), FORMAT_BBQR,
+                     QR_ENCODING_ALPHANUMERIC, QR_VIEWER_ECC,
+                     QR_VIEWER_VERSION, &plan) ||
+      plan.num_parts > BBQR_MAX_PARTS) {
+    return 0;
   }
+  return plan.num_parts;
+}
 
-  size_t psbt_len = 0;
-  int ret =
-      wally_base64_to_bytes(content, 0, psbt_bytes, max_decoded_len, &psbt_len);
-  if (ret != WALLY_OK) {
-    free(psbt_bytes);
+bool qr_viewer_page_create_with_psbt(lv_obj_t *parent, int qr_format,
+                                     const struct wally_psbt *psbt,
+                                     const char *title,
+                                     void (*return_cb)(void)) {
+  if (!parent || !psbt) {
     return false;
   }
 
-  psbt_data_t *psbt_data = psbt_new(psbt_bytes, psbt_len);
-  free(psbt_bytes);
-  if (!psbt_data) {
+  // One binary serialisation; every frame is encoded from it
+  size_t psbt_len = 0;
+  if (wally_psbt_get_length(psbt, 0, &psbt_len) != WALLY_OK) {
     return false;
   }
-
-  size_t cbor_len = 0;
-  uint8_t *cbor_data = psbt_to_cbor(psbt_data, &cbor_len);
-  psbt_free(psbt_data);
-  if (!cbor_data) {
+  uint8_t *buffer = malloc(CBOR_HEADROOM + psbt_len);
+  if (!buffer) {
     return false;
   }
-
-  size_t max_fragment_len = UR_MAX_FRAGMENT_LEN < 10 ? 10 : UR_MAX_FRAGMENT_LEN;
-  ur_encoder_t *encoder = ur_encoder_new("crypto-psbt", cbor_data, cbor_len,
-                                         max_fragment_len, 0, 10);
-  free(cbor_data);
-  if (!encoder) {
+  uint8_t *psbt_bytes = buffer + CBOR_HEADROOM;
+  size_t written = 0;
+  if (wally_psbt_to_bytes(psbt, 0, psbt_bytes, psbt_len, &written) !=
+          WALLY_OK ||
+      written != psbt_len) {
+    free(buffer);
     return false;
   }
 
-  bool is_single = ur_encoder_is_single_part(encoder);
-  size_t seq_len = ur_encoder_seq_len(encoder);
-  char **ur_parts_strings = NULL;
-  size_t parts_count = is_single ? 1 : (seq_len * 2 > 100 ? 100 : seq_len * 2);
-
-  ur_parts_strings = malloc(parts_count * sizeof(char *));
-  if (!ur_parts_strings) {
-    ur_encoder_free(encoder);
-    return false;
+  // Deflated once, both to count BBQr frames and to encode them
+  uint8_t *deflated = NULL;
+  size_t deflated_len = 0;
+  if (qr_format == FORMAT_AUTO || qr_format == FORMAT_BBQR) {
+    deflated = bbqr_deflate(psbt_bytes, psbt_len, &deflated_len);
   }
 
-  for (size_t i = 0; i < parts_count; i++) {
-    if (!ur_encoder_next_part(encoder, &ur_parts_strings[i])) {
-      for (size_t j = 0; j < i; j++) {
-        free(ur_parts_strings[j]);
-      }
-      free(ur_parts_strings);
-      ur_encoder_free(encoder);
-      return false;
+  // In auto mode, use whichever encoding needs the fewest frames, pMofN
+  // first on ties as the most widely readable
+  if (qr_format == FORMAT_AUTO) {
+    int frames = base64_frames(psbt_len);
+    qr_format = FORMAT_PMOFN;
+
+    int candidate = ur_frames(psbt_len);
+    if (candidate > 0 && (frames == 0 || candidate < frames)) {
+      frames = candidate;
+      qr_format = FORMAT_UR;
+    }
+    candidate = bbqr_frames(deflated ? deflated_len : psbt_len);
+    if (candidate > 0 && (frames == 0 || candidate < frames)) {
+      qr_format = FORMAT_BBQR;
     }
   }
-  ur_encoder_free(encoder);
 
-  return_callback = return_cb;
-  message_timer = NULL;
-  animation_timer = NULL;
+  if (qr_format != FORMAT_BBQR) {
+    free(deflated);
+  }
 
-  qr_parts_count = parts_count;
-  qr_parts = malloc(qr_parts_count * sizeof(QRViewerPart));
-  if (!qr_parts) {
-    for (size_t i = 0; i < parts_count; i++) {
-      free(ur_parts_strings[i]);
-    }
-    free(ur_parts_strings);
+  bool ok;
+  if (qr_format == FORMAT_UR) {
+    ok = setup_ur_source(buffer, psbt_bytes, psbt_len);
+  } else if (qr_format == FORMAT_BBQR) {
+    ok = setup_bbqr_source(buffer, psbt_bytes, psbt_len, deflated,
+                           deflated_len);
+  } else {
+    ok = setup_base64_source(buffer, psbt_bytes, psbt_len);
+  }
+  if (!ok) {
+    cleanup_source();
     return false;
   }
 
-  for (int i = 0; i < qr_parts_count; i++) {
-    qr_parts[i].len = strlen(ur_parts_strings[i]);
-    qr_parts[i].data = ur_parts_strings[i];
-  }
-  free(ur_parts_strings);
+  return_callback = return_cb;
+  message_timer = NULL;
+  animation_timer = NULL;
 
   if (!setup_qr_viewer_ui(parent, title)) {
-    cleanup_qr_parts();
+    qr_viewer_page_destroy();
     return false;
   }
   return true;
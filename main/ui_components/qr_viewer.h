@@ -3,28 +3,34 @@
 
 #include <lvgl.h>
 
+struct wally_psbt;
+
 /**
  * Create the QR viewer page
  * @param parent Parent LVGL object
  * @param qr_content Content to display as QR code
  * @param title Optional title to display (can be NULL)
  * @param return_cb Callback function to call when returning
+ * @return true on success, false on failure (nothing is left on screen)
  */
-void qr_viewer_page_create(lv_obj_t *parent, const char *qr_content,
+bool qr_viewer_page_create(lv_obj_t *parent, const char *qr_content,
                            const char *title, void (*return_cb)(void));
 
 /**
- * Create the QR viewer page with format support
+ * Create the QR viewer page for a PSBT
+ * The PSBT is serialised once; each frame is encoded from it when shown
  * @param parent Parent LVGL object
- * @param qr_format QR format (FORMAT_NONE, FORMAT_PMOFN, FORMAT_UR)
- * @param content Content or base64 PSBT string
+ * @param qr_format QR format (FORMAT_NONE, FORMAT_PMOFN, FORMAT_UR,
+ * FORMAT_BBQR, or FORMAT_AUTO for whichever needs the fewest frames)
+ * @param psbt PSBT to display (not kept after the call)
  * @param title Optional title to display (can be NULL)
  * @param return_cb Callback function to call when returning
- * @return true on success, false on failure
+ * @return true on success, false on failure (nothing is left on screen)
  */
-bool qr_viewer_page_create_with_format(lv_obj_t *parent, int qr_format,
-                                       const char *content, const char *title,
-                                       void (*return_cb)(void));
+bool qr_viewer_page_create_with_psbt(lv_obj_t *parent, int qr_format,
+                                     const struct wally_psbt *psbt,
+                                     const char *title,
+                                     void (*return_cb)(void));
 
 /**
  * Show the QR viewer page
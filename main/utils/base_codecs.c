@@ -0,0 +1,173 @@
+// Base Codecs
+
+#include "base_codecs.h"
+
+static int base64_value(uint8_t c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+bool base64_decode_in_place(uint8_t *data, size_t len, size_t *out_len) {
+  // Up to two '=' pad the last group to four characters
+  if (len >= 1 && data[len - 1] == '=')
+    len--;
+  if (len >= 1 && data[len - 1] == '=')
+    len--;
+  if (len % 4 == 1)
+    return false;
+
+  size_t out = 0;
+  uint32_t bits = 0;
+  int count = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    int value = base64_value(data[i]);
+    if (value < 0)
+      return false;
+    bits = (bits << 6) | (uint32_t)value;
+    if (++count == 4) {
+      data[out++] = (uint8_t)(bits >> 16);
+      data[out++] = (uint8_t)(bits >> 8);
+      data[out++] = (uint8_t)bits;
+      bits = 0;
+      count = 0;
+    }
+  }
+
+  // A partial group of 2 or 3 characters carries 1 or 2 bytes
+  if (count == 2) {
+    data[out++] = (uint8_t)(bits >> 4);
+  } else if (count == 3) {
+    data[out++] = (uint8_t)(bits >> 10);
+    data[out++] = (uint8_t)(bits >> 2);
+  }
+
+  *out_len = out;
+  return true;
+}
+
+size_t base64_encode(const uint8_t *data, size_t len, char *out) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t pos = 0;
+  size_t i = 0;
+
+  for (; i + 3 <= len; i += 3) {
+    uint32_t bits = (uint32_t)data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+    out[pos++] = alphabet[bits >> 18];
+    out[pos++] = alphabet[(bits >> 12) & 0x3F];
+    out[pos++] = alphabet[(bits >> 6) & 0x3F];
+    out[pos++] = alphabet[bits & 0x3F];
+  }
+
+  if (i < len) {
+    uint32_t bits = (uint32_t)data[i] << 16;
+    if (i + 1 < len)
+      bits |= data[i + 1] << 8;
+    out[pos++] = alphabet[bits >> 18];
+    out[pos++] = alphabet[(bits >> 12) & 0x3F];
+    out[pos++] = i + 1 < len ? alphabet[(bits >> 6) & 0x3F] : '=';
+    out[pos++] = '=';
+  }
+
+  out[pos] = '\0';
+  return pos;
+}
+
+static int base32_value(uint8_t c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= '2' && c <= '7')
+    return c - '2' + 26;
+  return -1;
+}
+
+bool base32_decode(const char *text, size_t len, uint8_t *out,
+                   size_t *out_len) {
+  // Bytes carried by a final group of n characters, -1 if impossible
+  static const int8_t tail_bytes[8] = {0, -1, 1, -1, 2, 3, -1, 4};
+  int tail = tail_bytes[len % 8];
+  if (tail < 0)
+    return false;
+
+  size_t pos = 0;
+  uint64_t bits = 0;
+  int count = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    int value = base32_value((uint8_t)text[i]);
+    if (value < 0)
+      return false;
+    bits = (bits << 5) | (uint64_t)value;
+    if (++count == 8) {
+      for (int shift = 32; shift >= 0; shift -= 8)
+        out[pos++] = (uint8_t)(bits >> shift);
+      bits = 0;
+      count = 0;
+    }
+  }
+
+  // Left-align the partial group in 40 bits, then take its whole bytes
+  bits <<= 5 * (8 - count);
+  for (int i = 0; i < tail; i++)
+    out[pos++] = (uint8_t)(bits >> (32 - 8 * i));
+
+  *out_len = pos;
+  return true;
+}
+
+size_t base32_encode(const uint8_t *data, size_t len, char *out) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+  size_t pos = 0;
+  uint32_t bits = 0;
+  int count = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    bits = (bits << 8) | data[i];
+    count += 8;
+    while (count >= 5) {
+      count -= 5;
+      out[pos++] = alphabet[(bits >> count) & 0x1F];
+    }
+  }
+  if (count > 0)
+    out[pos++] = alphabet[(bits << (5 - count)) & 0x1F];
+
+  out[pos] = '\0';
+  return pos;
+}
+
+static int hex_value(uint8_t c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+bool hex_decode(const char *text, size_t len, uint8_t *out, size_t *out_len) {
+  if (len % 2)
+    return false;
+
+  for (size_t i = 0; i < len; i += 2) {
+    int high = hex_value((uint8_t)text[i]);
+    int low = hex_value((uint8_t)text[i + 1]);
+    if (high < 0 || low < 0)
+      return false;
+    out[i / 2] = (uint8_t)(high << 4 | low);
+  }
+
+  *out_len = len / 2;
+  return true;
+}
@@ -0,0 +1,91 @@
+/*
+ * Base Codecs
+ * Text-to-binary decoding for scanned payloads, and the encodings used to
+ * display them
+ *
+ * Decoders can work in place: the output is never longer than the text, and
+ * each output byte is written only after the text it comes from has been
+ * read, so a scanned buffer can be turned into its binary payload without
+ * a second allocation.
+ */
+
+#ifndef BASE_CODECS_H
+#define BASE_CODECS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Decode standard base64 (RFC 4648) in place
+ *
+ * Padding is optional; whitespace and the URL-safe alphabet are rejected.
+ *
+ * @param data Base64 text, overwritten with the decoded bytes
+ * @param len Length of the text
+ * @param out_len Pointer to receive the number of decoded bytes
+ * @return true on success, false if the text is not valid base64 (data is
+ * then left partly overwritten)
+ */
+bool base64_decode_in_place(uint8_t *data, size_t len, size_t *out_len);
+
+/**
+ * @brief Number of characters base64_encode() produces for len bytes
+ */
+#define BASE64_ENCODED_LEN(len) (((len) + 2) / 3 * 4)
+
+/**
+ * @brief Encode as padded standard base64 (RFC 4648)
+ *
+ * Encoding consecutive multiples of 3 bytes separately gives the same text
+ * as encoding them at once.
+ *
+ * @param data Bytes to encode
+ * @param len Number of bytes
+ * @param out Output buffer of at least BASE64_ENCODED_LEN(len) + 1 bytes
+ * @return Number of characters written, not counting the NUL terminator
+ */
+size_t base64_encode(const uint8_t *data, size_t len, char *out);
+
+/**
+ * @brief Decode unpadded base32 (RFC 4648 alphabet), as used by BBQr
+ *
+ * A final group of 2, 4, 5 or 7 characters carries 1 to 4 bytes; other
+ * lengths are rejected.
+ *
+ * @param text Base32 text (upper case)
+ * @param len Length of the text
+ * @param out Output buffer of at least len * 5 / 8 bytes; may be text itself
+ * @param out_len Pointer to receive the number of decoded bytes
+ * @return true on success, false if the text is not valid base32
+ */
+bool base32_decode(const char *text, size_t len, uint8_t *out,
+                   size_t *out_len);
+
+/**
+ * @brief Number of characters base32_encode() produces for len bytes
+ */
+#define BASE32_ENCODED_LEN(len) (((len) * 8 + 4) / 5)
+
+/**
+ * @brief Encode as unpadded base32 (RFC 4648 alphabet), as used by BBQr
+ *
+ * @param data Bytes to encode
+ * @param len Number of bytes
+ * @param out Output buffer of at least BASE32_ENCODED_LEN(len) + 1 bytes
+ * @return Number of characters written, not counting the NUL terminator
+ */
+size_t base32_encode(const uint8_t *data, size_t len, char *out);
+
+/**
+ * @brief Decode hexadecimal text, in either case
+ *
+ * @param text Hex text of even length
+ * @param len Length of the text
+ * @param out Output buffer of at least len / 2 bytes; may be text itself
+ * @param out_len Pointer to receive the number of decoded bytes
+ * @return true on success, false if the text is not valid hex
+ */
+bool hex_decode(const char *text, size_t len, uint8_t *out, size_t *out_len);
+
+#endif // BASE_CODECS_H
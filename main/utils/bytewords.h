@@ -0,0 +1,48 @@
+/*
+ * Bytewords
+ * Minimal bytewords decoding (BCR-2020-012) and the CRC32 that guards it
+ *
+ * Uniform Resources (UR) carry their CBOR body as bytewords: each byte is
+ * one of 256 four-letter words, and the minimal form used in QR codes
+ * keeps only the first and last letter. The bytes are followed by the
+ * big-endian CRC32 of the data.
+ */
+
+#ifndef BYTEWORDS_H
+#define BYTEWORDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Length of the CRC32 that ends bytewords data
+ */
+#define BYTEWORDS_CRC_LEN 4
+
+/**
+ * @brief CRC32 (ISO-HDLC, as zlib and UR use)
+ *
+ * @param data Bytes
+ * @param len Number of bytes
+ * @return Checksum
+ */
+uint32_t bytewords_crc32(const uint8_t *data, size_t len);
+
+/**
+ * @brief Decode minimal bytewords and check their CRC32
+ *
+ * Case-insensitive, so upper-case (alphanumeric mode) QR codes decode too.
+ *
+ * @param text Minimal bytewords, two letters per byte
+ * @param len Length of the text
+ * @param out Output buffer of at least len / 2 bytes
+ * @param out_len Pointer to receive the number of data bytes, without the
+ * CRC
+ * @return true on success, false on an odd length, an unknown word or a
+ * CRC mismatch
+ */
+bool bytewords_decode_minimal(const char *text, size_t len, uint8_t *out,
+                              size_t *out_len);
+
+#endif // BYTEWORDS_H
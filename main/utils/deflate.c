@@ -0,0 +1,491 @@
+// Deflate
+
+#include "deflate.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CODE_BITS 15
+#define MAX_LITLEN_CODES 288
+#define MAX_DIST_CODES 30
+#define CODE_LENGTH_CODES 19
+#define END_OF_BLOCK 256
+#define INITIAL_OUT_SIZE 4096
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define HASH_BITS 12
+#define HASH_SIZE (1 << HASH_BITS)
+#define MAX_CHAIN 64
+#define STORED_BLOCK_MAX 65535
+
+// Canonical Huffman code: codes per length and symbols in code order
+typedef struct {
+  uint16_t count[MAX_CODE_BITS + 1];
+  uint16_t symbol[MAX_LITLEN_CODES];
+} huffman_t;
+
+typedef struct {
+  const uint8_t *in;
+  size_t in_len;
+  size_t in_pos;
+  uint32_t bit_buf;
+  int bit_count;
+  bool error; // ran past the input
+
+  uint8_t *out;
+  size_t out_len;
+  size_t out_size;
+  size_t max_out;
+} inflate_state_t;
+
+static const uint16_t length_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                         1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0,  0,  1,  1,  2,  2,  3,  3,
+                                       4, 4, 5,  5,  6,  6,  7,  7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order in which code length code lengths are sent
+static const uint8_t code_length_order[CODE_LENGTH_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Reads n bits, least significant first. Past the end of the input it
+// returns zeros and flags the error, so callers check once per symbol.
+static uint32_t get_bits(inflate_state_t *s, int n) {
+  while (s->bit_count < n) {
+    if (s->in_pos >= s->in_len) {
+      s->error = true;
+      return 0;
+    }
+    s->bit_buf |= (uint32_t)s->in[s->in_pos++] << s->bit_count;
+    s->bit_count += 8;
+  }
+
+  uint32_t value = s->bit_buf & ((1u << n) - 1);
+  s->bit_buf >>= n;
+  s->bit_count -= n;
+  return value;
+}
+
+// Builds a canonical code from code lengths. Incomplete codes are allowed
+// (deflate uses them for single-distance blocks); over-subscribed ones are
+// not.
+static bool huffman_build(huffman_t *h, const uint8_t *lengths, int n) {
+  uint16_t offsets[MAX_CODE_BITS + 1];
+
+  memset(h->count, 0, sizeof(h->count));
+  for (int i = 0; i < n; i++)
+    h->count[lengths[i]]++;
+  h->count[0] = 0;
+
+  int left = 1;
+  for (int len = 1; len <= MAX_CODE_BITS; len++) {
+    left = (left << 1) - h->count[len];
+    if (left < 0)
+      return false;
+  }
+
+  offsets[1] = 0;
+  for (int len = 1; len < MAX_CODE_BITS; len++)
+    offsets[len + 1] = offsets[len] + h->count[len];
+  for (int i = 0; i < n; i++) {
+    if (lengths[i])
+      h->symbol[offsets[lengths[i]]++] = (uint16_t)i;
+  }
+  return true;
+}
+
+// Decodes one symbol a bit at a time, walking the code lengths in order
+static int huffman_decode(inflate_state_t *s, const huffman_t *h) {
+  int code = 0, first = 0, index = 0;
+
+  for (int len = 1; len <= MAX_CODE_BITS; len++) {
+    code |= (int)get_bits(s, 1);
+    if (s->error)
+      return -1;
+    int count = h->count[len];
+    if (code - first < count)
+      return h->symbol[index + code - first];
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+static bool reserve_output(inflate_state_t *s, size_t extra) {
+  if (extra > s->max_out - s->out_len)
+    return false;
+  size_t needed = s->out_len + extra + 1; // room for the final NUL
+  if (needed <= s->out_size)
+    return true;
+
+  size_t size = s->out_size;
+  while (size < needed)
+    size *= 2;
+  if (size > s->max_out + 1)
+    size = s->max_out + 1;
+  uint8_t *out = realloc(s->out, size);
+  if (!out)
+    return false;
+  s->out = out;
+  s->out_size = size;
+  return true;
+}
+
+static bool inflate_stored(inflate_state_t *s) {
+  // Stored blocks start on a byte boundary
+  s->bit_buf = 0;
+  s->bit_count = 0;
+
+  if (s->in_len - s->in_pos < 4)
+    return false;
+  const uint8_t *header = s->in + s->in_pos;
+  uint16_t len = header[0] | header[1] << 8;
+  uint16_t nlen = header[2] | header[3] << 8;
+  s->in_pos += 4;
+  if (len != (uint16_t)~nlen || s->in_len - s->in_pos < len)
+    return false;
+
+  if (!reserve_output(s, len))
+    return false;
+  memcpy(s->out + s->out_len, s->in + s->in_pos, len);
+  s->out_len += len;
+  s->in_pos += len;
+  return true;
+}
+
+static bool inflate_codes(inflate_state_t *s, const huffman_t *litlen,
+                          const huffman_t *dist) {
+  for (;;) {
+    int symbol = huffman_decode(s, litlen);
+    if (symbol < 0)
+      return false;
+
+    if (symbol < END_OF_BLOCK) {
+      if (!reserve_output(s, 1))
+        return false;
+      s->out[s->out_len++] = (uint8_t)symbol;
+      continue;
+    }
+    if (symbol == END_OF_BLOCK)
+      return true;
+
+    symbol -= END_OF_BLOCK + 1;
+    if (symbol >= 29)
+      return false;
+    size_t len = length_base[symbol] + get_bits(s, length_extra[symbol]);
+
+    symbol = huffman_decode(s, dist);
+    if (symbol < 0 || symbol >= MAX_DIST_CODES)
+      return false;
+    size_t distance = dist_base[symbol] + get_bits(s, dist_extra[symbol]);
+    if (s->error || distance > s->out_len || !reserve_output(s, len))
+      return false;
+
+    // Byte by byte: the copy may overlap its own output
+    uint8_t *dest = s->out + s->out_len;
+    const uint8_t *src = dest - distance;
+    for (size_t i = 0; i < len; i++)
+      dest[i] = src[i];
+    s->out_len += len;
+  }
+}
+
+// Built per block rather than cached, so concurrent callers share nothing
+static bool inflate_fixed(inflate_state_t *s) {
+  uint8_t lengths[MAX_LITLEN_CODES];
+  huffman_t litlen, dist;
+  int i = 0;
+
+  for (; i < 144; i++)
+    lengths[i] = 8;
+  for (; i < 256; i++)
+    lengths[i] = 9;
+  for (; i < 280; i++)
+    lengths[i] = 7;
+  for (; i < MAX_LITLEN_CODES; i++)
+    lengths[i] = 8;
+  huffman_build(&litlen, lengths, MAX_LITLEN_CODES);
+  for (i = 0; i < MAX_DIST_CODES; i++)
+    lengths[i] = 5;
+  huffman_build(&dist, lengths, MAX_DIST_CODES);
+
+  return inflate_codes(s, &litlen, &dist);
+}
+
+static bool inflate_dynamic(inflate_state_t *s) {
+  uint8_t lengths[MAX_LITLEN_CODES + MAX_DIST_CODES];
+  huffman_t litlen, dist;
+
+  int nlen = (int)get_bits(s, 5) + 257;
+  int ndist = (int)get_bits(s, 5) + 1;
+  int ncode = (int)get_bits(s, 4) + 4;
+  if (s->error || nlen > MAX_LITLEN_CODES - 2 || ndist > MAX_DIST_CODES)
+    return false;
+
+  // Code lengths of the code that codes the code lengths
+  memset(lengths, 0, CODE_LENGTH_CODES);
+  for (int i = 0; i < ncode; i++)
+    lengths[code_length_order[i]] = (uint8_t)get_bits(s, 3);
+  if (s->error || !huffman_build(&litlen, lengths, CODE_LENGTH_CODES))
+    return false;
+
+  // Literal/length and distance code lengths, run-length coded
+  int index = 0;
+  while (index < nlen + ndist) {
+    int symbol = huffman_decode(s, &litlen);
+    if (symbol < 0)
+      return false;
+    if (symbol < 16) {
+      lengths[index++] = (uint8_t)symbol;
+      continue;
+    }
+
+    uint8_t value = 0;
+    int repeat;
+    if (symbol == 16) {
+      if (index == 0)
+        return false;
+      value = lengths[index - 1];
+      repeat = 3 + (int)get_bits(s, 2);
+    } else if (symbol == 17) {
+      repeat = 3 + (int)get_bits(s, 3);
+    } else {
+      repeat = 11 + (int)get_bits(s, 7);
+    }
+    if (s->error || index + repeat > nlen + ndist)
+      return false;
+    while (repeat--)
+      lengths[index++] = value;
+  }
+
+  if (lengths[END_OF_BLOCK] == 0)
+    return false;
+  if (!huffman_build(&litlen, lengths, nlen) ||
+      !huffman_build(&dist, lengths + nlen, ndist))
+    return false;
+
+  return inflate_codes(s, &litlen, &dist);
+}
+
+bool inflate_raw(const uint8_t *in, size_t in_len, size_t max_out,
+                 uint8_t **out, size_t *out_len) {
+  inflate_state_t s = {
+      .in = in,
+      .in_len = in_len,
+      .max_out = max_out,
+      .out_size = INITIAL_OUT_SIZE,
+  };
+
+  s.out = malloc(s.out_size);
+  if (!s.out)
+    return false;
+
+  bool last;
+  do {
+    last = get_bits(&s, 1);
+    uint32_t type = get_bits(&s, 2);
+    bool ok;
+    if (s.error)
+      ok = false;
+    else if (type == 0)
+      ok = inflate_stored(&s);
+    else if (type == 1)
+      ok = inflate_fixed(&s);
+    else if (type == 2)
+      ok = inflate_dynamic(&s);
+    else
+      ok = false;
+
+    if (!ok || s.error) {
+      free(s.out);
+      return false;
+    }
+  } while (!last);
+
+  s.out[s.out_len] = '\0';
+  *out = s.out;
+  *out_len = s.out_len;
+  return true;
+}
+
+typedef struct {
+  uint8_t *out;
+  size_t len;
+  uint32_t bit_buf;
+  int bit_count;
+} bit_writer_t;
+
+// Appends n bits, least significant first
+static void put_bits(bit_writer_t *w, uint32_t value, int n) {
+  w->bit_buf |= value << w->bit_count;
+  w->bit_count += n;
+  while (w->bit_count >= 8) {
+    w->out[w->len++] = (uint8_t)w->bit_buf;
+    w->bit_buf >>= 8;
+    w->bit_count -= 8;
+  }
+}
+
+// Huffman codes are sent most significant bit first
+static void put_code(bit_writer_t *w, uint32_t code, int n) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < n; i++) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  put_bits(w, reversed, n);
+}
+
+// Fixed literal/length code (RFC 1951 3.2.6)
+static void put_litlen(bit_writer_t *w, int symbol) {
+  if (symbol < 144)
+    put_code(w, 0x30 + symbol, 8);
+  else if (symbol < 256)
+    put_code(w, 0x190 + symbol - 144, 9);
+  else if (symbol < 280)
+    put_code(w, symbol - 256, 7);
+  else
+    put_code(w, 0xC0 + symbol - 280, 8);
+}
+
+static void put_match(bit_writer_t *w, int len, int distance) {
+  int code = 28;
+  while (length_base[code] > len)
+    code--;
+  put_litlen(w, END_OF_BLOCK + 1 + code);
+  put_bits(w, len - length_base[code], length_extra[code]);
+
+  code = MAX_DIST_CODES - 1;
+  while (dist_base[code] > distance)
+    code--;
+  put_code(w, code, 5);
+  put_bits(w, distance - dist_base[code], dist_extra[code]);
+}
+
+static uint32_t hash3(const uint8_t *p) {
+  return ((uint32_t)p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u >>
+         (32 - HASH_BITS);
+}
+
+// One final fixed-Huffman block. Returns the stream length.
+static size_t compress_fixed(const uint8_t *in, size_t in_len, uint8_t *out,
+                             int32_t *head, int32_t *prev) {
+  bit_writer_t w = {.out = out};
+
+  for (int i = 0; i < HASH_SIZE; i++)
+    head[i] = -1;
+
+  put_bits(&w, 1, 1); // final block
+  put_bits(&w, 1, 2); // fixed Huffman codes
+
+  size_t pos = 0;
+  while (pos < in_len) {
+    int best_len = 0;
+    size_t best_pos = 0;
+
+    if (in_len - pos >= MIN_MATCH) {
+      uint32_t h = hash3(in + pos);
+      size_t max_len = in_len - pos < MAX_MATCH ? in_len - pos : MAX_MATCH;
+      int32_t candidate = head[h];
+
+      // Walk earlier positions with the same hash, nearest first
+      for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 &&
+                          pos - (size_t)candidate <= DEFLATE_WINDOW_SIZE;
+           chain++) {
+        size_t len = 0;
+        while (len < max_len && in[candidate + len] == in[pos + len])
+          len++;
+        if ((int)len > best_len) {
+          best_len = (int)len;
+          best_pos = (size_t)candidate;
+          if (len == max_len)
+            break;
+        }
+        int32_t next = prev[candidate & (DEFLATE_WINDOW_SIZE - 1)];
+        if (next >= candidate)
+          break;
+        candidate = next;
+      }
+    }
+
+    size_t advance = best_len >= MIN_MATCH ? (size_t)best_len : 1;
+    if (best_len >= MIN_MATCH)
+      put_match(&w, best_len, (int)(pos - best_pos));
+    else
+      put_litlen(&w, in[pos]);
+
+    // Index every position covered, so later matches can start inside
+    for (size_t end = pos + advance; pos < end; pos++) {
+      if (in_len - pos >= MIN_MATCH) {
+        uint32_t h = hash3(in + pos);
+        prev[pos & (DEFLATE_WINDOW_SIZE - 1)] = head[h];
+        head[h] = (int32_t)pos;
+      }
+    }
+  }
+
+  put_litlen(&w, END_OF_BLOCK);
+  if (w.bit_count > 0)
+    put_bits(&w, 0, 8 - w.bit_count);
+  return w.len;
+}
+
+static size_t compress_stored(const uint8_t *in, size_t in_len, uint8_t *out) {
+  size_t len = 0;
+  size_t pos = 0;
+
+  do {
+    size_t block = in_len - pos;
+    if (block > STORED_BLOCK_MAX)
+      block = STORED_BLOCK_MAX;
+    bool final = pos + block == in_len;
+
+    // BFINAL and BTYPE 00, padded to the byte boundary
+    out[len++] = final ? 1 : 0;
+    out[len++] = (uint8_t)block;
+    out[len++] = (uint8_t)(block >> 8);
+    out[len++] = (uint8_t)~block;
+    out[len++] = (uint8_t)(~block >> 8);
+    memcpy(out + len, in + pos, block);
+    len += block;
+    pos += block;
+  } while (pos < in_len);
+
+  return len;
+}
+
+bool deflate_raw(const uint8_t *in, size_t in_len, uint8_t **out,
+                 size_t *out_len) {
+  // Fixed codes spend at most 9 bits per byte; stored blocks 5 bytes each
+  size_t stored_len = in_len + 5 * (in_len / STORED_BLOCK_MAX + 1);
+  size_t size = in_len + in_len / 8 + 16;
+  if (size < stored_len)
+    size = stored_len;
+
+  uint8_t *buf = malloc(size);
+  int32_t *head = malloc(HASH_SIZE * sizeof(int32_t));
+  int32_t *prev = malloc(DEFLATE_WINDOW_SIZE * sizeof(int32_t));
+  if (!buf || !head || !prev) {
+    free(buf);
+    free(head);
+    free(prev);
+    return false;
+  }
+
+  size_t len = compress_fixed(in, in_len, buf, head, prev);
+  free(head);
+  free(prev);
+  if (len >= stored_len)
+    len = compress_stored(in, in_len, buf);
+
+  *out = buf;
+  *out_len = len;
+  return true;
+}
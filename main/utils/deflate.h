@@ -0,0 +1,56 @@
+/*
+ * Deflate
+ * Self-contained raw deflate (RFC 1951) compression and decompression
+ *
+ * BBQr's "Z" encoding is a raw deflate stream (no zlib header or checksum)
+ * of the file, base32 encoded. Payloads are a few hundred kilobytes at
+ * most, so the whole output is kept in one buffer that also serves as the
+ * back-reference window.
+ */
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Decompress a raw deflate stream
+ *
+ * @param in Compressed data
+ * @param in_len Length of the compressed data
+ * @param max_out Largest output accepted, guarding against expansion bombs
+ * @param out Pointer to receive the output, NUL-terminated for text
+ * payloads. Caller must free it.
+ * @param out_len Pointer to receive the output length (without the NUL)
+ * @return true on success, false on malformed, truncated or oversized input
+ */
+bool inflate_raw(const uint8_t *in, size_t in_len, size_t max_out,
+                 uint8_t **out, size_t *out_len);
+
+/**
+ * @brief Back-reference window of the compressor
+ *
+ * BBQr decoders inflate with a 2^10 byte window, so matches must not
+ * reach further back.
+ */
+#define DEFLATE_WINDOW_SIZE 1024
+
+/**
+ * @brief Compress into a raw deflate stream
+ *
+ * Greedy LZ77 over a DEFLATE_WINDOW_SIZE window with fixed Huffman codes,
+ * in about 20 KB of working memory. Falls back to stored blocks when that
+ * would not be smaller.
+ *
+ * @param in Data to compress
+ * @param in_len Length of the data
+ * @param out Pointer to receive the compressed stream. Caller must free it.
+ * @param out_len Pointer to receive the compressed length
+ * @return true on success, false on allocation failure
+ */
+bool deflate_raw(const uint8_t *in, size_t in_len, uint8_t **out,
+                 size_t *out_len);
+
+#endif // DEFLATE_H
@@ -7,241 +7,423 @@
  */
 
 #include "qr_codes.h"
-#include "../../components/cUR/src/ur_decoder.h"
+#include "base_codecs.h"
+#include "bytewords.h"
+#include "deflate.h"
 #include <ctype.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// QR capacity arrays (limited to version 20)
-static const int QR_CAPACITY_BYTE[] = {17,  32,  53,  78,  106, 134, 154,
-                                       192, 230, 271, 321, 367, 425, 458,
-                                       520, 586, 644, 718, 792, 858};
+// Data codewords per version (1-20) and ECC level (L, M, Q, H)
+static const uint16_t QR_DATA_CODEWORDS[QR_CAPACITY_SIZE][4] = {
+    {19, 16, 13, 9},      {34, 28, 22, 16},     {55, 44, 34, 26},
+    {80, 64, 48, 36},     {108, 86, 62, 46},    {136, 108, 76, 60},
+    {156, 124, 88, 66},   {194, 154, 110, 86},  {232, 182, 132, 100},
+    {274, 216, 154, 122}, {324, 254, 180, 140}, {370, 290, 206, 158},
+    {428, 334, 244, 180}, {461, 365, 261, 197}, {523, 415, 295, 223},
+    {589, 453, 325, 253}, {647, 507, 367, 283}, {721, 563, 397, 313},
+    {795, 627, 445, 341}, {861, 669, 485, 385}};
 
-static const int QR_CAPACITY_ALPHANUMERIC[] = {
-    25,  47,  77,  114, 154, 195, 224, 279,  335,  395,
-    468, 535, 619, 667, 758, 854, 938, 1046, 1153, 1249};
+// Largest decompressed BBQr file accepted
+#define BBQR_MAX_INFLATED_SIZE (2 * 1024 * 1024)
 
-#define QR_CAPACITY_SIZE 20
+// A multi-part sequence is under way while it took a part within this many
+// frames; until then frames complete on their own are ignored as strays
+#define SEQUENCE_IDLE_FRAMES 16
 
 // Helper function prototypes
-static int detect_format(const char *data, BBQrCode **bbqr);
-static bool parse_pmofn_qr_part(const char *data, char **part, int *index,
-                                int *total);
+static int detect_format(const char *data, size_t data_len, QRSequence *key);
+static bool parse_pmofn_qr_part(const char *data, size_t data_len,
+                                const char **part, size_t *part_len,
+                                int *index, int *total);
+static bool parse_ur_header(const char *data, size_t data_len,
+                            QRSequence *key, int *seq_num, size_t *body);
+static int receive_ur_part(QRPartParser *parser, QRSequence *seq,
+                           const char *data, size_t data_len);
+static bool parse_bbqr_header(const char *data, size_t data_len, int *index,
+                              int *total);
+static bool decode_bbqr_part(QRPartParser *parser, const QRSequence *seq,
+                             const char *data, size_t data_len,
+                             size_t *part_len);
+static char *finish_bbqr(const QRSequence *seq, char *data, size_t len,
+                         size_t *result_len);
 static bool starts_with_case_insensitive(const char *str, const char *prefix);
-static int max_qr_bytes(int max_width, const char *encoding);
-static void find_min_num_parts(const char *data, size_t data_len, int max_width,
-                               int qr_format, int *num_parts, int *part_size);
-static bool add_part(QRPartParser *parser, int index, const char *data,
+static bool add_part(QRSequence *seq, int index, int total, const char *data,
                      size_t data_len);
-static int compare_parts(const void *a, const void *b);
 
-QRPartParser *qr_parser_create(void) {
-  QRPartParser *parser = (QRPartParser *)calloc(1, sizeof(QRPartParser));
-  if (!parser)
-    return NULL;
+// Parts written into the arena share its allocation; the rest own theirs
+static bool part_in_arena(const QRSequence *seq, const QRPart *part) {
+  return seq->arena && part->data >= seq->arena &&
+         part->data < seq->arena + seq->arena_size;
+}
 
-  parser->parts_capacity = 10;
-  parser->parts = (QRPart **)calloc(parser->parts_capacity, sizeof(QRPart *));
-  if (!parser->parts) {
-    free(parser);
-    return NULL;
-  }
+static void release_part(QRSequence *seq, QRPart *part) {
+  if (!part_in_arena(seq, part))
+    free(part->data);
+  part->data = NULL;
+}
 
-  parser->total = -1;
-  parser->format = -1;
-  return parser;
+// Every part but the last is exactly arena_part_len long, the last at most
+static bool part_fits_arena(const QRSequence *seq, int slot, size_t data_len) {
+  if (!seq->arena)
+    return false;
+  if (slot < seq->total - 1)
+    return data_len == seq->arena_part_len;
+  return data_len <= seq->arena_part_len;
 }
 
-void qr_parser_destroy(QRPartParser *parser) {
-  if (!parser)
+static void sequence_destroy(QRSequence *seq) {
+  if (!seq)
     return;
 
-  if (parser->parts) {
-    for (int i = 0; i < parser->parts_count; i++) {
-      if (parser->parts[i]) {
-        free(parser->parts[i]->data);
-        free(parser->parts[i]);
-      }
-    }
-    free(parser->parts);
+  if (seq->parts) {
+    for (int i = 0; i < seq->parts_capacity; i++)
+      release_part(seq, &seq->parts[i]);
+    free(seq->parts);
+  }
+  free(seq->received);
+  free(seq->arena);
+
+  ur_fountain_destroy(seq->ur_fountain);
+  free(seq->ur_seen);
+
+  free(seq);
+}
+
+static int sequence_parsed_count(const QRSequence *seq) {
+  if (seq->ur_fountain)
+    return ur_fountain_received_count(seq->ur_fountain);
+  return seq->parts_count;
+}
+
+static bool sequence_is_complete(const QRSequence *seq) {
+  if (seq->ur_fountain)
+    return ur_fountain_is_complete(seq->ur_fountain);
+
+  // Every stored part has a distinct in-range slot
+  return seq->total > 0 && seq->parts_count == seq->total;
+}
+
+// Frames belong to the same sequence when their headers agree on everything
+// but the part index
+static bool same_sequence(const QRSequence *seq, const QRSequence *key) {
+  if (seq->format != key->format || seq->total != key->total)
+    return false;
+  if (key->format == FORMAT_BBQR)
+    return seq->bbqr.encoding == key->bbqr.encoding &&
+           seq->bbqr.file_type == key->bbqr.file_type;
+  if (key->format == FORMAT_UR)
+    return seq->ur_seq_len == key->ur_seq_len &&
+           strcmp(seq->ur_type, key->ur_type) == 0;
+  return true;
+}
+
+static QRSequence *find_sequence(QRPartParser *parser, const QRSequence *key) {
+  for (int i = 0; i < parser->sequence_count; i++) {
+    if (same_sequence(parser->sequences[i], key))
+      return parser->sequences[i];
+  }
+  return NULL;
+}
+
+static bool sequence_under_way(const QRPartParser *parser) {
+  for (int i = 0; i < parser->sequence_count; i++) {
+    if (parser->frame_count - parser->sequences[i]->last_frame <
+        SEQUENCE_IDLE_FRAMES)
+      return true;
   }
+  return false;
+}
 
-  if (parser->bbqr) {
-    free(parser->bbqr->payload);
-    free(parser->bbqr);
+static void remove_sequence(QRPartParser *parser, QRSequence *seq) {
+  for (int i = 0; i < parser->sequence_count; i++) {
+    if (parser->sequences[i] != seq)
+      continue;
+    parser->sequences[i] = parser->sequences[--parser->sequence_count];
+    parser->sequences[parser->sequence_count] = NULL;
+    break;
   }
+  if (parser->lead == seq)
+    parser->lead = NULL;
+  sequence_destroy(seq);
+}
 
-  if (parser->ur_decoder) {
-    ur_decoder_free((ur_decoder_t *)parser->ur_decoder);
-    parser->ur_decoder = NULL;
+// Starts accumulating a new sequence, replacing the one that went longest
+// without a part when all slots are taken
+static QRSequence *add_sequence(QRPartParser *parser, const QRSequence *key) {
+  if (parser->sequence_count == QR_PARSER_MAX_SEQUENCES) {
+    QRSequence *idle = parser->sequences[0];
+    for (int i = 1; i < parser->sequence_count; i++) {
+      if (parser->sequences[i]->last_frame < idle->last_frame)
+        idle = parser->sequences[i];
+    }
+    remove_sequence(parser, idle);
   }
 
+  QRSequence *seq = (QRSequence *)malloc(sizeof(QRSequence));
+  if (!seq)
+    return NULL;
+  *seq = *key;
+
+  // Single-part URs are stored like any other single frame
+  if (seq->format == FORMAT_UR && seq->ur_seq_len > 0) {
+    seq->ur_fountain = ur_fountain_create();
+    seq->ur_seen = (QRSeenPart *)calloc(QR_UR_SEEN_SLOTS, sizeof(QRSeenPart));
+    if (!seq->ur_fountain || !seq->ur_seen) {
+      ur_fountain_destroy(seq->ur_fountain);
+      free(seq->ur_seen);
+      free(seq);
+      return NULL;
+    }
+  }
+
+  seq->last_frame = parser->frame_count;
+  parser->sequences[parser->sequence_count++] = seq;
+  return seq;
+}
+
+QRPartParser *qr_parser_create(void) {
+  return (QRPartParser *)calloc(1, sizeof(QRPartParser));
+}
+
+void qr_parser_destroy(QRPartParser *parser) {
+  if (!parser)
+    return;
+
+  for (int i = 0; i < parser->sequence_count; i++)
+    sequence_destroy(parser->sequences[i]);
+  free(parser->scratch);
   free(parser);
 }
 
 int qr_parser_parsed_count(QRPartParser *parser) {
-  if (parser->format == FORMAT_UR && parser->ur_decoder) {
-    ur_decoder_t *decoder = (ur_decoder_t *)parser->ur_decoder;
-    return (int)ur_decoder_processed_parts_count(decoder);
-  }
-  return parser->parts_count;
+  return parser->lead ? sequence_parsed_count(parser->lead) : 0;
 }
 
 int qr_parser_processed_parts_count(QRPartParser *parser) {
-  if (parser->format == FORMAT_UR && parser->ur_decoder) {
-    ur_decoder_t *decoder = (ur_decoder_t *)parser->ur_decoder;
-    return (int)ur_decoder_processed_parts_count(decoder);
-  }
-  return parser->parts_count;
+  return parser->lead ? parser->lead->frames_accepted : 0;
 }
 
 int qr_parser_total_count(QRPartParser *parser) {
-  if (parser->format == FORMAT_UR && parser->ur_decoder) {
-    ur_decoder_t *decoder = (ur_decoder_t *)parser->ur_decoder;
-    size_t expected = ur_decoder_expected_part_count(decoder);
-    return expected > 0 ? (int)expected : 1;
-  }
-  return parser->total;
+  QRSequence *seq = parser->lead;
+
+  if (!seq)
+    return -1;
+  return seq->total;
 }
 
-static bool add_part(QRPartParser *parser, int index, const char *data,
-                     size_t data_len) {
-  // Resize if needed
-  if (parser->parts_count >= parser->parts_capacity) {
-    int new_capacity = parser->parts_capacity * 2;
-    QRPart **new_parts =
-        (QRPart **)realloc(parser->parts, new_capacity * sizeof(QRPart *));
-    if (!new_parts)
-      return false;
-    parser->parts = new_parts;
-    parser->parts_capacity = new_capacity;
-  }
-
-  // Check if part already exists
-  for (int i = 0; i < parser->parts_count; i++) {
-    if (parser->parts[i]->index == index) {
-      // Update existing part
-      free(parser->parts[i]->data);
-      parser->parts[i]->data = (char *)malloc(data_len + 1);
-      if (!parser->parts[i]->data)
-        return false;
-      memcpy(parser->parts[i]->data, data, data_len);
-      parser->parts[i]->data[data_len] = '\0';
-      parser->parts[i]->data_len = data_len;
-      return true;
-    }
-  }
+int qr_parser_progress_permille(QRPartParser *parser) {
+  QRSequence *seq = parser->lead;
 
-  // Add new part
-  QRPart *part = (QRPart *)calloc(1, sizeof(QRPart));
-  if (!part)
-    return false;
+  if (!seq)
+    return 0;
+  if (seq->ur_fountain)
+    return ur_fountain_progress_permille(seq->ur_fountain);
+  if (seq->total <= 0)
+    return 0;
+  return seq->parts_count * 1000 / seq->total;
+}
 
-  part->index = index;
-  part->data = (char *)malloc(data_len + 1);
-  if (!part->data) {
-    free(part);
+// Sizes the slot store for a sequence of total parts, on its first part
+static bool allocate_slots(QRSequence *seq, int total) {
+  size_t words = (total + 31) / 32;
+
+  seq->parts = (QRPart *)calloc(total, sizeof(QRPart));
+  seq->received = (uint32_t *)calloc(words, sizeof(uint32_t));
+  if (!seq->parts || !seq->received) {
+    free(seq->parts);
+    free(seq->received);
+    seq->parts = NULL;
+    seq->received = NULL;
     return false;
   }
-  memcpy(part->data, data, data_len);
-  part->data[data_len] = '\0';
-  part->data_len = data_len;
 
-  parser->parts[parser->parts_count++] = part;
+  seq->parts_capacity = total;
+  seq->total = total;
   return true;
 }
 
-int qr_parser_parse(QRPartParser *parser, const char *data) {
-  return qr_parser_parse_with_len(parser, data, strlen(data));
-}
+// Reserves the output buffer once the length shared by all parts but the
+// last is known, and moves parts already received into it. Without an arena
+// (allocation failed, or parts of uneven length) parts stay on the heap and
+// are concatenated at the end.
+static void allocate_arena(QRSequence *seq, size_t part_len) {
+  size_t size = (size_t)seq->total * part_len + 1;
 
-int qr_parser_parse_with_len(QRPartParser *parser, const char *data,
-                             size_t data_len) {
-  if (parser->format == -1) {
-    parser->format = detect_format(data, &parser->bbqr);
-  }
-
-  if (parser->format == FORMAT_NONE) {
-    add_part(parser, 1, data, data_len);
-    parser->total = 1;
-  } else if (parser->format == FORMAT_PMOFN) {
-    char *part = NULL;
-    int index, total;
-    if (parse_pmofn_qr_part(data, &part, &index, &total)) {
-      add_part(parser, index, part, strlen(part));
-      parser->total = total;
-      free(part);
-      return index - 1;
-    }
-  } else if (parser->format == FORMAT_UR) {
-    // Create UR decoder if not exists
-    if (!parser->ur_decoder) {
-      parser->ur_decoder = ur_decoder_new();
-      if (!parser->ur_decoder) {
-        return -1;
-      }
-    }
-
-    ur_decoder_t *decoder = (ur_decoder_t *)parser->ur_decoder;
-    if (ur_decoder_receive_part(decoder, data)) {
-      size_t processed = ur_decoder_processed_parts_count(decoder);
-      return (int)processed - 1;
-    }
-  } else if (parser->format == FORMAT_BBQR) {
-    // TODO: Implement BBQR format parsing
-    // Would need to parse BBQR header and extract part data
-    /*
-    char *part;
-    int index, total;
-    if (parse_bbqr(data, &part, &index, &total)) {
-        add_part(parser, index, part, strlen(part));
-        parser->total = total;
-        free(part);
-        return index;
-    }
-    */
+  seq->arena = (char *)malloc(size);
+  if (!seq->arena)
+    return;
+  seq->arena_size = size;
+  seq->arena_part_len = part_len;
+
+  for (int slot = 0; slot < seq->total; slot++) {
+    QRPart *part = &seq->parts[slot];
+    if (!part->data || !part_fits_arena(seq, slot, part->data_len))
+      continue;
+    char *dest = seq->arena + (size_t)slot * part_len;
+    memcpy(dest, part->data, part->data_len);
+    free(part->data);
+    part->data = dest;
   }
-
-  return -1;
 }
 
-bool qr_parser_is_complete(QRPartParser *parser) {
-  if (parser->format == FORMAT_UR && parser->ur_decoder) {
-    ur_decoder_t *decoder = (ur_decoder_t *)parser->ur_decoder;
-    return ur_decoder_is_complete(decoder) && ur_decoder_is_success(decoder);
+// Writes a part into its final position in the arena, or into its own heap
+// copy if it does not fit the arena's layout
+static bool store_part(QRSequence *seq, int slot, const char *data,
+                       size_t data_len) {
+  QRPart *part = &seq->parts[slot];
+
+  if (part_fits_arena(seq, slot, data_len)) {
+    part->data = seq->arena + (size_t)slot * seq->arena_part_len;
+    memcpy(part->data, data, data_len);
+  } else {
+    part->data = (char *)malloc(data_len + 1);
+    if (!part->data)
+      return false;
+    memcpy(part->data, data, data_len);
+    part->data[data_len] = '\0';
   }
+  part->data_len = data_len;
+  return true;
+}
 
-  if (parser->total == -1)
+// Stores part index (1-based) of a total-part sequence in its slot. A part
+// already held with the same content is a duplicate and costs only a
+// comparison; parts out of range or from a sequence of another length are
+// rejected.
+static bool add_part(QRSequence *seq, int index, int total, const char *data,
+                     size_t data_len) {
+  if (total < 1 || total > QR_PARSER_MAX_PARTS || index < 1 || index > total)
+    return false;
+  if (!seq->parts && !allocate_slots(seq, total))
     return false;
-  if (parser->parts_count != parser->total)
+  if (total != seq->parts_capacity)
     return false;
 
-  // Check if we have all expected indices
-  int start_index =
-      (parser->format == FORMAT_PMOFN || parser->format == FORMAT_NONE) ? 1 : 0;
-  int expected_sum = 0;
-  for (int i = start_index; i < start_index + parser->total; i++) {
-    expected_sum += i;
+  int slot = index - 1;
+  uint32_t bit = 1u << (slot % 32);
+  uint32_t *word = &seq->received[slot / 32];
+  QRPart *part = &seq->parts[slot];
+
+  if (*word & bit) {
+    if (part->data && part->data_len == data_len &&
+        memcmp(part->data, data, data_len) == 0)
+      return true;
+    // A complete sequence is final; a changed part is a misread
+    if (seq->parts_count == seq->total)
+      return false;
+    // Same index, different content: keep the latest
+    release_part(seq, part);
+    *word &= ~bit;
+    seq->parts_count--;
   }
 
-  int actual_sum = 0;
-  for (int i = 0; i < parser->parts_count; i++) {
-    actual_sum += parser->parts[i]->index;
+  // The first part that is not the last fixes the arena layout
+  if (!seq->arena && index < total)
+    allocate_arena(seq, data_len);
+
+  if (!store_part(seq, slot, data, data_len))
+    return false;
+
+  *word |= bit;
+  seq->parts_count++;
+  return true;
+}
+
+// Hands a frame to its sequence. Returns the part index, or -1 if rejected.
+static int receive_part(QRPartParser *parser, QRSequence *seq,
+                        const char *data, size_t data_len) {
+  const char *part;
+  size_t part_len;
+  int index, total;
+
+  switch (seq->format) {
+  case FORMAT_NONE:
+    return add_part(seq, 1, 1, data, data_len) ? 0 : -1;
+  case FORMAT_PMOFN:
+    if (parse_pmofn_qr_part(data, data_len, &part, &part_len, &index,
+                            &total) &&
+        add_part(seq, index, total, part, part_len))
+      return index - 1;
+    return -1;
+  case FORMAT_UR:
+    return receive_ur_part(parser, seq, data, data_len);
+  case FORMAT_BBQR:
+    // Parts are stored decoded, so the arena assembles the binary file
+    if (parse_bbqr_header(data, data_len, &index, &total) &&
+        decode_bbqr_part(parser, seq, data, data_len, &part_len) &&
+        add_part(seq, index + 1, total, (const char *)parser->scratch,
+                 part_len))
+      return index;
+    return -1;
+  default:
+    return -1;
   }
+}
 
-  return actual_sum == expected_sum;
+int qr_parser_parse(QRPartParser *parser, const char *data) {
+  return qr_parser_parse_with_len(parser, data, strlen(data));
 }
 
-static int compare_parts(const void *a, const void *b) {
-  QRPart *part_a = *(QRPart **)a;
-  QRPart *part_b = *(QRPart **)b;
-  return part_a->index - part_b->index;
+int qr_parser_parse_with_len(QRPartParser *parser, const char *data,
+                             size_t data_len) {
+  QRSequence key;
+
+  if (parser->complete || detect_format(data, data_len, &key) < 0)
+    return -1;
+  parser->frame_count++;
+
+  QRSequence *seq = find_sequence(parser, &key);
+  bool created = false;
+  if (!seq) {
+    // Frames complete on their own are strays while a sequence is scanned
+    if (key.total == 1 && sequence_under_way(parser))
+      return -1;
+    seq = add_sequence(parser, &key);
+    if (!seq)
+      return -1;
+    created = true;
+  }
+
+  int index = receive_part(parser, seq, data, data_len);
+  if (index < 0) {
+    if (created)
+      remove_sequence(parser, seq);
+    return -1;
+  }
+  seq->last_frame = parser->frame_count;
+  seq->frames_accepted++;
+
+  if (sequence_is_complete(seq)) {
+    // The first sequence to complete wins; the others are dropped
+    for (int i = parser->sequence_count - 1; i >= 0; i--) {
+      if (parser->sequences[i] != seq)
+        remove_sequence(parser, parser->sequences[i]);
+    }
+    parser->lead = seq;
+    parser->complete = true;
+    return index;
+  }
+
+  // The lead only changes hands when overtaken, so a stray frame does not
+  // switch the progress shown
+  if (!parser->lead ||
+      sequence_parsed_count(seq) > sequence_parsed_count(parser->lead))
+    parser->lead = seq;
+  return seq == parser->lead ? index : -1;
 }
 
+bool qr_parser_is_complete(QRPartParser *parser) { return parser->complete; }
+
 char *qr_parser_result(QRPartParser *parser, size_t *result_len) {
-  if (parser->format == FORMAT_UR && parser->ur_decoder) {
+  QRSequence *seq = parser->lead;
+
+  if (!parser->complete)
+    return NULL;
+
+  if (seq->format == FORMAT_UR) {
     // For UR format, return a special marker string that indicates
     // the result needs to be extracted using qr_parser_get_ur_result()
     // This is because UR results are binary CBOR data, not text strings
@@ -253,18 +435,12 @@ char *qr_parser_result(QRPartParser *parser, size_t *result_len) {
     return result;
   }
 
-  if (parser->format == FORMAT_BBQR) {
-    // TODO: Decode BBQR and return result
-    return NULL;
-  }
-
-  // Sort parts by index
-  qsort(parser->parts, parser->parts_count, sizeof(QRPart *), compare_parts);
-
-  // Calculate total length
+  // Slots are in part order
   size_t total_len = 0;
-  for (int i = 0; i < parser->parts_count; i++) {
-    total_len += parser->parts[i]->data_len;
+  for (int i = 0; i < seq->total; i++) {
+    if (!seq->parts[i].data)
+      return NULL; // handed over by qr_parser_take_result()
+    total_len += seq->parts[i].data_len;
   }
 
   // Combine parts
@@ -273,17 +449,67 @@ char *qr_parser_result(QRPartParser *parser, size_t *result_len) {
     return NULL;
 
   size_t offset = 0;
-  for (int i = 0; i < parser->parts_count; i++) {
-    memcpy(result + offset, parser->parts[i]->data, parser->parts[i]->data_len);
-    offset += parser->parts[i]->data_len;
+  for (int i = 0; i < seq->total; i++) {
+    memcpy(result + offset, seq->parts[i].data, seq->parts[i].data_len);
+    offset += seq->parts[i].data_len;
   }
   result[total_len] = '\0';
 
+  if (seq->format == FORMAT_BBQR)
+    return finish_bbqr(seq, result, total_len, result_len);
+
   if (result_len)
     *result_len = total_len;
   return result;
 }
 
+char *qr_parser_take_result(QRPartParser *parser, size_t *result_len) {
+  QRSequence *seq = parser->lead;
+
+  if (!parser->complete || seq->format == FORMAT_UR)
+    return NULL;
+
+  char *result = NULL;
+  size_t len = 0;
+  QRPart *last = &seq->parts[seq->total - 1];
+
+  if (seq->total == 1 && last->data && !part_in_arena(seq, last)) {
+    // A single part already is the result
+    result = last->data;
+    len = last->data_len;
+  } else if (seq->arena) {
+    for (int i = 0; i < seq->total; i++) {
+      if (!part_in_arena(seq, &seq->parts[i]))
+        return qr_parser_result(parser, result_len);
+    }
+    // Every part was written in place: the arena is the result
+    len = (size_t)(seq->total - 1) * seq->arena_part_len + last->data_len;
+    result = seq->arena;
+    result[len] = '\0';
+    seq->arena = NULL;
+    seq->arena_size = 0;
+  } else {
+    return qr_parser_result(parser, result_len);
+  }
+
+  // The parts now belong to the result
+  for (int i = 0; i < seq->total; i++)
+    seq->parts[i].data = NULL;
+
+  if (seq->format == FORMAT_BBQR)
+    return finish_bbqr(seq, result, len, result_len);
+
+  if (result_len)
+    *result_len = len;
+  return result;
+}
+
+char qr_parser_get_bbqr_file_type(QRPartParser *parser) {
+  if (!parser || !parser->lead || parser->lead->format != FORMAT_BBQR)
+    return '\0';
+  return parser->lead->bbqr.file_type;
+}
+
 static bool starts_with_case_insensitive(const char *str, const char *prefix) {
   while (*prefix) {
     if (tolower(*str) != tolower(*prefix))
@@ -294,164 +520,396 @@ static bool starts_with_case_insensitive(const char *str, const char *prefix) {
   return true;
 }
 
-static int detect_format(const char *data, BBQrCode **bbqr) {
-  if (data[0] == 'p') {
-    // Check for "pXofY " format
-    const char *space = strchr(data, ' ');
-    if (space) {
-      char header[32];
-      size_t header_len = space - data;
-      if (header_len < sizeof(header)) {
-        strncpy(header, data, header_len);
-        header[header_len] = '\0';
-
-        const char *of_pos = strstr(header, "of");
-        if (of_pos && of_pos > header + 1) {
-          // Check if number before "of"
-          bool is_digit = true;
-          for (const char *p = header + 1; p < of_pos; p++) {
-            if (!isdigit((unsigned char)*p)) {
-              is_digit = false;
-              break;
-            }
-          }
-          if (is_digit)
-            return FORMAT_PMOFN;
-        }
-      }
-    }
-  } else if (starts_with_case_insensitive(data, "ur:")) {
-    return FORMAT_UR;
-  } else if (strncmp(data, "B$", 2) == 0) {
-    // TODO: Implement BBQR format detection
-    // Would need to check known encodings and file types
-    /*
-    if (is_known_filetype(data[3]) && is_known_encoding(data[2])) {
-        *bbqr = create_bbqr(NULL, data[2], data[3]);
-        return FORMAT_BBQR;
-    }
-    */
+// Classifies a frame on its own and fills in key, the identity of the
+// sequence it belongs to. Returns the format, or -1 for a malformed header.
+static int detect_format(const char *data, size_t data_len, QRSequence *key) {
+  const char *part;
+  size_t part_len;
+  int index;
+
+  memset(key, 0, sizeof(*key));
+  key->format = FORMAT_NONE;
+  key->total = 1;
+
+  if (parse_pmofn_qr_part(data, data_len, &part, &part_len, &index,
+                          &key->total)) {
+    key->format = FORMAT_PMOFN;
+  } else if (data_len >= 3 && starts_with_case_insensitive(data, "ur:")) {
+    int seq_num;
+    size_t body;
+    if (!parse_ur_header(data, data_len, key, &seq_num, &body))
+      return -1;
+    key->format = FORMAT_UR;
+    if (key->ur_seq_len > 0)
+      key->total = key->ur_seq_len;
+  } else if (data_len >= 4 && data[0] == 'B' && data[1] == '$' && data[2] &&
+             strchr(BBQR_ENCODINGS, data[2]) && data[3] &&
+             strchr(BBQR_FILE_TYPES, data[3])) {
+    if (!parse_bbqr_header(data, data_len, &index, &key->total))
+      return -1;
+    key->format = FORMAT_BBQR;
+    key->bbqr.encoding = data[2];
+    key->bbqr.file_type = data[3];
   }
 
-  return FORMAT_NONE;
+  return key->format;
+}
+
+// Reads up to 9 decimal digits at *pos
+static bool parse_number(const char *data, size_t data_len, size_t *pos,
+                         int *value) {
+  size_t start = *pos;
+
+  *value = 0;
+  while (*pos < data_len && *pos - start < 9 &&
+         isdigit((unsigned char)data[*pos]))
+    *value = *value * 10 + (data[(*pos)++] - '0');
+  return *pos > start;
 }
 
-static bool parse_pmofn_qr_part(const char *data, char **part, int *index,
-                                int *total) {
-  const char *of_pos = strstr(data, "of");
-  const char *space_pos = strchr(data, ' ');
+// Parses a "p<index>of<total> " header; the part follows it in place
+static bool parse_pmofn_qr_part(const char *data, size_t data_len,
+                                const char **part, size_t *part_len,
+                                int *index, int *total) {
+  size_t pos = 1;
 
-  if (!of_pos || !space_pos || of_pos >= space_pos)
+  if (data_len < PMOFN_PREFIX_LENGTH_1D || data[0] != 'p' ||
+      !parse_number(data, data_len, &pos, index) || pos + 2 > data_len ||
+      data[pos] != 'o' || data[pos + 1] != 'f')
+    return false;
+  pos += 2;
+  if (!parse_number(data, data_len, &pos, total) || pos >= data_len ||
+      data[pos] != ' ')
     return false;
 
-  // Parse index (skip 'p')
-  *index = atoi(data + 1);
+  *part = data + pos + 1;
+  *part_len = data_len - pos - 1;
+  return true;
+}
 
-  // Parse total
-  *total = atoi(of_pos + 2);
+// Reads the type, part number and sequence length of
+// "ur:<type>/<seq>-<len>/<body>", or of "ur:<type>/<body>" for a single-part
+// UR (both 0), and finds where the body starts
+static bool parse_ur_header(const char *data, size_t data_len,
+                            QRSequence *key, int *seq_num, size_t *body) {
+  size_t pos = 3;
+  size_t type_len = 0;
+
+  while (pos < data_len && data[pos] != '/') {
+    char c = (char)tolower((unsigned char)data[pos++]);
+    if (type_len == QR_UR_TYPE_MAX_LENGTH ||
+        !(islower((unsigned char)c) || isdigit((unsigned char)c) || c == '-'))
+      return false;
+    key->ur_type[type_len++] = c;
+  }
+  if (type_len == 0 || pos == data_len)
+    return false;
+  key->ur_type[type_len] = '\0';
+  pos++;
+
+  int num, len;
+  size_t body_pos = pos;
+  *seq_num = 0;
+  if (parse_number(data, data_len, &pos, &num) && pos < data_len &&
+      data[pos++] == '-' && parse_number(data, data_len, &pos, &len) &&
+      pos < data_len && data[pos] == '/' && num > 0 && len > 0) {
+    *seq_num = num;
+    key->ur_seq_len = len;
+    body_pos = pos + 1;
+  }
+  *body = body_pos;
+  return true;
+}
+
+static int base36_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 10;
+  return -1;
+}
 
-  // Extract part data (after space)
-  size_t part_len = strlen(space_pos + 1);
-  *part = (char *)malloc(part_len + 1);
-  if (!*part)
+// Parses the total and index (two base36 digits each, index from 0) of a
+// "B$" + encoding + file type + total + index header
+static bool parse_bbqr_header(const char *data, size_t data_len, int *index,
+                              int *total) {
+  if (data_len < BBQR_PREFIX_LENGTH)
     return false;
-  strcpy(*part, space_pos + 1);
 
+  int digits[4];
+  for (int i = 0; i < 4; i++) {
+    digits[i] = base36_value(data[4 + i]);
+    if (digits[i] < 0)
+      return false;
+  }
+  *total = digits[0] * 36 + digits[1];
+  *index = digits[2] * 36 + digits[3];
+  return *index < *total;
+}
+
+static bool reserve_scratch(QRPartParser *parser, size_t size) {
+  if (size <= parser->scratch_size)
+    return true;
+
+  uint8_t *scratch = (uint8_t *)realloc(parser->scratch, size);
+  if (!scratch)
+    return false;
+  parser->scratch = scratch;
+  parser->scratch_size = size;
   return true;
 }
 
-static int max_qr_bytes(int max_width, const char *encoding) {
-  max_width -= 2; // Subtract frame width
-  int qr_version = (max_width - 17) / 4;
+static uint32_t fnv1a(const char *data, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+  return hash;
+}
+
+// Decodes the bytewords body of a UR frame into parser->scratch. A
+// single-part UR is the message itself; the parts of a multi-part UR go to
+// the fountain decoder, unless the same frame was taken on an earlier loop
+// of the animation.
+static int receive_ur_part(QRPartParser *parser, QRSequence *seq,
+                           const char *data, size_t data_len) {
+  QRSequence key;
+  int seq_num;
+  size_t body, len;
+  ur_part_t part;
+
+  if (!parse_ur_header(data, data_len, &key, &seq_num, &body))
+    return -1;
+
+  QRSeenPart *seen = NULL;
+  uint32_t body_hash = 0;
+  if (seq->ur_fountain) {
+    seen = &seq->ur_seen[(uint32_t)seq_num % QR_UR_SEEN_SLOTS];
+    body_hash = fnv1a(data + body, data_len - body);
+    if (seen->seq_num == (uint32_t)seq_num && seen->body_hash == body_hash)
+      return ur_fountain_received_count(seq->ur_fountain) - 1;
+  }
+
+  if (!reserve_scratch(parser, (data_len - body) / 2) ||
+      !bytewords_decode_minimal(data + body, data_len - body, parser->scratch,
+                                &len))
+    return -1;
+
+  if (!seq->ur_fountain)
+    return add_part(seq, 1, 1, (const char *)parser->scratch, len) ? 0 : -1;
+
+  if (!ur_part_parse(parser->scratch, len, &part) ||
+      part.seq_num != (uint32_t)seq_num ||
+      part.seq_len != (uint32_t)seq->ur_seq_len)
+    return -1;
+  if (!ur_fountain_receive(seq->ur_fountain, &part)) {
+    // Decoding may have started over, so every part is needed again
+    memset(seq->ur_seen, 0, QR_UR_SEEN_SLOTS * sizeof(QRSeenPart));
+    return -1;
+  }
+  seen->seq_num = (uint32_t)seq_num;
+  seen->body_hash = body_hash;
+  return ur_fountain_received_count(seq->ur_fountain) - 1;
+}
+
+// Decodes the body of a BBQr part into parser->scratch
+static bool decode_bbqr_part(QRPartParser *parser, const QRSequence *seq,
+                             const char *data, size_t data_len,
+                             size_t *part_len) {
+  // Decoded data is never longer than its text
+  const char *body = data + BBQR_PREFIX_LENGTH;
+  size_t body_len = data_len - BBQR_PREFIX_LENGTH;
+  if (!reserve_scratch(parser, body_len))
+    return false;
+
+  if (seq->bbqr.encoding == 'H')
+    return hex_decode(body, body_len, parser->scratch, part_len);
+  return base32_decode(body, body_len, parser->scratch, part_len);
+}
+
+// Turns the assembled BBQr data into the file: inflates "Z" payloads, takes
+// ownership of data either way
+static char *finish_bbqr(const QRSequence *seq, char *data, size_t len,
+                         size_t *result_len) {
+  if (seq->bbqr.encoding == 'Z') {
+    uint8_t *inflated;
+    size_t inflated_len;
+    bool ok = inflate_raw((const uint8_t *)data, len, BBQR_MAX_INFLATED_SIZE,
+                          &inflated, &inflated_len);
+    free(data);
+    if (!ok)
+      return NULL;
+    data = (char *)inflated;
+    len = inflated_len;
+  }
+
+  if (result_len)
+    *result_len = len;
+  return data;
+}
+
+int qr_capacity(int version, int encoding, int ecc) {
+  if (version < 1 || version > QR_CAPACITY_SIZE || ecc < QR_ECC_LOW ||
+      ecc > QR_ECC_HIGH)
+    return 0;
+
+  // 4-bit mode indicator, then a character count that widens at version 10
+  int bits = QR_DATA_CODEWORDS[version - 1][ecc] * 8 - 4;
+  bool wide = version >= 10;
+
+  switch (encoding) {
+  case QR_ENCODING_NUMERIC: {
+    bits -= wide ? 12 : 10;
+    int rest = bits % 10; // 3 digits in 10 bits, 2 in 7, 1 in 4
+    return bits / 10 * 3 + (rest >= 7 ? 2 : rest >= 4 ? 1 : 0);
+  }
+  case QR_ENCODING_ALPHANUMERIC:
+    bits -= wide ? 11 : 9;
+    return bits / 11 * 2 + (bits % 11 >= 6 ? 1 : 0);
+  default:
+    bits -= wide ? 16 : 8;
+    return bits / 8;
+  }
+}
+
+int qr_version_for_width(int max_width) {
+  int qr_version = (max_width - 2 - 17) / 4; // Subtract frame width
 
   if (qr_version < 1)
     qr_version = 1;
   if (qr_version > QR_CAPACITY_SIZE)
     qr_version = QR_CAPACITY_SIZE;
+  return qr_version;
+}
 
-  const int *capacity_list = (strcmp(encoding, "alphanumeric") == 0)
-                                 ? QR_CAPACITY_ALPHANUMERIC
-                                 : QR_CAPACITY_BYTE;
+// Every part but the last is a multiple of this many payload units
+static int part_granule(int qr_format) {
+  switch (qr_format) {
+  case FORMAT_PMOFN:
+    return 4; // whole base64 quads, so parts encode separately
+  case FORMAT_BBQR:
+    return 8; // whole base32 groups
+  default:
+    return 1;
+  }
+}
 
-  return capacity_list[qr_version - 1];
+static int decimal_digits(int value) {
+  int digits = 1;
+  while (value >= 10) {
+    value /= 10;
+    digits++;
+  }
+  return digits;
 }
 
-static void find_min_num_parts(const char *data, size_t data_len, int max_width,
-                               int qr_format, int *num_parts, int *part_size) {
-  const char *encoding = (qr_format == FORMAT_BBQR) ? "alphanumeric" : "byte";
-  int qr_capacity = max_qr_bytes(max_width, encoding);
+// Largest payload per part when the sequence has num_parts parts, in the
+// units qr_plan_parts() counts, or 0 if nothing fits
+static int part_payload_capacity(int capacity, int qr_format, int num_parts) {
+  int granule = part_granule(qr_format);
+
+  switch (qr_format) {
+  case FORMAT_PMOFN:
+    // "p<M>of<N> " prefix, absent on a single part
+    if (num_parts > 1)
+      capacity -= 4 + 2 * decimal_digits(num_parts);
+    break;
+  case FORMAT_UR:
+    // Bytewords spend two characters per byte
+    capacity -= UR_GENERIC_PREFIX_LENGTH;
+    capacity -= (UR_CBOR_PREFIX_LEN + UR_BYTEWORDS_CRC_LEN) * 2;
+    capacity /= 2;
+    if (capacity < UR_MIN_FRAGMENT_LENGTH)
+      return 0;
+    break;
+  case FORMAT_BBQR:
+    capacity -= BBQR_PREFIX_LENGTH;
+    break;
+  default:
+    if (num_parts > 1)
+      return 0;
+    break;
+  }
 
-  if (qr_format == FORMAT_PMOFN) {
-    int ps = qr_capacity - PMOFN_PREFIX_LENGTH_1D;
-    *num_parts = (data_len + ps - 1) / ps;
+  if (num_parts > 1)
+    capacity -= capacity % granule;
+  return capacity > 0 ? capacity : 0;
+}
 
-    if (*num_parts > 9) {
-      ps = qr_capacity - PMOFN_PREFIX_LENGTH_2D;
-      *num_parts = (data_len + ps - 1) / ps;
-    }
+// Fewest parts at one version, with the data spread evenly across them
+static bool plan_at_version(size_t data_len, int qr_format, int encoding,
+                            int ecc, int version, QRPartPlan *plan) {
+  int capacity = qr_capacity(version, encoding, ecc);
+
+  for (int num_parts = 1; num_parts <= QR_PARSER_MAX_PARTS; num_parts++) {
+    size_t granule = num_parts > 1 ? part_granule(qr_format) : 1;
+    size_t part_size = (data_len + num_parts - 1) / num_parts;
+    part_size = (part_size + granule - 1) / granule * granule;
+
+    int part_capacity = part_payload_capacity(capacity, qr_format, num_parts);
+    if (part_capacity == 0 || part_size > (size_t)part_capacity)
+      continue;
+
+    // Rounding up can leave nothing for the last parts
+    if (part_size > 0)
+      num_parts = (data_len + part_size - 1) / part_size;
+    plan->num_parts = num_parts > 0 ? num_parts : 1;
+    plan->part_size = (int)part_size;
+    plan->version = version;
+    return true;
+  }
+  return false;
+}
 
-    *part_size = (data_len + *num_parts - 1) / *num_parts;
-  } else if (qr_format == FORMAT_UR) {
-    // TODO: Implement UR format calculation
-    // Similar to Python version but adapted for C
-    qr_capacity -= UR_GENERIC_PREFIX_LENGTH;
-    qr_capacity -= (UR_CBOR_PREFIX_LEN + UR_BYTEWORDS_CRC_LEN) * 2;
-    qr_capacity = (qr_capacity > UR_MIN_FRAGMENT_LENGTH)
-                      ? qr_capacity
-                      : UR_MIN_FRAGMENT_LENGTH;
-
-    size_t adjusted_len = data_len * 2; // Bytewords encoding doubles length
-    *num_parts = (adjusted_len + qr_capacity - 1) / qr_capacity;
-    *part_size = data_len / *num_parts;
-    *part_size = (*part_size > UR_MIN_FRAGMENT_LENGTH) ? *part_size
-                                                       : UR_MIN_FRAGMENT_LENGTH;
-  } else if (qr_format == FORMAT_BBQR) {
-    // TODO: Implement BBQR format calculation
-    int max_part_size = qr_capacity - BBQR_PREFIX_LENGTH;
-    if ((int)data_len < max_part_size) {
-      *num_parts = 1;
-      *part_size = data_len;
-      return;
-    }
+bool qr_plan_parts(size_t data_len, int qr_format, int encoding, int ecc,
+                   int max_version, QRPartPlan *plan) {
+  if (!plan || max_version < 1)
+    return false;
+  if (max_version > QR_CAPACITY_SIZE)
+    max_version = QR_CAPACITY_SIZE;
 
-    max_part_size = (max_part_size / 8) * 8;
-    *num_parts = (data_len + max_part_size - 1) / max_part_size;
-    *part_size = data_len / *num_parts;
-    *part_size = ((*part_size + 7) / 8) * 8;
+  QRPartPlan best;
+  if (!plan_at_version(data_len, qr_format, encoding, ecc, max_version,
+                       &best))
+    return false;
 
-    if (*part_size > max_part_size) {
-      (*num_parts)++;
-      *part_size = data_len / *num_parts;
-      *part_size = ((*part_size + 7) / 8) * 8;
-    }
+  // The smallest version that needs no more parts gives the largest modules
+  for (int version = 1; version < max_version; version++) {
+    if (plan_at_version(data_len, qr_format, encoding, ecc, version, plan) &&
+        plan->num_parts == best.num_parts)
+      return true;
   }
+  *plan = best;
+  return true;
 }
 
 bool qr_parser_get_ur_result(QRPartParser *parser, const char **ur_type_out,
                              const uint8_t **cbor_data_out,
                              size_t *cbor_len_out) {
-  if (!parser || parser->format != FORMAT_UR || !parser->ur_decoder) {
+  if (!parser || !parser->complete || parser->lead->format != FORMAT_UR) {
     return false;
   }
 
-  ur_decoder_t *decoder = (ur_decoder_t *)parser->ur_decoder;
-  if (!ur_decoder_is_complete(decoder) || !ur_decoder_is_success(decoder)) {
-    return false;
+  QRSequence *seq = parser->lead;
+  const uint8_t *cbor;
+  size_t cbor_len;
+  if (seq->ur_fountain) {
+    cbor = ur_fountain_message(seq->ur_fountain, &cbor_len);
+  } else {
+    cbor = (const uint8_t *)seq->parts[0].data;
+    cbor_len = seq->parts[0].data_len;
   }
-
-  ur_result_t *result = ur_decoder_get_result(decoder);
-  if (!result) {
+  if (!cbor) {
     return false;
   }
 
   if (ur_type_out) {
-    *ur_type_out = result->type;
+    *ur_type_out = seq->ur_type;
   }
   if (cbor_data_out) {
-    *cbor_data_out = result->cbor_data;
+    *cbor_data_out = cbor;
   }
   if (cbor_len_out) {
-    *cbor_len_out = result->cbor_len;
+    *cbor_len_out = cbor_len;
   }
 
   return true;
@@ -461,7 +919,7 @@ int qr_parser_get_format(QRPartParser *parser) {
   if (!parser) {
     return FORMAT_NONE;
   }
-  return parser->format;
+  return parser->lead ? parser->lead->format : -1;
 }
 
 int get_qr_size(const char *qr_code) {
@@ -1,219 +1,409 @@
-/*
- * QR Part Parser - C Implementation
- * Based on Python implementation from Krux project
- *
- * MIT License
- * Copyright (c) 2021-2025 Krux contributors
- */
-
-#ifndef QR_CODES_H
-#define QR_CODES_H
-
-#include <stdbool.h>
-#include <stddef.h>
-#include <stdint.h>
-
-/**
- * @brief QR code format constants
- */
-#define FORMAT_NONE 0
-#define FORMAT_PMOFN 1
-#define FORMAT_UR 2
-#define FORMAT_BBQR 3
-
-/**
- * @brief Prefix length constants for different QR formats
- */
-#define PMOFN_PREFIX_LENGTH_1D 6
-#define PMOFN_PREFIX_LENGTH_2D 8
-#define BBQR_PREFIX_LENGTH 8
-#define UR_GENERIC_PREFIX_LENGTH 22
-#define UR_CBOR_PREFIX_LEN 14
-#define UR_BYTEWORDS_CRC_LEN 4
-#define UR_MIN_FRAGMENT_LENGTH 10
-
-/**
- * @brief Maximum QR code versions supported (limited to version 20)
- */
-#define QR_CAPACITY_SIZE 20
-
-/**
- * @brief Structure to hold a single QR part
- */
-typedef struct {
-  int index;       /**< Part index in the sequence */
-  char *data;      /**< Part data content */
-  size_t data_len; /**< Length of the data */
-} QRPart;
-
-/**
- * @brief Structure for BBQr code information
- */
-typedef struct {
-  char encoding;  /**< Encoding type */
-  char file_type; /**< File type identifier */
-  char *payload;  /**< Decoded payload */
-} BBQrCode;
-
-/**
- * @brief Main QR Parser structure
- *
- * This structure maintains the state of multi-part QR code parsing,
- * supporting various formats including P M-of-N, UR, and BBQR.
- */
-typedef struct {
-  QRPart **parts;     /**< Array of parsed QR parts */
-  int parts_capacity; /**< Allocated capacity for parts array */
-  int parts_count;    /**< Current number of parts */
-  int total;          /**< Total expected number of parts */
-  int format;         /**< Detected QR format (FORMAT_* constants) */
-  BBQrCode *bbqr;     /**< BBQr specific data (if format is BBQR) */
-  void *ur_decoder;   /**< UR decoder instance (if format is UR) */
-} QRPartParser;
-
-/**
- * @brief Create a new QR part parser instance
- *
- * Allocates and initializes a new QRPartParser structure.
- *
- * @return Pointer to new parser instance, or NULL on failure
- */
-QRPartParser *qr_parser_create(void);
-
-/**
- * @brief Destroy parser and free all associated memory
- *
- * Frees all memory associated with the parser, including
- * parsed parts and format-specific data.
- *
- * @param parser Parser instance to destroy
- */
-void qr_parser_destroy(QRPartParser *parser);
-
-/**
- * @brief Get the number of successfully parsed parts
- *
- * Returns the count of unique QR parts that have been
- * successfully parsed and stored.
- *
- * @param parser Parser instance
- * @return Number of parsed parts
- */
-int qr_parser_parsed_count(QRPartParser *parser);
-
-/**
- * @brief Get the number of processed parts (including duplicates)
- *
- * Returns the total count of parts that have been processed,
- * including any duplicate parts that may have been received.
- *
- * @param parser Parser instance
- * @return Number of processed parts
- */
-int qr_parser_processed_parts_count(QRPartParser *parser);
-
-/**
- * @brief Get the total expected number of parts
- *
- * Returns the total number of parts expected for the complete
- * message, as determined from the QR format headers.
- *
- * @param parser Parser instance
- * @return Total expected parts, or -1 if not yet determined
- */
-int qr_parser_total_count(QRPartParser *parser);
-
-/**
- * @brief Parse a QR code data string
- *
- * Attempts to parse the provided QR data string, detecting the format
- * on the first call and extracting part information for multi-part formats.
- *
- * @param parser Parser instance
- * @param data QR code data string to parse
- * @return Part index on success, or -1 on failure
- */
-int qr_parser_parse(QRPartParser *parser, const char *data);
-
-/**
- * @brief Parse QR code data with explicit length
- *
- * Like qr_parser_parse but accepts an explicit length, which is necessary
- * for binary data that may contain null bytes (e.g., Compact SeedQR).
- *
- * @param parser Parser instance
- * @param data QR code data (may contain null bytes)
- * @param data_len Length of the data in bytes
- * @return Part index on success, or -1 on failure
- */
-int qr_parser_parse_with_len(QRPartParser *parser, const char *data,
-                             size_t data_len);
-
-/**
- * @brief Check if all expected parts have been received
- *
- * Determines whether all parts of a multi-part QR sequence
- * have been successfully parsed and are ready for assembly.
- *
- * @param parser Parser instance
- * @return true if parsing is complete, false otherwise
- */
-bool qr_parser_is_complete(QRPartParser *parser);
-
-/**
- * @brief Get the assembled result from all parsed parts
- *
- * Combines all parsed parts in the correct order to produce
- * the final decoded message. Only call when qr_parser_is_complete()
- * returns true.
- *
- * For UR format, this returns a special marker string "UR_RESULT".
- * Use qr_parser_get_ur_result() to get the actual UR data.
- *
- * @param parser Parser instance
- * @param result_len Pointer to store the result length (optional)
- * @return Allocated string containing the result, or NULL on failure.
- *         Caller must free the returned string.
- */
-char *qr_parser_result(QRPartParser *parser, size_t *result_len);
-
-/**
- * @brief Get the UR decoder result (for FORMAT_UR only)
- *
- * Returns the UR result structure containing the type and CBOR data.
- * Only call when format is FORMAT_UR and qr_parser_is_complete() returns true.
- *
- * @param parser Parser instance
- * @param ur_type_out Pointer to store UR type string (do not free, owned by
- * decoder)
- * @param cbor_data_out Pointer to store CBOR data pointer (do not free, owned
- * by decoder)
- * @param cbor_len_out Pointer to store CBOR data length
- * @return true on success, false on failure
- */
-bool qr_parser_get_ur_result(QRPartParser *parser, const char **ur_type_out,
-                             const uint8_t **cbor_data_out,
-                             size_t *cbor_len_out);
-
-/**
- * @brief Get the detected QR format
- *
- * Returns the format detected during parsing.
- *
- * @param parser Parser instance
- * @return QR format (FORMAT_* constants)
- */
-int qr_parser_get_format(QRPartParser *parser);
-
-/**
- * @brief Calculate QR code size from encoded data
- *
- * Estimates the QR code size (side length in modules) based
- * on the encoded data length.
- *
- * @param qr_code Encoded QR code data
- * @return Estimated QR code size in modules
- */
-int get_qr_size(const char *qr_code);
-
+/*
+ * QR Part Parser - C Implementation
+ * Based on Python implementation from Krux project
+ *
+ * MIT License
+ * Copyright (c) 2021-2025 Krux contributors
+ */
+
+#ifndef QR_CODES_H
+#define QR_CODES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ur_fountain.h"
+
+/**
+ * @brief QR code format constants
+ */
+#define FORMAT_NONE 0
+#define FORMAT_PMOFN 1
+#define FORMAT_UR 2
+#define FORMAT_BBQR 3
+
+/**
+ * @brief Export-only format: encode with whichever format needs the fewest
+ * frames, for when the recipient's format is unknown
+ */
+#define FORMAT_AUTO 4
+
+/**
+ * @brief Prefix length constants for different QR formats
+ */
+#define PMOFN_PREFIX_LENGTH_1D 6
+#define PMOFN_PREFIX_LENGTH_2D 8
+#define BBQR_PREFIX_LENGTH 8
+#define UR_GENERIC_PREFIX_LENGTH 22
+#define UR_CBOR_PREFIX_LEN 14
+#define UR_BYTEWORDS_CRC_LEN 4
+#define UR_MIN_FRAGMENT_LENGTH 10
+
+/**
+ * @brief BBQr encodings (hex, base32, raw deflate + base32) and file types
+ */
+#define BBQR_ENCODINGS "H2Z"
+#define BBQR_FILE_TYPES "PTJCUBX"
+
+/**
+ * @brief Maximum QR code versions supported (limited to version 20)
+ */
+#define QR_CAPACITY_SIZE 20
+
+/**
+ * @brief QR code encoding modes
+ */
+#define QR_ENCODING_NUMERIC 0
+#define QR_ENCODING_ALPHANUMERIC 1
+#define QR_ENCODING_BYTE 2
+
+/**
+ * @brief QR code error correction levels, in qrcodegen's order
+ */
+#define QR_ECC_LOW 0
+#define QR_ECC_MEDIUM 1
+#define QR_ECC_QUARTILE 2
+#define QR_ECC_HIGH 3
+
+/**
+ * @brief Largest part count accepted from a sequence header
+ */
+#define QR_PARSER_MAX_PARTS 1024
+
+/**
+ * @brief Most sequences accumulated side by side
+ *
+ * A frame starting one more sequence replaces the sequence that went longest
+ * without a part.
+ */
+#define QR_PARSER_MAX_SEQUENCES 4
+
+/**
+ * @brief Longest UR type told apart, in characters
+ */
+#define QR_UR_TYPE_MAX_LENGTH 32
+
+/**
+ * @brief Slots remembering the UR parts a sequence has taken
+ *
+ * Part n goes in slot n modulo this count. An animated UR loops over the
+ * same frames, so a frame matching its slot is dropped before decoding.
+ */
+#define QR_UR_SEEN_SLOTS 64
+
+/**
+ * @brief Structure to hold a single QR part
+ */
+typedef struct {
+  char *data;      /**< Part data content, NULL until received */
+  size_t data_len; /**< Length of the data */
+} QRPart;
+
+/**
+ * @brief UR part taken by a sequence, from its frame alone
+ */
+typedef struct {
+  uint32_t seq_num;   /**< Part number, 0 for an empty slot */
+  uint32_t body_hash; /**< FNV-1a hash of the bytewords body */
+} QRSeenPart;
+
+/**
+ * @brief Split of a payload into QR frames, from qr_plan_parts()
+ */
+typedef struct {
+  int num_parts; /**< Number of parts */
+  int part_size; /**< Payload per part; the last part can be shorter */
+  int version;   /**< QR version every part fits in */
+} QRPartPlan;
+
+/**
+ * @brief Structure for BBQr code information
+ */
+typedef struct {
+  char encoding;  /**< Encoding type */
+  char file_type; /**< File type identifier */
+} BBQrCode;
+
+/**
+ * @brief Accumulator for the parts of one sequence
+ *
+ * A sequence is identified by its format and header: the total for P M-of-N,
+ * the encoding, file type and total for BBQr, the type and sequence length
+ * for UR. A frame without a multi-part header is a sequence of one part.
+ */
+typedef struct {
+  int format;    /**< QR format (FORMAT_* constants) */
+  int total;     /**< Total expected number of parts */
+  BBQrCode bbqr; /**< BBQr header (if format is BBQR) */
+  /** UR type (if format is UR) */
+  char ur_type[QR_UR_TYPE_MAX_LENGTH + 1];
+  int ur_seq_len;        /**< UR sequence length, 0 for a single-part UR */
+  QRPart *parts;         /**< Parts by slot (part index - 1) */
+  uint32_t *received;    /**< Bitmap of the slots holding a part */
+  int parts_capacity;    /**< Number of slots allocated */
+  int parts_count;       /**< Number of slots holding a part */
+  char *arena;           /**< Output buffer parts are written into */
+  size_t arena_size;     /**< Allocated size of the arena */
+  size_t arena_part_len; /**< Length of every part but the last */
+  /** Fountain decoder (if format is UR with more than one part) */
+  ur_fountain_t *ur_fountain;
+  QRSeenPart *ur_seen; /**< UR parts taken, QR_UR_SEEN_SLOTS of them */
+  uint32_t last_frame; /**< Parser frame count when a part last arrived */
+  int frames_accepted; /**< Frames taken, duplicates included */
+} QRSequence;
+
+/**
+ * @brief Main QR Parser structure
+ *
+ * Every frame is classified on its own and goes to the sequence it belongs
+ * to, so a stray code in view does not decide the format of the scan. The
+ * first sequence to complete wins.
+ */
+typedef struct {
+  /** Sequences in progress */
+  QRSequence *sequences[QR_PARSER_MAX_SEQUENCES];
+  int sequence_count;   /**< Number of sequences in progress */
+  QRSequence *lead;     /**< Winning sequence, or the one furthest along */
+  bool complete;        /**< The lead sequence is complete */
+  uint32_t frame_count; /**< Number of frames classified */
+  uint8_t *scratch;     /**< Decode buffer for BBQr parts */
+  size_t scratch_size;  /**< Allocated size of the scratch buffer */
+} QRPartParser;
+
+/**
+ * @brief Create a new QR part parser instance
+ *
+ * Allocates and initializes a new QRPartParser structure.
+ *
+ * @return Pointer to new parser instance, or NULL on failure
+ */
+QRPartParser *qr_parser_create(void);
+
+/**
+ * @brief Destroy parser and free all associated memory
+ *
+ * Frees all memory associated with the parser, including
+ * parsed parts and format-specific data.
+ *
+ * @param parser Parser instance to destroy
+ */
+void qr_parser_destroy(QRPartParser *parser);
+
+/**
+ * @brief Get the number of successfully parsed parts
+ *
+ * Returns the count of unique QR parts of the lead sequence that have been
+ * successfully parsed and stored.
+ *
+ * @param parser Parser instance
+ * @return Number of parsed parts
+ */
+int qr_parser_parsed_count(QRPartParser *parser);
+
+/**
+ * @brief Get the number of processed parts (including duplicates)
+ *
+ * Returns the count of frames the lead sequence accepted, including parts
+ * it already held. Frames that were rejected, or that went to another
+ * sequence, are not counted.
+ *
+ * @param parser Parser instance
+ * @return Number of processed parts
+ */
+int qr_parser_processed_parts_count(QRPartParser *parser);
+
+/**
+ * @brief Get the total expected number of parts
+ *
+ * Returns the total number of parts expected for the complete
+ * message of the lead sequence, as determined from the QR format headers.
+ *
+ * @param parser Parser instance
+ * @return Total expected parts, or -1 if not yet determined
+ */
+int qr_parser_total_count(QRPartParser *parser);
+
+/**
+ * @brief Get the progress of the lead sequence
+ *
+ * For UR this is the decoder's estimate, since fountain-coded parts do not
+ * map to slots.
+ *
+ * @param parser Parser instance
+ * @return Progress in permille, 0 if no sequence has started
+ */
+int qr_parser_progress_permille(QRPartParser *parser);
+
+/**
+ * @brief Parse a QR code data string
+ *
+ * Attempts to parse the provided QR data string, detecting its format
+ * and extracting part information for multi-part formats.
+ *
+ * A frame complete on its own (no multi-part header, or a sequence of one
+ * part) only wins while no multi-part sequence is under way.
+ *
+ * @param parser Parser instance
+ * @param data QR code data string to parse
+ * @return Part index within the lead sequence, or -1 if the frame was
+ * rejected or went to another sequence
+ */
+int qr_parser_parse(QRPartParser *parser, const char *data);
+
+/**
+ * @brief Parse QR code data with explicit length
+ *
+ * Like qr_parser_parse but accepts an explicit length, which is necessary
+ * for binary data that may contain null bytes (e.g., Compact SeedQR).
+ *
+ * @param parser Parser instance
+ * @param data QR code data (may contain null bytes)
+ * @param data_len Length of the data in bytes
+ * @return Part index within the lead sequence, or -1 if the frame was
+ * rejected or went to another sequence
+ */
+int qr_parser_parse_with_len(QRPartParser *parser, const char *data,
+                             size_t data_len);
+
+/**
+ * @brief Check if all expected parts have been received
+ *
+ * Determines whether all parts of one QR sequence have been
+ * successfully parsed and are ready for assembly. That sequence is the
+ * lead from then on, and later frames are ignored.
+ *
+ * @param parser Parser instance
+ * @return true if parsing is complete, false otherwise
+ */
+bool qr_parser_is_complete(QRPartParser *parser);
+
+/**
+ * @brief Get the assembled result from all parsed parts
+ *
+ * Combines all parsed parts in the correct order to produce
+ * the final decoded message. Only call when qr_parser_is_complete()
+ * returns true.
+ *
+ * For UR format, this returns a special marker string "UR_RESULT".
+ * Use qr_parser_get_ur_result() to get the actual UR data.
+ *
+ * @param parser Parser instance
+ * @param result_len Pointer to store the result length (optional)
+ * @return Allocated string containing the result, or NULL on failure.
+ *         Caller must free the returned string.
+ */
+char *qr_parser_result(QRPartParser *parser, size_t *result_len);
+
+/**
+ * @brief Take ownership of the assembled result
+ *
+ * Like qr_parser_result(), but without a copy where possible: once the part
+ * length is known the parser reserves one output buffer and writes every
+ * part into its final position as it arrives, and this hands that buffer
+ * over. Afterwards the parser no longer holds the parts, and
+ * qr_parser_result() returns NULL.
+ *
+ * For FORMAT_BBQR the result is the decoded (and, for the Z encoding,
+ * decompressed) file; see qr_parser_get_bbqr_file_type().
+ *
+ * @param parser Parser instance
+ * @param result_len Pointer to store the result length (optional)
+ * @return NUL-terminated result, or NULL if incomplete or for FORMAT_UR.
+ *         Caller must free the returned buffer.
+ */
+char *qr_parser_take_result(QRPartParser *parser, size_t *result_len);
+
+/**
+ * @brief Get the file type of a BBQr sequence
+ *
+ * @param parser Parser instance
+ * @return File type character (e.g. 'P' for PSBT, 'U' for text), or '\0' if
+ * the format is not FORMAT_BBQR
+ */
+char qr_parser_get_bbqr_file_type(QRPartParser *parser);
+
+/**
+ * @brief Capacity of one QR code version, in characters of an encoding
+ *
+ * @param version QR version, 1 to QR_CAPACITY_SIZE
+ * @param encoding QR_ENCODING_* constant
+ * @param ecc QR_ECC_* constant
+ * @return Characters (bytes for QR_ENCODING_BYTE), 0 if out of range
+ */
+int qr_capacity(int version, int encoding, int ecc);
+
+/**
+ * @brief Largest QR version that fits a width
+ *
+ * @param max_width Maximum QR code width in modules, including a 1-module
+ * frame on each side
+ * @return QR version, clamped to 1 .. QR_CAPACITY_SIZE
+ */
+int qr_version_for_width(int max_width);
+
+/**
+ * @brief Plan the split of a payload into QR frames
+ *
+ * Finds the fewest parts at max_version, accounting for the format's
+ * per-part prefix, and spreads the payload evenly so only the last part can
+ * be shorter. The plan then uses the smallest version that needs no more
+ * parts.
+ *
+ * data_len and part_size count base64 characters for FORMAT_PMOFN and
+ * FORMAT_NONE, CBOR bytes (fragment length) for FORMAT_UR, and base32
+ * characters for FORMAT_BBQR. Every part but the last is a multiple of 4
+ * for pMofN (whole base64 quads) and of 8 for BBQr.
+ *
+ * @param data_len Payload length
+ * @param qr_format FORMAT_NONE (single part only), FORMAT_PMOFN, FORMAT_UR
+ * or FORMAT_BBQR
+ * @param encoding QR_ENCODING_* mode the frames will be encoded in
+ * @param ecc QR_ECC_* level the frames will be encoded with
+ * @param max_version Largest QR version to use (see qr_version_for_width())
+ * @param plan Pointer to receive the plan
+ * @return true on success, false if the payload cannot be split that way
+ */
+bool qr_plan_parts(size_t data_len, int qr_format, int encoding, int ecc,
+                   int max_version, QRPartPlan *plan);
+
+/**
+ * @brief Get the UR decoder result (for FORMAT_UR only)
+ *
+ * Returns the UR result structure containing the type and CBOR data.
+ * Only call when format is FORMAT_UR and qr_parser_is_complete() returns true.
+ *
+ * @param parser Parser instance
+ * @param ur_type_out Pointer to store UR type string (do not free, owned by
+ * decoder)
+ * @param cbor_data_out Pointer to store CBOR data pointer (do not free, owned
+ * by decoder)
+ * @param cbor_len_out Pointer to store CBOR data length
+ * @return true on success, false on failure
+ */
+bool qr_parser_get_ur_result(QRPartParser *parser, const char **ur_type_out,
+                             const uint8_t **cbor_data_out,
+                             size_t *cbor_len_out);
+
+/**
+ * @brief Get the detected QR format
+ *
+ * Returns the format of the lead sequence.
+ *
+ * @param parser Parser instance
+ * @return QR format (FORMAT_* constants), or -1 before any frame was parsed
+ */
+int qr_parser_get_format(QRPartParser *parser);
+
+/**
+ * @brief Calculate QR code size from encoded data
+ *
+ * Estimates the QR code size (side length in modules) based
+ * on the encoded data length.
+ *
+ * @param qr_code Encoded QR code data
+ * @return Estimated QR code size in modules
+ */
+int get_qr_size(const char *qr_code);
+
 #endif /* QR_CODES_H */
\ No newline at end of file
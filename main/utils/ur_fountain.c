@@ -0,0 +1,503 @@
+// UR Fountain Decoder
+
+#include "ur_fountain.h"
+#include "bytewords.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wally_crypto.h>
+
+#define WORD_BITS 64
+#define WORDS_FOR(count) (((count) + WORD_BITS - 1) / WORD_BITS)
+// Held rows allocated up front; the store doubles from there up to seqLen
+#define INITIAL_ROWS 32
+
+// Xoshiro256**, seeded from SHA-256 as the UR reference does
+typedef struct {
+  uint64_t s[4];
+} xoshiro256_t;
+
+struct ur_fountain {
+  uint32_t seq_len;
+  uint32_t message_len;
+  uint32_t checksum;
+  size_t fragment_len;
+  size_t data_words; // 64-bit words per fragment, the last zero-padded
+  size_t bit_words;  // 64-bit words per fragment bitset
+  size_t row_words;  // bitset then data
+  uint64_t *message; // solved fragment i at i * data_words
+  uint64_t *solved;  // bitset of solved fragments
+  uint32_t solved_count;
+  uint64_t *rows;      // held mixed parts, row_words each
+  uint64_t *pivots;    // bitset of the pivots of held rows
+  uint32_t *row_pivot; // pivot fragment of each held row
+  int32_t *pivot_row;  // held row of each fragment, or -1
+  uint32_t row_count;
+  uint32_t row_capacity;
+  uint64_t *part;       // incoming part, row_words
+  double *degree_probs; // alias table of the degree distribution
+  uint32_t *degree_aliases;
+  uint32_t *shuffle; // fragment indexes being drawn
+  int received;
+  bool complete;
+};
+
+// Reads the head of a CBOR data item of the given major type
+static bool cbor_read_head(const uint8_t **pos, const uint8_t *end, int major,
+                           uint64_t *value) {
+  if (*pos >= end || (**pos >> 5) != major)
+    return false;
+
+  uint8_t info = *(*pos)++ & 0x1F;
+  if (info < 24) {
+    *value = info;
+    return true;
+  }
+  if (info > 27)
+    return false;
+
+  size_t len = (size_t)1 << (info - 24);
+  if ((size_t)(end - *pos) < len)
+    return false;
+  *value = 0;
+  for (size_t i = 0; i < len; i++)
+    *value = (*value << 8) | *(*pos)++;
+  return true;
+}
+
+bool ur_part_parse(const uint8_t *cbor, size_t len, ur_part_t *part) {
+  const uint8_t *pos = cbor;
+  const uint8_t *end = cbor + len;
+  uint64_t count, fields[4], fragment_len;
+
+  if (!cbor_read_head(&pos, end, 4, &count) || count != 5)
+    return false;
+  for (int i = 0; i < 4; i++) {
+    if (!cbor_read_head(&pos, end, 0, &fields[i]) || fields[i] > UINT32_MAX)
+      return false;
+  }
+  // The fragment ends the part
+  if (!cbor_read_head(&pos, end, 2, &fragment_len) ||
+      fragment_len != (uint64_t)(end - pos))
+    return false;
+
+  part->seq_num = (uint32_t)fields[0];
+  part->seq_len = (uint32_t)fields[1];
+  part->message_len = (uint32_t)fields[2];
+  part->checksum = (uint32_t)fields[3];
+  part->fragment = pos;
+  part->fragment_len = (size_t)fragment_len;
+  return true;
+}
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+static void xoshiro_seed(xoshiro256_t *rng, uint32_t seq_num,
+                         uint32_t checksum) {
+  uint8_t seed[8], digest[32];
+
+  for (int i = 0; i < 4; i++) {
+    seed[i] = (uint8_t)(seq_num >> (24 - 8 * i));
+    seed[4 + i] = (uint8_t)(checksum >> (24 - 8 * i));
+  }
+  wally_sha256(seed, sizeof(seed), digest, sizeof(digest));
+
+  for (int i = 0; i < 4; i++) {
+    rng->s[i] = 0;
+    for (int n = 0; n < 8; n++)
+      rng->s[i] = (rng->s[i] << 8) | digest[8 * i + n];
+  }
+}
+
+static uint64_t xoshiro_next(xoshiro256_t *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+static double xoshiro_next_double(xoshiro256_t *rng) {
+  return (double)xoshiro_next(rng) / ((double)UINT64_MAX + 1);
+}
+
+static uint32_t xoshiro_next_int(xoshiro256_t *rng, uint32_t low,
+                                 uint32_t high) {
+  return (uint32_t)(xoshiro_next_double(rng) * (high - low + 1)) + low;
+}
+
+// Vose's alias table for degree d with weight 1/d, built once per sequence
+// and in the reference's order, so draws match the encoder's exactly
+static bool build_degree_sampler(ur_fountain_t *fountain) {
+  uint32_t n = fountain->seq_len;
+  double *p = malloc(n * sizeof(double));
+  uint32_t *small = malloc(n * sizeof(uint32_t));
+  uint32_t *large = malloc(n * sizeof(uint32_t));
+  uint32_t small_count = 0, large_count = 0;
+  double sum = 0;
+  bool ok = false;
+
+  if (!p || !small || !large)
+    goto cleanup;
+
+  for (uint32_t i = 0; i < n; i++)
+    sum += 1.0 / (i + 1);
+  for (uint32_t i = 0; i < n; i++)
+    p[i] = 1.0 / (i + 1) * (double)n / sum;
+  for (uint32_t i = n; i-- > 0;) {
+    if (p[i] < 1)
+      small[small_count++] = i;
+    else
+      large[large_count++] = i;
+  }
+
+  while (small_count && large_count) {
+    uint32_t a = small[--small_count];
+    uint32_t g = large[--large_count];
+    fountain->degree_probs[a] = p[a];
+    fountain->degree_aliases[a] = g;
+    p[g] += p[a] - 1;
+    if (p[g] < 1)
+      small[small_count++] = g;
+    else
+      large[large_count++] = g;
+  }
+  while (large_count)
+    fountain->degree_probs[large[--large_count]] = 1;
+  while (small_count)
+    fountain->degree_probs[small[--small_count]] = 1;
+  ok = true;
+
+cleanup:
+  free(p);
+  free(small);
+  free(large);
+  return ok;
+}
+
+// Sets the bits of the fragments mixed into part seq_num
+static void choose_fragments(ur_fountain_t *fountain, uint32_t seq_num,
+                             uint64_t *bits) {
+  uint32_t n = fountain->seq_len;
+
+  memset(bits, 0, fountain->bit_words * sizeof(uint64_t));
+  if (seq_num <= n) {
+    bits[(seq_num - 1) / WORD_BITS] |= 1ULL << ((seq_num - 1) % WORD_BITS);
+    return;
+  }
+
+  xoshiro256_t rng;
+  xoshiro_seed(&rng, seq_num, fountain->checksum);
+
+  double r1 = xoshiro_next_double(&rng);
+  double r2 = xoshiro_next_double(&rng);
+  uint32_t i = (uint32_t)((double)n * r1);
+  uint32_t degree =
+      (r2 < fountain->degree_probs[i] ? i : fountain->degree_aliases[i]) + 1;
+
+  // The first degree draws of the reference's shuffle, which removes each
+  // drawn index from the remaining ones
+  uint32_t *remaining = fountain->shuffle;
+  for (uint32_t k = 0; k < n; k++)
+    remaining[k] = k;
+  for (uint32_t k = 0; k < degree; k++) {
+    uint32_t count = n - k;
+    uint32_t index = xoshiro_next_int(&rng, 0, count - 1);
+    uint32_t fragment = remaining[index];
+    memmove(&remaining[index], &remaining[index + 1],
+            (count - index - 1) * sizeof(uint32_t));
+    bits[fragment / WORD_BITS] |= 1ULL << (fragment % WORD_BITS);
+  }
+}
+
+static void xor_words(uint64_t *dst, const uint64_t *src, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    dst[i] ^= src[i];
+}
+
+static bool test_bit(const uint64_t *bits, uint32_t index) {
+  return (bits[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+}
+
+static int lowest_bit(const uint64_t *bits, size_t words) {
+  for (size_t w = 0; w < words; w++) {
+    if (bits[w])
+      return (int)(w * WORD_BITS + __builtin_ctzll(bits[w]));
+  }
+  return -1;
+}
+
+// Whether index is the only bit set
+static bool single_bit(const uint64_t *bits, size_t words, uint32_t index) {
+  for (size_t w = 0; w < words; w++) {
+    uint64_t expected =
+        w == index / WORD_BITS ? 1ULL << (index % WORD_BITS) : 0;
+    if (bits[w] != expected)
+      return false;
+  }
+  return true;
+}
+
+static uint64_t *row_at(const ur_fountain_t *fountain, uint32_t row) {
+  return fountain->rows + (size_t)row * fountain->row_words;
+}
+
+static void solve(ur_fountain_t *fountain, uint32_t index,
+                  const uint64_t *data) {
+  memcpy(fountain->message + index * fountain->data_words, data,
+         fountain->data_words * sizeof(uint64_t));
+  fountain->solved[index / WORD_BITS] |= 1ULL << (index % WORD_BITS);
+  fountain->solved_count++;
+}
+
+// Makes room for one more held row. Every held row has its own unsolved
+// pivot, so seqLen rows are never outgrown.
+static bool grow_rows(ur_fountain_t *fountain) {
+  uint32_t capacity = fountain->row_capacity * 2;
+  if (capacity > fountain->seq_len)
+    capacity = fountain->seq_len;
+
+  uint64_t *rows =
+      realloc(fountain->rows,
+              (size_t)capacity * fountain->row_words * sizeof(uint64_t));
+  if (!rows)
+    return false;
+  fountain->rows = rows;
+  uint32_t *row_pivot =
+      realloc(fountain->row_pivot, capacity * sizeof(uint32_t));
+  if (!row_pivot)
+    return false;
+  fountain->row_pivot = row_pivot;
+  fountain->row_capacity = capacity;
+  return true;
+}
+
+// Drops a held row, moving the last one into its place
+static void remove_row(ur_fountain_t *fountain, uint32_t row) {
+  uint32_t pivot = fountain->row_pivot[row];
+  uint32_t last = --fountain->row_count;
+
+  fountain->pivots[pivot / WORD_BITS] &= ~(1ULL << (pivot % WORD_BITS));
+  fountain->pivot_row[pivot] = -1;
+  if (row == last)
+    return;
+
+  memcpy(row_at(fountain, row), row_at(fountain, last),
+         fountain->row_words * sizeof(uint64_t));
+  fountain->row_pivot[row] = fountain->row_pivot[last];
+  fountain->pivot_row[fountain->row_pivot[row]] = (int32_t)row;
+}
+
+static void free_buffers(ur_fountain_t *fountain) {
+  free(fountain->message);
+  free(fountain->solved);
+  free(fountain->pivots);
+  free(fountain->rows);
+  free(fountain->row_pivot);
+  free(fountain->pivot_row);
+  free(fountain->part);
+  free(fountain->degree_probs);
+  free(fountain->degree_aliases);
+  free(fountain->shuffle);
+}
+
+static void reset_solution(ur_fountain_t *fountain) {
+  memset(fountain->solved, 0, fountain->bit_words * sizeof(uint64_t));
+  memset(fountain->pivots, 0, fountain->bit_words * sizeof(uint64_t));
+  for (uint32_t i = 0; i < fountain->seq_len; i++)
+    fountain->pivot_row[i] = -1;
+  fountain->solved_count = 0;
+  fountain->row_count = 0;
+}
+
+// Sizes every buffer for the sequence of the first part
+static bool setup(ur_fountain_t *fountain, const ur_part_t *part) {
+  uint32_t n = part->seq_len;
+
+  if (n < 1 || n > UR_FOUNTAIN_MAX_SEQ_LEN || part->fragment_len < 1 ||
+      part->fragment_len > UR_FOUNTAIN_MAX_FRAGMENT_LEN ||
+      part->message_len > (uint64_t)n * part->fragment_len)
+    return false;
+
+  fountain->seq_len = n;
+  fountain->message_len = part->message_len;
+  fountain->checksum = part->checksum;
+  fountain->fragment_len = part->fragment_len;
+  fountain->data_words = WORDS_FOR(part->fragment_len * 8);
+  fountain->bit_words = WORDS_FOR(n);
+  fountain->row_words = fountain->bit_words + fountain->data_words;
+  fountain->row_capacity = n < INITIAL_ROWS ? n : INITIAL_ROWS;
+
+  fountain->message = malloc(n * fountain->data_words * sizeof(uint64_t));
+  fountain->solved = malloc(fountain->bit_words * sizeof(uint64_t));
+  fountain->pivots = malloc(fountain->bit_words * sizeof(uint64_t));
+  fountain->rows =
+      malloc(fountain->row_capacity * fountain->row_words * sizeof(uint64_t));
+  fountain->row_pivot = malloc(fountain->row_capacity * sizeof(uint32_t));
+  fountain->pivot_row = malloc(n * sizeof(int32_t));
+  fountain->part = malloc(fountain->row_words * sizeof(uint64_t));
+  fountain->degree_probs = malloc(n * sizeof(double));
+  fountain->degree_aliases = calloc(n, sizeof(uint32_t));
+  fountain->shuffle = malloc(n * sizeof(uint32_t));
+  if (!fountain->message || !fountain->solved || !fountain->pivots ||
+      !fountain->rows || !fountain->row_pivot || !fountain->pivot_row ||
+      !fountain->part || !fountain->degree_probs ||
+      !fountain->degree_aliases || !fountain->shuffle ||
+      !build_degree_sampler(fountain)) {
+    // The next part retries from scratch
+    free_buffers(fountain);
+    *fountain = (ur_fountain_t){0};
+    return false;
+  }
+
+  reset_solution(fountain);
+  return true;
+}
+
+// Lays the solved fragments end to end and checks the message
+static bool finish(ur_fountain_t *fountain) {
+  uint8_t *bytes = (uint8_t *)fountain->message;
+  size_t stride = fountain->data_words * sizeof(uint64_t);
+
+  for (uint32_t i = 1; i < fountain->seq_len; i++)
+    memmove(bytes + i * fountain->fragment_len, bytes + i * stride,
+            fountain->fragment_len);
+
+  if (bytewords_crc32(bytes, fountain->message_len) != fountain->checksum) {
+    reset_solution(fountain);
+    return false;
+  }
+  fountain->complete = true;
+  return true;
+}
+
+ur_fountain_t *ur_fountain_create(void) {
+  return calloc(1, sizeof(ur_fountain_t));
+}
+
+void ur_fountain_destroy(ur_fountain_t *fountain) {
+  if (!fountain)
+    return;
+
+  free_buffers(fountain);
+  free(fountain);
+}
+
+bool ur_fountain_receive(ur_fountain_t *fountain, const ur_part_t *part) {
+  if (part->seq_num < 1)
+    return false;
+  if (!fountain->message) {
+    if (!setup(fountain, part))
+      return false;
+  } else if (part->seq_len != fountain->seq_len ||
+             part->message_len != fountain->message_len ||
+             part->checksum != fountain->checksum ||
+             part->fragment_len != fountain->fragment_len) {
+    return false;
+  }
+
+  fountain->received++;
+  if (fountain->complete)
+    return true;
+
+  size_t bit_words = fountain->bit_words;
+  uint64_t *bits = fountain->part;
+  uint64_t *data = fountain->part + bit_words;
+  choose_fragments(fountain, part->seq_num, bits);
+  data[fountain->data_words - 1] = 0;
+  memcpy(data, part->fragment, part->fragment_len);
+
+  // Peel solved fragments off and eliminate held pivots. Held rows hold no
+  // solved fragment or other pivot, so XORing one in never sets a bit this
+  // pass still has to clear.
+  for (size_t w = 0; w < bit_words; w++) {
+    uint64_t known = bits[w] & (fountain->solved[w] | fountain->pivots[w]);
+    while (known) {
+      uint32_t index = (uint32_t)(w * WORD_BITS + __builtin_ctzll(known));
+      known &= known - 1;
+      if (test_bit(fountain->solved, index)) {
+        xor_words(data, fountain->message + index * fountain->data_words,
+                  fountain->data_words);
+        bits[w] &= ~(1ULL << (index % WORD_BITS));
+      } else {
+        xor_words(bits, row_at(fountain, fountain->pivot_row[index]),
+                  fountain->row_words);
+      }
+    }
+  }
+
+  int pivot = lowest_bit(bits, bit_words);
+  if (pivot < 0)
+    return true; // duplicate or dependent
+  bool single = single_bit(bits, bit_words, (uint32_t)pivot);
+  if (!single && fountain->row_count == fountain->row_capacity &&
+      !grow_rows(fountain))
+    return false;
+
+  // Take the new pivot out of the held rows; a row left with its own pivot
+  // alone is solved
+  for (uint32_t r = 0; r < fountain->row_count;) {
+    uint64_t *row = row_at(fountain, r);
+    if (test_bit(row, (uint32_t)pivot)) {
+      xor_words(row, fountain->part, fountain->row_words);
+      if (single_bit(row, bit_words, fountain->row_pivot[r])) {
+        solve(fountain, fountain->row_pivot[r], row + bit_words);
+        remove_row(fountain, r);
+        continue;
+      }
+    }
+    r++;
+  }
+
+  if (single) {
+    solve(fountain, (uint32_t)pivot, data);
+  } else {
+    uint32_t r = fountain->row_count++;
+    memcpy(row_at(fountain, r), fountain->part,
+           fountain->row_words * sizeof(uint64_t));
+    fountain->row_pivot[r] = (uint32_t)pivot;
+    fountain->pivot_row[pivot] = (int32_t)r;
+    fountain->pivots[pivot / WORD_BITS] |= 1ULL << (pivot % WORD_BITS);
+  }
+
+  if (fountain->solved_count == fountain->seq_len)
+    return finish(fountain);
+  return true;
+}
+
+bool ur_fountain_is_complete(const ur_fountain_t *fountain) {
+  return fountain->complete;
+}
+
+const uint8_t *ur_fountain_message(const ur_fountain_t *fountain,
+                                   size_t *len) {
+  if (!fountain->complete)
+    return NULL;
+  if (len)
+    *len = fountain->message_len;
+  return (const uint8_t *)fountain->message;
+}
+
+int ur_fountain_received_count(const ur_fountain_t *fountain) {
+  return fountain->received;
+}
+
+int ur_fountain_seq_len(const ur_fountain_t *fountain) {
+  return (int)fountain->seq_len;
+}
+
+int ur_fountain_progress_permille(const ur_fountain_t *fountain) {
+  if (fountain->complete)
+    return 1000;
+  if (!fountain->seq_len)
+    return 0;
+
+  int permille = (int)((fountain->solved_count + fountain->row_count) * 1000 /
+                       fountain->seq_len);
+  return permille < 1000 ? permille : 999;
+}
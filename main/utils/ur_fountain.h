@@ -0,0 +1,134 @@
+/*
+ * UR Fountain Decoder
+ * Reassembles multi-part Uniform Resources (BCR-2020-005) from
+ * fountain-coded parts
+ *
+ * Part seqNum of a sequence of seqLen fragments carries fragment
+ * seqNum - 1 while seqNum <= seqLen; later parts carry the XOR of a
+ * pseudo-random set of fragments. Each part is kept as a bitset of its
+ * fragments with its data, one bit per fragment, so mixing parts is a
+ * word-wide XOR of both. A part reduced to one fragment solves it
+ * (peeling); parts that stay mixed enter an incremental Gauss-Jordan
+ * elimination over GF(2), so every independent part counts towards the
+ * message and decoding finishes as soon as the parts received span it.
+ * Each held part has its own unsolved fragment as pivot, so the store
+ * grows as needed up to seqLen parts and never drops an independent one.
+ */
+
+#ifndef UR_FOUNTAIN_H
+#define UR_FOUNTAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Largest sequence length accepted
+ */
+#define UR_FOUNTAIN_MAX_SEQ_LEN 1024
+
+/**
+ * @brief Largest fragment accepted, in bytes
+ */
+#define UR_FOUNTAIN_MAX_FRAGMENT_LEN 2048
+
+/**
+ * @brief One part, as carried in the CBOR body of "ur:<type>/<n>-<m>/"
+ */
+typedef struct {
+  uint32_t seq_num;        /**< Part number, from 1 */
+  uint32_t seq_len;        /**< Number of fragments in the message */
+  uint32_t message_len;    /**< Message length in bytes, before padding */
+  uint32_t checksum;       /**< CRC32 of the message */
+  const uint8_t *fragment; /**< Part data, points into the parsed CBOR */
+  size_t fragment_len;     /**< Length of every fragment */
+} ur_part_t;
+
+typedef struct ur_fountain ur_fountain_t;
+
+/**
+ * @brief Parse the CBOR body of a multi-part UR
+ *
+ * @param cbor CBOR array [seqNum, seqLen, messageLen, checksum, fragment]
+ * @param len Length of the CBOR
+ * @param part Pointer to receive the part
+ * @return true on success, false if the CBOR is not a valid part
+ */
+bool ur_part_parse(const uint8_t *cbor, size_t len, ur_part_t *part);
+
+/**
+ * @brief Create a decoder
+ *
+ * Buffers are allocated on the first part, once the sequence is known.
+ *
+ * @return Decoder, or NULL on allocation failure
+ */
+ur_fountain_t *ur_fountain_create(void);
+
+/**
+ * @brief Destroy a decoder
+ *
+ * @param fountain Decoder (can be NULL)
+ */
+void ur_fountain_destroy(ur_fountain_t *fountain);
+
+/**
+ * @brief Add a part to the message being decoded
+ *
+ * Duplicate and dependent parts are accepted but add nothing. When the
+ * last fragment is solved the message is checked against its checksum; on a
+ * mismatch decoding starts over.
+ *
+ * @param fountain Decoder
+ * @param part Part from ur_part_parse()
+ * @return true if the part was accepted, false if it belongs to another
+ * sequence, or on allocation failure or checksum mismatch
+ */
+bool ur_fountain_receive(ur_fountain_t *fountain, const ur_part_t *part);
+
+/**
+ * @brief Check whether the message is decoded and its checksum matches
+ *
+ * @param fountain Decoder
+ * @return true once the message is available
+ */
+bool ur_fountain_is_complete(const ur_fountain_t *fountain);
+
+/**
+ * @brief Get the decoded message
+ *
+ * @param fountain Decoder
+ * @param len Pointer to receive the message length
+ * @return Message, owned by the decoder, or NULL if not complete
+ */
+const uint8_t *ur_fountain_message(const ur_fountain_t *fountain,
+                                   size_t *len);
+
+/**
+ * @brief Number of parts accepted, including duplicates
+ *
+ * @param fountain Decoder
+ * @return Parts accepted
+ */
+int ur_fountain_received_count(const ur_fountain_t *fountain);
+
+/**
+ * @brief Sequence length of the message being decoded
+ *
+ * @param fountain Decoder
+ * @return Number of fragments, 0 before the first part
+ */
+int ur_fountain_seq_len(const ur_fountain_t *fountain);
+
+/**
+ * @brief Decoding progress
+ *
+ * The rank of the parts held over the number of fragments: the message is
+ * decoded when it reaches 1000, and no fewer independent parts can do it.
+ *
+ * @param fountain Decoder
+ * @return Progress in permille
+ */
+int ur_fountain_progress_permille(const ur_fountain_t *fountain);
+
+#endif // UR_FOUNTAIN_H
@@ -0,0 +1,252 @@
+/*
+ * Bytewords Benchmark
+ * Checks the table-driven CRC32 and minimal bytewords decoder against the
+ * straightforward versions they replaced (a bit at a time, and a search of
+ * the 256 words), then times both, and the cost of a UR frame the parser
+ * has already taken.
+ *
+ * Usage: bench_bytewords [iterations]
+ */
+
+#include "bytewords.h"
+#include "qr_codes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 20000
+#define BENCH_DATA_LEN 420 // a UR part's CBOR with a 400-byte fragment
+#define MAX_DATA_LEN 4096
+
+// First and last letter of each word, in byte order (BCR-2020-012)
+static const char MINIMAL_WORDS[] =
+    "aeadaoaxaaahamatayasbkbdbnbtbabsbebybgbwbbbzcmchcscfcycwcecackctcxclcpcn"
+    "dkdadsdidedtdrdndwdpdmdldyeheyeoeeecenemetesftfrfnfsfmfhfzfpfwfxfyfefgfl"
+    "fdgagegrgsgtglgwgdgygmgughgohfhghdhkhthphhhlhyhehnhsidiaieihiyioisinimje"
+    "jzjnjtjljojsjpjkjykpkoktkskkknkgkekikblblalylflslrlplnltloldlelulklgmnmy"
+    "mhmemomumwmdmtmsmknlnyndnsntnnnenboyoeotoxonolospdptpkpypspmplpepfpaprqd"
+    "qzrerprlrorhrdrkrfryrnrsrtsesasrssskswstspsosgsbsfsntotktitttdtetytltbts"
+    "tptatnuyuoutueurvtvyvovlvevwvavdvswlwdwmwpwewywswtwnwzwfwkykynylyaytzszo"
+    "ztzczezm";
+
+static volatile uint32_t sink;
+
+static double now_ns(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static uint32_t reference_crc32(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static bool reference_decode(const char *text, size_t len, uint8_t *out,
+                             size_t *out_len) {
+  if (len % 2 || len < 2 * BYTEWORDS_CRC_LEN)
+    return false;
+
+  size_t count = len / 2;
+  for (size_t i = 0; i < count; i++) {
+    char first = text[2 * i] | 0x20, last = text[2 * i + 1] | 0x20;
+    int value = 0;
+    while (value < 256 && (MINIMAL_WORDS[2 * value] != first ||
+                           MINIMAL_WORDS[2 * value + 1] != last))
+      value++;
+    if (value == 256)
+      return false;
+    out[i] = (uint8_t)value;
+  }
+
+  size_t data_len = count - BYTEWORDS_CRC_LEN;
+  const uint8_t *crc = out + data_len;
+  uint32_t expected = (uint32_t)crc[0] << 24 | (uint32_t)crc[1] << 16 |
+                      (uint32_t)crc[2] << 8 | crc[3];
+  if (reference_crc32(out, data_len) != expected)
+    return false;
+  *out_len = data_len;
+  return true;
+}
+
+// Minimal bytewords of data followed by its CRC32
+static size_t encode_minimal(const uint8_t *data, size_t len, char *text) {
+  uint32_t crc = reference_crc32(data, len);
+  uint8_t tail[BYTEWORDS_CRC_LEN] = {crc >> 24, crc >> 16, crc >> 8, crc};
+  size_t pos = 0;
+
+  for (size_t i = 0; i < len + BYTEWORDS_CRC_LEN; i++) {
+    uint8_t byte = i < len ? data[i] : tail[i - len];
+    text[pos++] = MINIMAL_WORDS[2 * byte];
+    text[pos++] = MINIMAL_WORDS[2 * byte + 1];
+  }
+  text[pos] = '\0';
+  return pos;
+}
+
+static bool check_vectors(void) {
+  static const uint8_t bytes[] = {0x00, 0x01, 0x02, 0x80, 0xFF};
+  char text[32];
+  uint8_t out[16];
+  size_t out_len;
+
+  if (bytewords_crc32((const uint8_t *)"123456789", 9) != 0xCBF43926 ||
+      bytewords_crc32(NULL, 0) != 0) {
+    fprintf(stderr, "CRC32 check values wrong\n");
+    return false;
+  }
+  // BCR-2020-012 example, in upper case as an alphanumeric QR carries it
+  encode_minimal(bytes, sizeof(bytes), text);
+  if (strcmp(text, "aeadaolazmjendeoti") != 0 ||
+      !bytewords_decode_minimal("AEADAOLAZMJENDEOTI", 18, out, &out_len) ||
+      out_len != sizeof(bytes) || memcmp(out, bytes, sizeof(bytes)) != 0) {
+    fprintf(stderr, "Bytewords example wrong\n");
+    return false;
+  }
+  return true;
+}
+
+// Every length and alignment for the CRC; random valid, corrupted and
+// mixed-case text for the decoder
+static bool check_against_reference(void) {
+  static uint8_t data[MAX_DATA_LEN], out[MAX_DATA_LEN], ref_out[MAX_DATA_LEN];
+  static char text[2 * MAX_DATA_LEN + 2 * BYTEWORDS_CRC_LEN + 1];
+  int valid = 0;
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)rand();
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t len = 0; len <= 600; len++) {
+      if (bytewords_crc32(data + offset, len) !=
+          reference_crc32(data + offset, len)) {
+        fprintf(stderr, "CRC32 differs at offset %zu, length %zu\n", offset,
+                len);
+        return false;
+      }
+    }
+  }
+
+  for (int trial = 0; trial < 20000; trial++) {
+    size_t len = (size_t)rand() % 200;
+    for (size_t i = 0; i < len; i++)
+      data[i] = (uint8_t)rand();
+    size_t text_len = encode_minimal(data, len, text);
+    if (rand() % 2) {
+      for (size_t i = 0; i < text_len; i++)
+        text[i] ^= (char)(0x20 * (rand() % 2));
+    }
+    int damage = rand() % 4;
+    if (damage == 1)
+      text[(size_t)rand() % text_len] = (char)rand();
+    else if (damage == 2)
+      text[(size_t)rand() % text_len] ^= 1;
+
+    size_t out_len = 0, ref_len = 0;
+    bool ok = bytewords_decode_minimal(text, text_len, out, &out_len);
+    bool ref_ok = reference_decode(text, text_len, ref_out, &ref_len);
+    if (ok != ref_ok ||
+        (ok && (out_len != ref_len || memcmp(out, ref_out, out_len) != 0))) {
+      fprintf(stderr, "Decoders differ on trial %d\n", trial);
+      return false;
+    }
+    valid += ok;
+  }
+  printf("CRC32 matches for lengths 0-600 at 8 alignments; decoders agree "
+         "on 20000 inputs (%d valid)\n",
+         valid);
+  return true;
+}
+
+static void bench_tables(int iterations) {
+  static uint8_t data[BENCH_DATA_LEN], out[BENCH_DATA_LEN + 8];
+  static char text[2 * (BENCH_DATA_LEN + BYTEWORDS_CRC_LEN) + 1];
+  size_t out_len;
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)rand();
+  size_t text_len = encode_minimal(data, sizeof(data), text);
+
+  double start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    sink += reference_crc32(data, sizeof(data));
+  double before = (now_ns() - start) / iterations;
+  start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    sink += bytewords_crc32(data, sizeof(data));
+  double after = (now_ns() - start) / iterations;
+  printf("CRC32, %d bytes:            %8.2f us -> %6.2f us\n", BENCH_DATA_LEN,
+         before / 1e3, after / 1e3);
+
+  start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    sink += reference_decode(text, text_len, out, &out_len);
+  before = (now_ns() - start) / iterations;
+  start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    sink += bytewords_decode_minimal(text, text_len, out, &out_len);
+  after = (now_ns() - start) / iterations;
+  printf("Decode %zu chars with CRC:  %8.2f us -> %6.2f us\n", text_len,
+         before / 1e3, after / 1e3);
+}
+
+// Part 1 of a 200-part UR, parsed once and then seen again
+static void bench_repeated_frame(int iterations) {
+  static uint8_t cbor[BENCH_DATA_LEN];
+  static char frame[64 + 2 * (BENCH_DATA_LEN + BYTEWORDS_CRC_LEN)];
+  const uint32_t seq_len = 200, fragment_len = 400;
+  size_t pos = 0;
+
+  // [1, 200, 80000, checksum, h'...'] with a 400-byte fragment
+  cbor[pos++] = 0x85;
+  cbor[pos++] = 0x01;
+  cbor[pos++] = 0x18;
+  cbor[pos++] = (uint8_t)seq_len;
+  cbor[pos++] = 0x1A;
+  for (int shift = 24; shift >= 0; shift -= 8)
+    cbor[pos++] = (uint8_t)((seq_len * fragment_len) >> shift);
+  cbor[pos++] = 0x1A;
+  for (int i = 0; i < 4; i++)
+    cbor[pos++] = (uint8_t)rand();
+  cbor[pos++] = 0x59;
+  cbor[pos++] = (uint8_t)(fragment_len >> 8);
+  cbor[pos++] = (uint8_t)fragment_len;
+  for (uint32_t i = 0; i < fragment_len; i++)
+    cbor[pos++] = (uint8_t)rand();
+
+  int len = snprintf(frame, sizeof(frame), "ur:crypto-psbt/1-%u/", seq_len);
+  encode_minimal(cbor, pos, frame + len);
+
+  QRPartParser *parser = qr_parser_create();
+  if (!parser || qr_parser_parse(parser, frame) < 0) {
+    fprintf(stderr, "Parser refused the benchmark frame\n");
+    qr_parser_destroy(parser);
+    return;
+  }
+  double start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    sink += qr_parser_parse(parser, frame);
+  double repeat = (now_ns() - start) / iterations;
+  printf("Repeated frame, %u-part UR: %8.2f us\n", seq_len, repeat / 1e3);
+  qr_parser_destroy(parser);
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+
+  if (iterations < 1)
+    return EXIT_FAILURE;
+  srand(50);
+  if (!check_vectors() || !check_against_reference())
+    return EXIT_FAILURE;
+  bench_tables(iterations);
+  bench_repeated_frame(iterations);
+  return EXIT_SUCCESS;
+}
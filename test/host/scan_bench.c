@@ -0,0 +1,146 @@
+/*
+ * Scan Pipeline Benchmark
+ * Runs the scanner service end to end on the virtual camera: capture,
+ * crop, the frame pool, the decode workers, the parser stage and
+ * completion, with the host shim standing in for FreeRTOS.
+ *
+ * Each session scans the animated sequence from wherever the camera is in
+ * its loop until the parser completes. The service logs its own counters
+ * (captured, dropped, processed, attempts) when the session ends; this
+ * prints the time to completion, the rate parts were accepted at, where the
+ * exposure control left the camera, and the CPU time the process used.
+ * VIRTUAL_SCREEN_BRIGHTNESS in the CMake cache sets how bright the synthetic
+ * screen is, to tune the exposure loop against.
+ *
+ * Usage: scan_bench_<N>w [sessions]
+ */
+
+#define _GNU_SOURCE
+#include "scanner_service.h"
+#include "video.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_SESSIONS 5
+#define SESSION_TIMEOUT_MS 60000
+#define POLL_INTERVAL_US 5000
+#define HOST_CORES 2
+#define VIRTUAL_CAMERA_FD 0 // the virtual camera has a single device
+
+static int64_t now_us(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int64_t cpu_us(void) {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Two cores, as on the ESP32-P4; tasks pinned to core 0 or 1 get one each
+static void restrict_to_two_cores(void) {
+  cpu_set_t cpus;
+
+  CPU_ZERO(&cpus);
+  for (int i = 0; i < HOST_CORES; i++)
+    CPU_SET(i, &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+    perror("sched_setaffinity");
+}
+
+// Exposure steps count from the start of the camera stream
+static void print_exposure(void) {
+  app_video_virtual_stats_t stats;
+  int32_t exposure;
+
+  if (app_video_virtual_get_stats(&stats) != ESP_OK ||
+      app_video_get_control(VIRTUAL_CAMERA_FD, V4L2_CID_EXPOSURE_ABSOLUTE,
+                            &exposure) != ESP_OK) {
+    printf("no exposure control\n");
+    return;
+  }
+  printf("exposure %ld after %lu step(s), the last at frame %lu of %lu\n",
+         (long)exposure, (unsigned long)stats.exposure_steps,
+         (unsigned long)stats.exposure_frame, (unsigned long)stats.frames);
+}
+
+static int compare_ms(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+  int sessions = argc > 1 ? atoi(argv[1]) : DEFAULT_SESSIONS;
+  int64_t *elapsed_ms;
+  int completed = 0;
+
+  if (sessions < 1 || !(elapsed_ms = calloc(sessions, sizeof(int64_t))))
+    return EXIT_FAILURE;
+
+  restrict_to_two_cores();
+  printf("%d decode worker(s), %d session(s)\n", CONFIG_SCANNER_DECODE_WORKERS,
+         sessions);
+
+  for (int i = 0; i < sessions; i++) {
+    scan_progress_event_t event;
+    int parts_accepted = 0;
+
+    int64_t start_us = now_us();
+    int64_t start_cpu_us = cpu_us();
+    if (!scanner_service_begin_session()) {
+      fprintf(stderr, "session %d did not start\n", i + 1);
+      return EXIT_FAILURE;
+    }
+
+    while (!scanner_service_is_complete() &&
+           now_us() - start_us < SESSION_TIMEOUT_MS * 1000LL) {
+      while (scanner_service_poll_progress(&event))
+        parts_accepted++;
+      usleep(POLL_INTERVAL_US);
+    }
+    while (scanner_service_poll_progress(&event))
+      parts_accepted++;
+
+    int64_t wall_us = now_us() - start_us;
+    int64_t used_cpu_us = cpu_us() - start_cpu_us;
+    bool complete = scanner_service_is_complete();
+    size_t result_len = 0;
+    if (complete) {
+      char *result =
+          qr_parser_result(scanner_service_get_parser(), &result_len);
+      free(result);
+    }
+
+    printf("session %d: %s in %lld ms, %d parts accepted, %zu bytes, "
+           "CPU %lld ms (%lld%% of one core)\n",
+           i + 1, complete ? "complete" : "TIMEOUT", (long long)wall_us / 1000,
+           parts_accepted, result_len, (long long)used_cpu_us / 1000,
+           (long long)(wall_us ? used_cpu_us * 100 / wall_us : 0));
+    printf("  %.1f parts/s, ", wall_us ? parts_accepted * 1e6 / wall_us : 0.0);
+    print_exposure();
+    scanner_service_end_session();
+    if (complete)
+      elapsed_ms[completed++] = wall_us / 1000;
+  }
+
+  if (completed) {
+    qsort(elapsed_ms, completed, sizeof(int64_t), compare_ms);
+    printf("median time to completion: %lld ms over %d session(s)\n",
+           (long long)elapsed_ms[completed / 2], completed);
+  }
+
+  scanner_service_shutdown();
+  free(elapsed_ms);
+  return completed == sessions ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,11 @@
+// Board support package, host shim: only the I2C bus handle the camera
+// takes
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+
+typedef struct i2c_master_bus_t *i2c_master_bus_handle_t;
+
+i2c_master_bus_handle_t bsp_i2c_get_handle(void);
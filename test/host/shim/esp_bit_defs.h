@@ -0,0 +1,5 @@
+// ESP-IDF bit helpers, host shim
+
+#pragma once
+
+#define BIT(nr) (1UL << (nr))
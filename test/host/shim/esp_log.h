@@ -0,0 +1,26 @@
+/*
+ * ESP-IDF logging, host shim
+ * Messages go to stderr. Debug and verbose messages are only printed when
+ * the ESP_LOG_DEBUG environment variable is set.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+
+int esp_log_debug_enabled(void);
+
+#define ESP_LOG_AT(letter, tag, format, ...)                                   \
+  fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_AT("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_AT("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_AT("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)                                             \
+  do {                                                                         \
+    if (esp_log_debug_enabled())                                               \
+      ESP_LOG_AT("D", tag, format, ##__VA_ARGS__);                             \
+  } while (0)
+#define ESP_LOGV(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
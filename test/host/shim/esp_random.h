@@ -0,0 +1,7 @@
+// ESP-IDF random numbers, host shim
+
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
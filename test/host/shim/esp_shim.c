@@ -0,0 +1,122 @@
+// ESP-IDF services, host shim
+
+#include "bsp/esp-bsp.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+  case ESP_OK:
+    return "ESP_OK";
+  case ESP_FAIL:
+    return "ESP_FAIL";
+  case ESP_ERR_NO_MEM:
+    return "ESP_ERR_NO_MEM";
+  case ESP_ERR_INVALID_ARG:
+    return "ESP_ERR_INVALID_ARG";
+  case ESP_ERR_INVALID_STATE:
+    return "ESP_ERR_INVALID_STATE";
+  case ESP_ERR_NOT_FOUND:
+    return "ESP_ERR_NOT_FOUND";
+  case ESP_ERR_NOT_SUPPORTED:
+    return "ESP_ERR_NOT_SUPPORTED";
+  case ESP_ERR_TIMEOUT:
+    return "ESP_ERR_TIMEOUT";
+  default:
+    return "UNKNOWN ERROR";
+  }
+}
+
+int esp_log_debug_enabled(void) { return getenv("ESP_LOG_DEBUG") != NULL; }
+
+int64_t esp_timer_get_time(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t esp_random(void) {
+  return (uint32_t)random() ^ (uint32_t)random() << 16;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+  (void)caps;
+  return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+  (void)caps;
+  return calloc(n, size);
+}
+
+void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+  (void)caps;
+  // aligned_alloc() wants a size that is a multiple of the alignment
+  size = (size + alignment - 1) / alignment * alignment;
+  return aligned_alloc(alignment, size);
+}
+
+void *heap_caps_aligned_calloc(size_t alignment, size_t n, size_t size,
+                               uint32_t caps) {
+  void *ptr = heap_caps_aligned_alloc(alignment, n * size, caps);
+  if (ptr)
+    memset(ptr, 0, n * size);
+  return ptr;
+}
+
+void heap_caps_free(void *ptr) { free(ptr); }
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  (void)caps;
+  return SIZE_MAX;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+  (void)type;
+  (void)subtype;
+  (void)label;
+  return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             size_t src_offset, void *dst, size_t size) {
+  return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                              size_t dst_offset, const void *src,
+                              size_t size) {
+  return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    size_t offset, size_t size) {
+  return ESP_ERR_NOT_FOUND;
+}
+
+i2c_master_bus_handle_t bsp_i2c_get_handle(void) {
+  // Never dereferenced: the virtual camera ignores the bus
+  static int bus;
+  return (i2c_master_bus_handle_t)&bus;
+}
@@ -0,0 +1,10 @@
+// ESP-IDF high resolution timer, host shim
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Microseconds on the monotonic clock
+ */
+int64_t esp_timer_get_time(void);
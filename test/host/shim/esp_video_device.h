@@ -0,0 +1,5 @@
+// esp_video device names, host shim
+
+#pragma once
+
+#define ESP_VIDEO_MIPI_CSI_DEVICE_NAME "/dev/video0"
@@ -0,0 +1,3 @@
+// esp_video initialisation, host shim: the virtual camera needs none
+
+#pragma once
@@ -0,0 +1,38 @@
+/*
+ * FreeRTOS, host shim
+ * The subset of the ESP-IDF FreeRTOS API the scan pipeline uses, on POSIX
+ * threads. A tick is a millisecond, as with CONFIG_FREERTOS_HZ=1000.
+ * Critical sections are mutexes, so they exclude other threads but do not
+ * stop preemption.
+ */
+
+#pragma once
+
+#include "esp_bit_defs.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define portNUM_PROCESSORS 2
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7fffffff
+
+typedef struct {
+  pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {PTHREAD_MUTEX_INITIALIZER}
+
+#define taskENTER_CRITICAL(mux) pthread_mutex_lock(&(mux)->mutex)
+#define taskEXIT_CRITICAL(mux) pthread_mutex_unlock(&(mux)->mutex)
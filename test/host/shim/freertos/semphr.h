@@ -0,0 +1,16 @@
+// FreeRTOS semaphores, host shim: counting semaphores on a mutex and a
+// condition variable. A mutex is a binary semaphore created given.
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct shim_semaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max,
+                                           UBaseType_t initial);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
@@ -0,0 +1,39 @@
+// FreeRTOS tasks, host shim: a task is a thread
+
+#pragma once
+
+#include "FreeRTOS.h"
+#include <sched.h>
+
+typedef struct shim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * @brief Start a thread running fn(arg)
+ *
+ * A core_id other than tskNO_AFFINITY pins the thread to that host CPU.
+ * Stack size and priority are ignored.
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack_size, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core_id);
+
+#define xTaskCreate(fn, name, stack_size, arg, priority, handle)               \
+  xTaskCreatePinnedToCore(fn, name, stack_size, arg, priority, handle,         \
+                          tskNO_AFFINITY)
+
+/**
+ * @brief End a task: the calling one if task is NULL, otherwise cancel it
+ * at its next wait
+ */
+void vTaskDelete(TaskHandle_t task);
+
+/**
+ * @brief Park the calling task for good (task must be NULL)
+ */
+void vTaskSuspend(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+#define taskYIELD() sched_yield()
@@ -0,0 +1,341 @@
+// FreeRTOS on POSIX threads, host shim
+
+#define _GNU_SOURCE
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct shim_task {
+  pthread_t thread;
+  TaskFunction_t fn;
+  void *arg;
+};
+
+struct shim_semaphore {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  UBaseType_t count;
+  UBaseType_t max;
+};
+
+struct shim_event_group {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  EventBits_t bits;
+};
+
+struct shim_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  uint8_t *items;
+  UBaseType_t length;
+  UBaseType_t item_size;
+  UBaseType_t head;
+  UBaseType_t count;
+};
+
+static void init_wait(pthread_mutex_t *lock, pthread_cond_t *changed) {
+  pthread_condattr_t attr;
+
+  pthread_mutex_init(lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(changed, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+static struct timespec deadline_after(TickType_t ticks) {
+  struct timespec deadline;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += ticks / 1000;
+  deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  return deadline;
+}
+
+static void unlock(void *lock) { pthread_mutex_unlock(lock); }
+
+// Waits on changed until ready() holds or the ticks run out, with lock held
+// on entry and exit. A cancelled task releases lock on the way out.
+static bool wait_until(pthread_mutex_t *lock, pthread_cond_t *changed,
+                       TickType_t ticks, bool (*ready)(void *), void *ctx) {
+  struct timespec deadline = deadline_after(ticks);
+  bool ok = true;
+
+  pthread_cleanup_push(unlock, lock);
+  while (!ready(ctx)) {
+    if (ticks == 0) {
+      ok = false;
+      break;
+    }
+    if (ticks == portMAX_DELAY) {
+      pthread_cond_wait(changed, lock);
+    } else if (pthread_cond_timedwait(changed, lock, &deadline) ==
+               ETIMEDOUT) {
+      ok = ready(ctx);
+      break;
+    }
+  }
+  pthread_cleanup_pop(0);
+  return ok;
+}
+
+/* ------------------------------ Tasks ------------------------------ */
+
+static void *task_entry(void *arg) {
+  struct shim_task *task = arg;
+
+  task->fn(task->arg);
+  return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack_size, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core_id) {
+  struct shim_task *task = calloc(1, sizeof(*task));
+  if (!task)
+    return pdFAIL;
+  task->fn = fn;
+  task->arg = arg;
+
+  if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+    free(task);
+    return pdFAIL;
+  }
+  pthread_detach(task->thread);
+  pthread_setname_np(task->thread, name);
+
+  if (core_id != tskNO_AFFINITY) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core_id, &cpus);
+    pthread_setaffinity_np(task->thread, sizeof(cpus), &cpus);
+  }
+
+  if (handle)
+    *handle = task;
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (!task) {
+    pthread_exit(NULL);
+    return;
+  }
+  pthread_cancel(task->thread);
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+  (void)task;
+  while (true)
+    pause();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  struct timespec delay = {ticks / 1000, (long)(ticks % 1000) * 1000000};
+
+  nanosleep(&delay, NULL);
+}
+
+/* ---------------------------- Semaphores ---------------------------- */
+
+static SemaphoreHandle_t create_semaphore(UBaseType_t max,
+                                          UBaseType_t initial) {
+  struct shim_semaphore *sem = calloc(1, sizeof(*sem));
+  if (!sem)
+    return NULL;
+
+  init_wait(&sem->lock, &sem->changed);
+  sem->count = initial;
+  sem->max = max;
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+  return create_semaphore(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  return create_semaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max,
+                                           UBaseType_t initial) {
+  return create_semaphore(max, initial);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+  pthread_mutex_destroy(&sem->lock);
+  pthread_cond_destroy(&sem->changed);
+  free(sem);
+}
+
+static bool semaphore_available(void *ctx) {
+  return ((struct shim_semaphore *)ctx)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  pthread_mutex_lock(&sem->lock);
+  bool ok = wait_until(&sem->lock, &sem->changed, ticks, semaphore_available,
+                       sem);
+  if (ok)
+    sem->count--;
+  pthread_mutex_unlock(&sem->lock);
+  return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  BaseType_t result = pdFALSE;
+
+  pthread_mutex_lock(&sem->lock);
+  if (sem->count < sem->max) {
+    sem->count++;
+    pthread_cond_broadcast(&sem->changed);
+    result = pdTRUE;
+  }
+  pthread_mutex_unlock(&sem->lock);
+  return result;
+}
+
+/* --------------------------- Event groups --------------------------- */
+
+typedef struct {
+  struct shim_event_group *group;
+  EventBits_t bits;
+  bool all;
+} bits_wait_t;
+
+EventGroupHandle_t xEventGroupCreate(void) {
+  struct shim_event_group *group = calloc(1, sizeof(*group));
+  if (!group)
+    return NULL;
+
+  init_wait(&group->lock, &group->changed);
+  return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+  pthread_mutex_destroy(&group->lock);
+  pthread_cond_destroy(&group->changed);
+  free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+  pthread_mutex_lock(&group->lock);
+  group->bits |= bits;
+  EventBits_t result = group->bits;
+  pthread_cond_broadcast(&group->changed);
+  pthread_mutex_unlock(&group->lock);
+  return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+  pthread_mutex_lock(&group->lock);
+  EventBits_t result = group->bits;
+  group->bits &= ~bits;
+  pthread_mutex_unlock(&group->lock);
+  return result;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+  pthread_mutex_lock(&group->lock);
+  EventBits_t result = group->bits;
+  pthread_mutex_unlock(&group->lock);
+  return result;
+}
+
+static bool bits_set(void *ctx) {
+  bits_wait_t *wait = ctx;
+  EventBits_t set = wait->group->bits & wait->bits;
+
+  return wait->all ? set == wait->bits : set != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+  bits_wait_t wait = {group, bits, wait_for_all};
+
+  pthread_mutex_lock(&group->lock);
+  bool ok = wait_until(&group->lock, &group->changed, ticks, bits_set, &wait);
+  EventBits_t result = group->bits;
+  if (ok && clear_on_exit)
+    group->bits &= ~bits;
+  pthread_mutex_unlock(&group->lock);
+  return result;
+}
+
+/* ------------------------------ Queues ------------------------------ */
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  struct shim_queue *queue = calloc(1, sizeof(*queue));
+  if (!queue)
+    return NULL;
+
+  queue->items = calloc(length, item_size);
+  if (!queue->items) {
+    free(queue);
+    return NULL;
+  }
+  init_wait(&queue->lock, &queue->changed);
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->changed);
+  free(queue->items);
+  free(queue);
+}
+
+static bool queue_has_room(void *ctx) {
+  struct shim_queue *queue = ctx;
+  return queue->count < queue->length;
+}
+
+static bool queue_has_item(void *ctx) {
+  return ((struct shim_queue *)ctx)->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item,
+                      TickType_t ticks) {
+  pthread_mutex_lock(&queue->lock);
+  bool ok =
+      wait_until(&queue->lock, &queue->changed, ticks, queue_has_room, queue);
+  if (ok) {
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+  pthread_mutex_lock(&queue->lock);
+  bool ok =
+      wait_until(&queue->lock, &queue->changed, ticks, queue_has_item, queue);
+  if (ok) {
+    memcpy(item, queue->items + queue->head * queue->item_size,
+           queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return ok ? pdTRUE : pdFALSE;
+}
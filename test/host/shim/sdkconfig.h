@@ -0,0 +1,43 @@
+/*
+ * Host build configuration
+ * The Kconfig options the host build compiles in. Each can be overridden
+ * with a -D from the host CMakeLists.txt.
+ */
+
+#pragma once
+
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_BSP_LCD_COLOR_FORMAT_RGB565 1
+
+// QR Scanner
+#ifndef CONFIG_SCANNER_DECODE_WORKERS
+#define CONFIG_SCANNER_DECODE_WORKERS 2
+#endif
+#ifndef CONFIG_SCANNER_CAPTURE_GREY
+#define CONFIG_SCANNER_CAPTURE_RGB565 1
+#endif
+#define CONFIG_SCANNER_IDLE_STANDBY 1
+#define CONFIG_SCANNER_AUTO_EXPOSURE 1
+
+// Video
+#define CONFIG_APP_VIDEO_VIRTUAL_CAMERA 1
+#ifndef CONFIG_APP_VIDEO_VIRTUAL_SOURCE_FILE
+#define CONFIG_APP_VIDEO_VIRTUAL_SOURCE_SYNTHETIC 1
+#endif
+#ifndef CONFIG_APP_VIDEO_VIRTUAL_FRAME_FILE
+#define CONFIG_APP_VIDEO_VIRTUAL_FRAME_FILE "frames.raw"
+#endif
+#define CONFIG_APP_VIDEO_VIRTUAL_WIDTH 800
+#define CONFIG_APP_VIDEO_VIRTUAL_HEIGHT 640
+#ifndef CONFIG_APP_VIDEO_VIRTUAL_FPS
+#define CONFIG_APP_VIDEO_VIRTUAL_FPS 30
+#endif
+#define CONFIG_APP_VIDEO_VIRTUAL_JITTER_MS 5
+#ifndef CONFIG_APP_VIDEO_VIRTUAL_QR_PARTS
+#define CONFIG_APP_VIDEO_VIRTUAL_QR_PARTS 30
+#endif
+#define CONFIG_APP_VIDEO_VIRTUAL_QR_PART_CHARS 300
+#ifndef CONFIG_APP_VIDEO_VIRTUAL_SCREEN_BRIGHTNESS
+#define CONFIG_APP_VIDEO_VIRTUAL_SCREEN_BRIGHTNESS 400
+#endif
+#define CONFIG_APP_VIDEO_VIRTUAL_FRAMES_PER_PART 3
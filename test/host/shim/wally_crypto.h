@@ -0,0 +1,12 @@
+// libwally crypto, host shim: SHA-256 only
+
+#pragma once
+
+#include <stddef.h>
+
+#define WALLY_OK 0
+#define WALLY_EINVAL -2
+#define SHA256_LEN 32
+
+int wally_sha256(const unsigned char *bytes, size_t bytes_len,
+                 unsigned char *bytes_out, size_t len);
@@ -0,0 +1,259 @@
+/*
+ * BBQr Codec Tests
+ * base32_decode(), hex_decode() and inflate_raw() against reference
+ * vectors: the RFC 4648 base32 samples, and BBQr part bodies in each of
+ * its encodings, with the "Z" bodies made by Python's zlib the way the
+ * BBQr reference encoder makes them:
+ *
+ *   c = zlib.compressobj(level, zlib.DEFLATED, -10, 8, strategy)
+ *   body = base64.b32encode(c.compress(data) + c.flush()).rstrip(b"=")
+ *
+ * The streams cover stored, fixed and dynamic Huffman blocks, and a full
+ * flush that splits the data across blocks.
+ */
+
+#include "base_codecs.h"
+#include "deflate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PLAIN 2048
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: %s failed (%s)\n", __FILE__, __LINE__, #cond,   \
+              current);                                                        \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+typedef struct {
+  const char *plain;
+  const char *base32;
+} base32_vector_t;
+
+typedef struct {
+  const char *name;
+  const char *body; // "Z" part body
+  const char *unit; // hex of the data, repeated...
+  int repeats;      // ...this many times
+} zlib_vector_t;
+
+static int failures = 0;
+static const char *current = "";
+
+// RFC 4648 section 10, without the padding BBQr leaves out
+static const base32_vector_t rfc4648_vectors[] = {
+    {"", ""},           {"f", "MY"},         {"fo", "MZXQ"},
+    {"foo", "MZXW6"},   {"foob", "MZXW6YQ"}, {"fooba", "MZXW6YTB"},
+    {"foobar", "MZXW6YTBOI"},
+};
+
+static const zlib_vector_t zlib_vectors[] = {
+    {"stored",
+     "AFWABE77IJBFC4RAONYGY2LUOMQGCIDGNFWGKIDBMNZG643TEBIVEIDDN5SGK4ZOEBBEEULS"
+     "EBZXA3DJORZSAYJAMZUWYZJAMFRXE33TOMQFCURAMNXWIZLTFYQEEQSROIQHG4DMNF2HGIDB"
+     "EBTGS3DFEBQWG4TPONZSAUKSEBRW6ZDFOMXCA",
+     "424251722073706c69747320612066696c65206163726f737320515220636f6465732e20",
+     3},
+    {"fixed",
+     "ONZAULCSFAXMRSJMFFLEQVCIZPGESVKIJQXMULZOKYEAYUSIZZHUSLOWKNYBVQLKAA",
+     "424251722073706c69747320612066696c65206163726f737320515220636f6465732e20",
+     8},
+    {"dynamic",
+     "5WGUWCWAGAEALL6SVMMSGVAICGRBM6X3NJZIF3W5XRI7YDBUTBO6MBMNA7NRWHAUEFXJST6W"
+     "JIZRXFOVCK3AA57PVMDVYYYHSFKBHXHXGKRPRYIZ35GPSKWGCHRGVDDRLLTDFF5ZZRS74376"
+     "AA",
+     "6162616e646f6e206162696c6974792061626c652061626f75742061626f766520616273"
+     "656e74206162736f72622061627374726163742061627375726420616275736520616363"
+     "657373206163636964656e74206163636f756e7420616363757365206163686965766520"
+     "616369642061636f757374696320",
+     12},
+    {"flushed",
+     "OJZAULCSFAXMRSJMFFLEQVCIZPGESVKIJQXMULZOKYEAYUSIZZHUSLOWKNYKFIY2AAAAAAH7"
+     "75ZXECRMKIUC5SGJFQUVMSCUJDF4YSKVJBGC5SRPFZLAQDCSJDHE6SJN2ZJXBIVDDIAA",
+     "424251722073706c69747320612066696c65206163726f737320515220636f6465732e20",
+     8},
+    {"sparse binary",
+     "FMUE4KXZZ7ABRRGEAAC77QJEEOBRSA7DP4QOP74D75AGSBTTIYOUNCBMG5EJEAKOGBPLVQHY"
+     "T7YT4SBREMRQGVYDYQIBKRTBA2QD5BQJ74M4CKQZDHWIDITCMAPFQIODL6IGDX42IGTPYBYA",
+     "70736274ff000152020000000000000000ff00000000000100360001ff00ff00ffe0ffff"
+     "00010037012c0100000000ff000b000001000000000100000000010001d2d001ff01df00"
+     "01ff000101000a8000000000000024011300ffff000090ff01000001000001003f000000"
+     "16ff01000001ff0001010000fd000000fff68301000000ff",
+     1},
+    {"incompressible",
+     "AHEAAN77COJET3F5GHUP6CO5X3PMSWQ5GY74ATRRKL6UDRULLXACAGI7L4PVJF4ME42B6MHK"
+     "VGU6AVKAFGRRTCN4L4SDVGH5XHPBL4WUFK3UCLCOTU35TYQTJMATMP2ABCWDZ74E5GXMKLAR"
+     "F5U46Y6OQXI2PS5RDJPVWYA2O6MXDMDAN3CMO4Y75IPTCDIMHGYIM4CC4XEE67YDG5YD7VDG"
+     "YDMTMB27YA52RIEFIRGXYZTZCYXIT5MLEX3K2SFDOICWV42MSLRZT5XDTX45XXRENVHAYNZN"
+     "OZQGKHUDK34OZVUYECX6VYUI75DTVJFXVK5DHRXF",
+     "139249ecbd31e8ff09ddbedec95a1d363fc04e3152fd41c68b5dc020191f5f1f54978c27"
+     "341f30eaa9a9e0554029a31989bc5f243a98fdb9de15f2d42ab7412c4e9d37d9e2134b01"
+     "363f4008ac3cff84e9aec52c112f69cf63ce85d1a7cbb11a5f5b601a779971b0606ec4c7"
+     "731fea1f310d0c39b0867042e5c84f7f0337703fd466c0d936075fc03ba8a085444d7c66"
+     "79162e89f58b25f6ad48a372056af34c92e399f6e39df9dbde246d4e0c372d7660651e83"
+     "56f8ecd69820afeae288ff473aa4b7aaba33c6e5",
+     1},
+    {"empty",
+     "AMAA",
+     "",
+     0},
+};
+
+// The "sparse binary" data as a "2" (base32) and an "H" (hex) body
+static const char sparse_base32[] =
+    "OBZWE5H7AAAVEAQAAAAAAAAAAAAP6AAAAAAAAAIAGYAAD7YA74AP7YH774AACABXAEWACAAAA"
+    "AAP6AALAAAACAAAAAAACAAAAAAACAAB2LIAD7YB34AAD7YAAEAQACUAAAAAAAAAAASACEYA77"
+    "7QAAEQ74AQAAABAAAACAB7AAAAAFX7AEAAAAP7AAAQCAAA7UAAAAH762BQCAAAAD7Q";
+static const char sparse_hex[] =
+    "70736274FF000152020000000000000000FF00000000000100360001FF00FF00FFE0FFFF0"
+    "0010037012C0100000000FF000B000001000000000100000000010001D2D001FF01DF0001"
+    "FF000101000A8000000000000024011300FFFF000090FF01000001000001003F00000016F"
+    "F01000001FF0001010000FD000000FFF68301000000FF";
+
+// Expands a vector's repeated unit into the data it stands for
+static size_t expected_data(const zlib_vector_t *v, uint8_t *out) {
+  uint8_t unit[MAX_PLAIN];
+  size_t unit_len = 0;
+
+  if (!hex_decode(v->unit, strlen(v->unit), unit, &unit_len))
+    return 0;
+  for (int i = 0; i < v->repeats; i++)
+    memcpy(out + i * unit_len, unit, unit_len);
+  return unit_len * v->repeats;
+}
+
+static void test_base32(void) {
+  uint8_t out[16];
+  size_t out_len;
+
+  for (size_t i = 0; i < sizeof(rfc4648_vectors) / sizeof(*rfc4648_vectors);
+       i++) {
+    const base32_vector_t *v = &rfc4648_vectors[i];
+    current = v->base32;
+    CHECK(base32_decode(v->base32, strlen(v->base32), out, &out_len));
+    CHECK(out_len == strlen(v->plain) && !memcmp(out, v->plain, out_len));
+  }
+
+  // Final groups of 1, 3 or 6 characters cannot end on a byte
+  current = "bad length";
+  CHECK(!base32_decode("MZXW6YTBO", 9, out, &out_len));
+  CHECK(!base32_decode("MZX", 3, out, &out_len));
+  CHECK(!base32_decode("MZXW6Y", 6, out, &out_len));
+
+  current = "bad character";
+  CHECK(!base32_decode("mzxw6", 5, out, &out_len));
+  CHECK(!base32_decode("MZXW1", 5, out, &out_len));
+  CHECK(!base32_decode("MZXW8", 5, out, &out_len));
+  CHECK(!base32_decode("MZXQ====", 8, out, &out_len));
+
+  current = "in place";
+  char text[] = "MZXW6YTBOI";
+  CHECK(base32_decode(text, strlen(text), (uint8_t *)text, &out_len));
+  CHECK(out_len == 6 && !memcmp(text, "foobar", 6));
+}
+
+static void test_hex(void) {
+  uint8_t out[8];
+  size_t out_len;
+
+  current = "hex";
+  CHECK(hex_decode("", 0, out, &out_len) && out_len == 0);
+  CHECK(hex_decode("00ff7F80", 8, out, &out_len) && out_len == 4);
+  CHECK(!memcmp(out, "\x00\xff\x7f\x80", 4));
+  CHECK(hex_decode("DEADbeef", 8, out, &out_len) && out_len == 4);
+  CHECK(!memcmp(out, "\xde\xad\xbe\xef", 4));
+
+  current = "bad hex";
+  CHECK(!hex_decode("abc", 3, out, &out_len));
+  CHECK(!hex_decode("0g", 2, out, &out_len));
+  CHECK(!hex_decode("0 ", 2, out, &out_len));
+}
+
+static void test_inflate(void) {
+  static uint8_t expected[MAX_PLAIN];
+  static uint8_t compressed[MAX_PLAIN];
+
+  for (size_t i = 0; i < sizeof(zlib_vectors) / sizeof(*zlib_vectors); i++) {
+    const zlib_vector_t *v = &zlib_vectors[i];
+    size_t expected_len = expected_data(v, expected);
+    size_t compressed_len, out_len;
+    uint8_t *out = NULL;
+
+    current = v->name;
+    CHECK(base32_decode(v->body, strlen(v->body), compressed,
+                        &compressed_len));
+    CHECK(inflate_raw(compressed, compressed_len, MAX_PLAIN, &out, &out_len));
+    CHECK(out && out_len == expected_len &&
+          !memcmp(out, expected, expected_len) && out[out_len] == '\0');
+    free(out);
+
+    // The output limit guards against expansion bombs
+    out = NULL;
+    if (expected_len > 0) {
+      CHECK(!inflate_raw(compressed, compressed_len, expected_len - 1, &out,
+                         &out_len));
+      free(out);
+    }
+
+    // A stream cut short is rejected, not padded with zeros
+    out = NULL;
+    CHECK(!inflate_raw(compressed, compressed_len - 1, MAX_PLAIN, &out,
+                       &out_len));
+    free(out);
+  }
+
+  // Block type 3 is reserved
+  static const uint8_t reserved[] = {0x07, 0x00};
+  uint8_t *out = NULL;
+  size_t out_len;
+  current = "reserved block type";
+  CHECK(!inflate_raw(reserved, sizeof(reserved), MAX_PLAIN, &out, &out_len));
+  free(out);
+}
+
+// One payload decodes to the same data from each BBQr encoding
+static void test_encodings(void) {
+  static uint8_t expected[MAX_PLAIN];
+  static uint8_t decoded[MAX_PLAIN];
+  const zlib_vector_t *sparse = NULL;
+  size_t decoded_len;
+
+  for (size_t i = 0; i < sizeof(zlib_vectors) / sizeof(*zlib_vectors); i++) {
+    if (!strcmp(zlib_vectors[i].name, "sparse binary"))
+      sparse = &zlib_vectors[i];
+  }
+  current = "sparse binary";
+  CHECK(sparse);
+  if (!sparse)
+    return;
+  size_t expected_len = expected_data(sparse, expected);
+
+  current = "2 encoding";
+  CHECK(base32_decode(sparse_base32, strlen(sparse_base32), decoded,
+                      &decoded_len));
+  CHECK(decoded_len == expected_len &&
+        !memcmp(decoded, expected, expected_len));
+
+  current = "H encoding";
+  CHECK(hex_decode(sparse_hex, strlen(sparse_hex), decoded, &decoded_len));
+  CHECK(decoded_len == expected_len &&
+        !memcmp(decoded, expected, expected_len));
+}
+
+int main(void) {
+  test_base32();
+  test_hex();
+  test_inflate();
+  test_encodings();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("BBQr codecs: all checks passed\n");
+  return EXIT_SUCCESS;
+}
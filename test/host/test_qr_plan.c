@@ -0,0 +1,202 @@
+/*
+ * QR Plan Tests
+ * qr_capacity() and qr_plan_parts() for QR versions 1 to 20.
+ *
+ * The capacities are the largest inputs the Python qrcode encoder fits in
+ * each version, mode and ECC level; they match the character capacity
+ * table of ISO/IEC 18004. The plans come from a separate model that tries
+ * 1, 2, 3... parts, builds the longest frame of each split with its real
+ * prefix ("p<M>of<N> ", "B$ZP<NN><MM>", the UR header and CRC) and checks
+ * it against those capacities.
+ */
+
+#include "qr_codes.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ENCODINGS 3 // numeric, alphanumeric, byte
+#define ECC_LEVELS 4
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: %s failed (version %d)\n", __FILE__, __LINE__, \
+              #cond, version);                                                 \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+typedef struct {
+  int max_version;
+  int format;
+  int ecc;
+  int data_len;
+  int num_parts; // 0 if the payload cannot be split at max_version
+  int part_size;
+  int version;
+} plan_vector_t;
+
+static int failures = 0;
+
+// Characters per version (1-20): numeric, alphanumeric, byte by L, M, Q, H
+static const int capacities[QR_CAPACITY_SIZE][ENCODINGS][ECC_LEVELS] = {
+    {{41, 34, 27, 17}, {25, 20, 16, 10}, {17, 14, 11, 7}},
+    {{77, 63, 48, 34}, {47, 38, 29, 20}, {32, 26, 20, 14}},
+    {{127, 101, 77, 58}, {77, 61, 47, 35}, {53, 42, 32, 24}},
+    {{187, 149, 111, 82}, {114, 90, 67, 50}, {78, 62, 46, 34}},
+    {{255, 202, 144, 106}, {154, 122, 87, 64}, {106, 84, 60, 44}},
+    {{322, 255, 178, 139}, {195, 154, 108, 84}, {134, 106, 74, 58}},
+    {{370, 293, 207, 154}, {224, 178, 125, 93}, {154, 122, 86, 64}},
+    {{461, 365, 259, 202}, {279, 221, 157, 122}, {192, 152, 108, 84}},
+    {{552, 432, 312, 235}, {335, 262, 189, 143}, {230, 180, 130, 98}},
+    {{652, 513, 364, 288}, {395, 311, 221, 174}, {271, 213, 151, 119}},
+    {{772, 604, 427, 331}, {468, 366, 259, 200}, {321, 251, 177, 137}},
+    {{883, 691, 489, 374}, {535, 419, 296, 227}, {367, 287, 203, 155}},
+    {{1022, 796, 580, 427}, {619, 483, 352, 259}, {425, 331, 241, 177}},
+    {{1101, 871, 621, 468}, {667, 528, 376, 283}, {458, 362, 258, 194}},
+    {{1250, 991, 703, 530}, {758, 600, 426, 321}, {520, 412, 292, 220}},
+    {{1408, 1082, 775, 602}, {854, 656, 470, 365}, {586, 450, 322, 250}},
+    {{1548, 1212, 876, 674}, {938, 734, 531, 408}, {644, 504, 364, 280}},
+    {{1725, 1346, 948, 746}, {1046, 816, 574, 452}, {718, 560, 394, 310}},
+    {{1903, 1500, 1063, 813}, {1153, 909, 644, 493}, {792, 624, 442, 338}},
+    {{2061, 1600, 1159, 919}, {1249, 970, 702, 557}, {858, 666, 482, 382}},
+};
+
+// Payload lengths of a few frames' worth at each version, in the units
+// qr_plan_parts() counts
+static const plan_vector_t plan_vectors[] = {
+    {1, FORMAT_PMOFN, QR_ECC_LOW, 86, 11, 8, 1},
+    {1, FORMAT_UR, QR_ECC_LOW, 69, 0, 0, 0},
+    {1, FORMAT_BBQR, QR_ECC_LOW, 76, 5, 16, 1},
+    {2, FORMAT_PMOFN, QR_ECC_MEDIUM, 132, 7, 20, 2},
+    {2, FORMAT_UR, QR_ECC_MEDIUM, 106, 0, 0, 0},
+    {2, FORMAT_BBQR, QR_ECC_MEDIUM, 116, 5, 24, 2},
+    {3, FORMAT_PMOFN, QR_ECC_QUARTILE, 163, 7, 24, 3},
+    {3, FORMAT_UR, QR_ECC_QUARTILE, 131, 0, 0, 0},
+    {3, FORMAT_BBQR, QR_ECC_QUARTILE, 144, 5, 32, 3},
+    {4, FORMAT_PMOFN, QR_ECC_HIGH, 174, 7, 28, 4},
+    {4, FORMAT_UR, QR_ECC_HIGH, 140, 0, 0, 0},
+    {4, FORMAT_BBQR, QR_ECC_HIGH, 154, 4, 40, 4},
+    {5, FORMAT_PMOFN, QR_ECC_LOW, 535, 6, 92, 5},
+    {5, FORMAT_UR, QR_ECC_LOW, 429, 18, 24, 5},
+    {5, FORMAT_BBQR, QR_ECC_LOW, 467, 4, 120, 5},
+    {6, FORMAT_PMOFN, QR_ECC_MEDIUM, 536, 6, 92, 6},
+    {6, FORMAT_UR, QR_ECC_MEDIUM, 430, 18, 24, 6},
+    {6, FORMAT_BBQR, QR_ECC_MEDIUM, 468, 4, 120, 6},
+    {7, FORMAT_PMOFN, QR_ECC_QUARTILE, 437, 6, 76, 7},
+    {7, FORMAT_UR, QR_ECC_QUARTILE, 351, 26, 14, 7},
+    {7, FORMAT_BBQR, QR_ECC_QUARTILE, 382, 4, 96, 6},
+    {8, FORMAT_PMOFN, QR_ECC_HIGH, 428, 6, 72, 8},
+    {8, FORMAT_UR, QR_ECC_HIGH, 344, 27, 13, 8},
+    {8, FORMAT_BBQR, QR_ECC_HIGH, 374, 4, 96, 8},
+    {9, FORMAT_PMOFN, QR_ECC_LOW, 1159, 6, 196, 9},
+    {9, FORMAT_UR, QR_ECC_LOW, 929, 11, 85, 9},
+    {9, FORMAT_BBQR, QR_ECC_LOW, 1014, 4, 256, 8},
+    {10, FORMAT_PMOFN, QR_ECC_MEDIUM, 1075, 6, 180, 10},
+    {10, FORMAT_UR, QR_ECC_MEDIUM, 862, 12, 72, 10},
+    {10, FORMAT_BBQR, QR_ECC_MEDIUM, 943, 4, 240, 9},
+    {11, FORMAT_PMOFN, QR_ECC_QUARTILE, 896, 6, 152, 11},
+    {11, FORMAT_UR, QR_ECC_QUARTILE, 719, 13, 56, 11},
+    {11, FORMAT_BBQR, QR_ECC_QUARTILE, 788, 4, 200, 10},
+    {12, FORMAT_PMOFN, QR_ECC_HIGH, 787, 6, 132, 12},
+    {12, FORMAT_UR, QR_ECC_HIGH, 632, 14, 46, 12},
+    {12, FORMAT_BBQR, QR_ECC_HIGH, 693, 4, 176, 11},
+    {13, FORMAT_PMOFN, QR_ECC_LOW, 2138, 6, 360, 12},
+    {13, FORMAT_UR, QR_ECC_LOW, 1713, 10, 172, 13},
+    {13, FORMAT_BBQR, QR_ECC_LOW, 1870, 4, 472, 12},
+    {14, FORMAT_PMOFN, QR_ECC_MEDIUM, 1824, 6, 304, 13},
+    {14, FORMAT_UR, QR_ECC_MEDIUM, 1462, 10, 147, 14},
+    {14, FORMAT_BBQR, QR_ECC_MEDIUM, 1598, 4, 400, 12},
+    {15, FORMAT_PMOFN, QR_ECC_QUARTILE, 1475, 6, 248, 14},
+    {15, FORMAT_UR, QR_ECC_QUARTILE, 1183, 11, 108, 15},
+    {15, FORMAT_BBQR, QR_ECC_QUARTILE, 1293, 4, 328, 13},
+    {16, FORMAT_PMOFN, QR_ECC_HIGH, 1266, 6, 212, 15},
+    {16, FORMAT_UR, QR_ECC_HIGH, 1016, 11, 93, 16},
+    {16, FORMAT_BBQR, QR_ECC_HIGH, 1111, 4, 280, 15},
+    {17, FORMAT_PMOFN, QR_ECC_LOW, 3237, 6, 540, 16},
+    {17, FORMAT_UR, QR_ECC_LOW, 2593, 9, 289, 17},
+    {17, FORMAT_BBQR, QR_ECC_LOW, 2831, 4, 712, 15},
+    {18, FORMAT_PMOFN, QR_ECC_MEDIUM, 2818, 6, 472, 17},
+    {18, FORMAT_UR, QR_ECC_MEDIUM, 2258, 9, 251, 18},
+    {18, FORMAT_BBQR, QR_ECC_MEDIUM, 2466, 4, 624, 16},
+    {19, FORMAT_PMOFN, QR_ECC_QUARTILE, 2229, 6, 372, 18},
+    {19, FORMAT_UR, QR_ECC_QUARTILE, 1787, 10, 179, 19},
+    {19, FORMAT_BBQR, QR_ECC_QUARTILE, 1951, 4, 488, 17},
+    {20, FORMAT_PMOFN, QR_ECC_HIGH, 1930, 6, 324, 19},
+    {20, FORMAT_UR, QR_ECC_HIGH, 1548, 10, 155, 20},
+    {20, FORMAT_BBQR, QR_ECC_HIGH, 1691, 4, 424, 18},
+};
+
+// Frames are encoded as the QR viewer encodes them
+static int format_encoding(int format) {
+  return format == FORMAT_BBQR ? QR_ENCODING_ALPHANUMERIC : QR_ENCODING_BYTE;
+}
+
+static void test_capacity(void) {
+  int version;
+
+  for (version = 1; version <= QR_CAPACITY_SIZE; version++) {
+    for (int encoding = 0; encoding < ENCODINGS; encoding++) {
+      for (int ecc = 0; ecc < ECC_LEVELS; ecc++)
+        CHECK(qr_capacity(version, encoding, ecc) ==
+              capacities[version - 1][encoding][ecc]);
+    }
+  }
+
+  version = 0;
+  CHECK(qr_capacity(0, QR_ENCODING_BYTE, QR_ECC_LOW) == 0);
+  version = QR_CAPACITY_SIZE + 1;
+  CHECK(qr_capacity(version, QR_ENCODING_BYTE, QR_ECC_LOW) == 0);
+  version = 1;
+  CHECK(qr_capacity(1, QR_ENCODING_BYTE, QR_ECC_HIGH + 1) == 0);
+}
+
+// A single code holds exactly the capacity, in the smallest version that
+// does
+static void test_single_part(void) {
+  for (int version = 1; version <= QR_CAPACITY_SIZE; version++) {
+    for (int ecc = 0; ecc < ECC_LEVELS; ecc++) {
+      int capacity = capacities[version - 1][QR_ENCODING_BYTE][ecc];
+      QRPartPlan plan;
+
+      CHECK(qr_plan_parts(capacity, FORMAT_NONE, QR_ENCODING_BYTE, ecc,
+                          QR_CAPACITY_SIZE, &plan));
+      CHECK(plan.num_parts == 1 && plan.part_size == capacity &&
+            plan.version == version);
+      CHECK(!qr_plan_parts(capacity + 1, FORMAT_NONE, QR_ENCODING_BYTE, ecc,
+                           version, &plan));
+    }
+  }
+}
+
+static void test_plans(void) {
+  for (size_t i = 0; i < sizeof(plan_vectors) / sizeof(*plan_vectors); i++) {
+    const plan_vector_t *v = &plan_vectors[i];
+    int version = v->max_version;
+    QRPartPlan plan;
+
+    bool ok = qr_plan_parts(v->data_len, v->format, format_encoding(v->format),
+                            v->ecc, v->max_version, &plan);
+    if (v->num_parts == 0) {
+      CHECK(!ok);
+      continue;
+    }
+    CHECK(ok);
+    CHECK(plan.num_parts == v->num_parts);
+    CHECK(plan.part_size == v->part_size);
+    CHECK(plan.version == v->version);
+  }
+}
+
+int main(void) {
+  test_capacity();
+  test_single_part();
+  test_plans();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("QR plans: all checks passed\n");
+  return EXIT_SUCCESS;
+}
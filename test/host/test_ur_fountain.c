@@ -0,0 +1,416 @@
+/*
+ * UR Fountain Tests
+ * Decodes fountain-coded sequences made by an encoder written here from
+ * BCR-2020-005, independent of the decoder's own fragment chooser. The
+ * encoder is first checked against the reference implementation's test
+ * vectors (Xoshiro256** seeded with "Wolf", degrees, fragment sets).
+ *
+ * The simulations then cover sequence lengths up to the 1024 the decoder
+ * accepts. A scanner joining an animation late only sees mixed parts, so
+ * every sequence is also decoded from parts after seqLen, with frames
+ * missed along the way.
+ */
+
+#include "bytewords.h"
+#include "ur_fountain.h"
+#include "wally_crypto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PART_CBOR (32 + UR_FOUNTAIN_MAX_FRAGMENT_LEN)
+#define FRAME_LOSS_PERCENT 20
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: %s failed (%s)\n", __FILE__, __LINE__, #cond,   \
+              current);                                                        \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+typedef struct {
+  uint64_t s[4];
+} xoshiro256_t;
+
+// The message and its fragments, and the state the encoder draws with
+typedef struct {
+  uint32_t seq_len;
+  size_t fragment_len;
+  uint8_t *message; // padded with zeros to seq_len fragments
+  uint32_t message_len;
+  uint32_t checksum;
+  double *degree_probs;
+  uint32_t *degree_aliases;
+  uint32_t *remaining;
+} encoder_t;
+
+static int failures = 0;
+static char current[64] = "";
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+static void xoshiro_seed(xoshiro256_t *rng, const uint8_t *seed, size_t len) {
+  uint8_t digest[SHA256_LEN];
+
+  wally_sha256(seed, len, digest, sizeof(digest));
+  for (int i = 0; i < 4; i++) {
+    rng->s[i] = 0;
+    for (int b = 0; b < 8; b++)
+      rng->s[i] = (rng->s[i] << 8) | digest[8 * i + b];
+  }
+}
+
+static uint64_t xoshiro_next(xoshiro256_t *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+static double xoshiro_double(xoshiro256_t *rng) {
+  return (double)xoshiro_next(rng) / ((double)UINT64_MAX + 1.0);
+}
+
+static uint32_t xoshiro_int(xoshiro256_t *rng, uint32_t low, uint32_t high) {
+  return (uint32_t)(xoshiro_double(rng) * (high - low + 1)) + low;
+}
+
+// Walker's alias method over P(degree d) proportional to 1/d, built in the
+// reference's order
+static bool encoder_build_sampler(encoder_t *enc) {
+  uint32_t n = enc->seq_len;
+  double *scaled = malloc(n * sizeof(double));
+  uint32_t *small = malloc(n * sizeof(uint32_t));
+  uint32_t *large = malloc(n * sizeof(uint32_t));
+  uint32_t small_count = 0, large_count = 0;
+  double total = 0;
+  bool ok = scaled && small && large;
+
+  if (!ok)
+    goto done;
+  for (uint32_t i = 0; i < n; i++)
+    total += 1.0 / (i + 1);
+  for (uint32_t i = 0; i < n; i++)
+    scaled[i] = (1.0 / (i + 1)) * n / total;
+  for (uint32_t i = n; i-- > 0;) {
+    if (scaled[i] < 1)
+      small[small_count++] = i;
+    else
+      large[large_count++] = i;
+  }
+  while (small_count && large_count) {
+    uint32_t a = small[--small_count];
+    uint32_t g = large[--large_count];
+    enc->degree_probs[a] = scaled[a];
+    enc->degree_aliases[a] = g;
+    scaled[g] += scaled[a] - 1;
+    if (scaled[g] < 1)
+      small[small_count++] = g;
+    else
+      large[large_count++] = g;
+  }
+  while (large_count)
+    enc->degree_probs[large[--large_count]] = 1;
+  while (small_count)
+    enc->degree_probs[small[--small_count]] = 1;
+
+done:
+  free(scaled);
+  free(small);
+  free(large);
+  return ok;
+}
+
+static uint32_t encoder_degree(const encoder_t *enc, xoshiro256_t *rng) {
+  double r1 = xoshiro_double(rng);
+  double r2 = xoshiro_double(rng);
+  uint32_t i = (uint32_t)(enc->seq_len * r1);
+  return (r2 < enc->degree_probs[i] ? i : enc->degree_aliases[i]) + 1;
+}
+
+// Fragments mixed into part seq_num, as a 0/1 flag per fragment
+static void encoder_choose(encoder_t *enc, uint32_t seq_num, uint8_t *chosen) {
+  uint32_t n = enc->seq_len;
+
+  memset(chosen, 0, n);
+  if (seq_num <= n) {
+    chosen[seq_num - 1] = 1;
+    return;
+  }
+
+  uint8_t seed[8];
+  for (int i = 0; i < 4; i++) {
+    seed[i] = (uint8_t)(seq_num >> (24 - 8 * i));
+    seed[4 + i] = (uint8_t)(enc->checksum >> (24 - 8 * i));
+  }
+  xoshiro256_t rng;
+  xoshiro_seed(&rng, seed, sizeof(seed));
+  uint32_t degree = encoder_degree(enc, &rng);
+
+  // The first degree indexes of a shuffle of them all
+  uint32_t remaining = n;
+  for (uint32_t i = 0; i < n; i++)
+    enc->remaining[i] = i;
+  for (uint32_t d = 0; d < degree; d++) {
+    uint32_t pick = xoshiro_int(&rng, 0, remaining - 1);
+    chosen[enc->remaining[pick]] = 1;
+    memmove(enc->remaining + pick, enc->remaining + pick + 1,
+            (remaining - pick - 1) * sizeof(uint32_t));
+    remaining--;
+  }
+}
+
+static bool encoder_init(encoder_t *enc, const uint8_t *message,
+                         uint32_t message_len, size_t fragment_len) {
+  uint32_t n = (uint32_t)((message_len + fragment_len - 1) / fragment_len);
+
+  *enc = (encoder_t){.seq_len = n, .fragment_len = fragment_len,
+                     .message_len = message_len};
+  enc->message = calloc(n, fragment_len);
+  enc->degree_probs = malloc(n * sizeof(double));
+  enc->degree_aliases = calloc(n, sizeof(uint32_t));
+  enc->remaining = malloc(n * sizeof(uint32_t));
+  if (!enc->message || !enc->degree_probs || !enc->degree_aliases ||
+      !enc->remaining || !encoder_build_sampler(enc))
+    return false;
+  memcpy(enc->message, message, message_len);
+  enc->checksum = bytewords_crc32(message, message_len);
+  return true;
+}
+
+static void encoder_free(encoder_t *enc) {
+  free(enc->message);
+  free(enc->degree_probs);
+  free(enc->degree_aliases);
+  free(enc->remaining);
+}
+
+static size_t cbor_head(uint8_t *out, int major, uint64_t value) {
+  if (value < 24) {
+    out[0] = (uint8_t)(major << 5 | value);
+    return 1;
+  }
+
+  // Value in the next 1, 2, 4 or 8 bytes
+  int info = 24;
+  while (info < 27 && value >> (8 << (info - 24)))
+    info++;
+  int size = 1 << (info - 24);
+  out[0] = (uint8_t)(major << 5 | info);
+  for (int i = 0; i < size; i++)
+    out[1 + i] = (uint8_t)(value >> (8 * (size - 1 - i)));
+  return 1 + size;
+}
+
+// The CBOR body of part seq_num: [seqNum, seqLen, messageLen, checksum,
+// fragment]
+static size_t encoder_part(encoder_t *enc, uint32_t seq_num, uint8_t *chosen,
+                           uint8_t *out) {
+  size_t pos = 0;
+
+  encoder_choose(enc, seq_num, chosen);
+  out[pos++] = 0x85;
+  pos += cbor_head(out + pos, 0, seq_num);
+  pos += cbor_head(out + pos, 0, enc->seq_len);
+  pos += cbor_head(out + pos, 0, enc->message_len);
+  pos += cbor_head(out + pos, 0, enc->checksum);
+  pos += cbor_head(out + pos, 2, enc->fragment_len);
+
+  uint8_t *fragment = out + pos;
+  memset(fragment, 0, enc->fragment_len);
+  for (uint32_t i = 0; i < enc->seq_len; i++) {
+    if (!chosen[i])
+      continue;
+    for (size_t k = 0; k < enc->fragment_len; k++)
+      fragment[k] ^= enc->message[i * enc->fragment_len + k];
+  }
+  return pos + enc->fragment_len;
+}
+
+static void wolf_message(uint8_t *message, size_t len) {
+  xoshiro256_t rng;
+
+  xoshiro_seed(&rng, (const uint8_t *)"Wolf", 4);
+  for (size_t i = 0; i < len; i++)
+    message[i] = (uint8_t)xoshiro_int(&rng, 0, 255);
+}
+
+// BCR-2020-005 reference test vectors
+static void test_reference_vectors(void) {
+  static const uint8_t rng_mod_100[12] = {42, 81, 85, 8,  82, 84,
+                                          76, 73, 70, 88, 2,  74};
+  static const uint32_t degrees[20] = {11, 3, 6, 5, 2, 1,  2,  11, 1, 3,
+                                       9,  10, 10, 4, 2, 1, 1, 2,  1, 1};
+  // Fragments of parts 12 to 18 of the 1024-byte "Wolf" message in 11
+  static const char *mixed[7] = {"9",   "2 5 6 8 9 10", "8", "1 5",
+                                 "1",   "0 2 4 5 8 10", "5"};
+  xoshiro256_t rng;
+  encoder_t enc;
+  uint8_t message[1024], chosen[11];
+
+  snprintf(current, sizeof(current), "reference vectors");
+  xoshiro_seed(&rng, (const uint8_t *)"Wolf", 4);
+  for (int i = 0; i < 12; i++)
+    CHECK(xoshiro_next(&rng) % 100 == rng_mod_100[i]);
+
+  wolf_message(message, sizeof(message));
+  CHECK(encoder_init(&enc, message, sizeof(message), 100));
+  CHECK(enc.seq_len == 11);
+  for (int i = 0; i < 20; i++) {
+    char seed[16];
+    int len = snprintf(seed, sizeof(seed), "Wolf-%d", i + 1);
+    xoshiro_seed(&rng, (const uint8_t *)seed, len);
+    CHECK(encoder_degree(&enc, &rng) == degrees[i]);
+  }
+
+  for (uint32_t seq_num = 1; seq_num <= 18; seq_num++) {
+    char expected[32], got[32] = "";
+    size_t pos = 0;
+
+    if (seq_num <= 11)
+      snprintf(expected, sizeof(expected), "%u", seq_num - 1);
+    else
+      snprintf(expected, sizeof(expected), "%s", mixed[seq_num - 12]);
+    encoder_choose(&enc, seq_num, chosen);
+    for (int i = 0; i < 11; i++) {
+      if (chosen[i])
+        pos += snprintf(got + pos, sizeof(got) - pos, pos ? " %d" : "%d", i);
+    }
+    CHECK(strcmp(got, expected) == 0);
+  }
+  encoder_free(&enc);
+}
+
+// Feeds parts from first_seq on, missing loss_percent of them, until the
+// decoder completes or max_parts were received. Returns the parts received,
+// or 0 if the message never came out right.
+static int decode_sequence(encoder_t *enc, uint32_t first_seq,
+                           int loss_percent, int max_parts) {
+  static uint8_t cbor[MAX_PART_CBOR];
+  uint8_t *chosen = malloc(enc->seq_len);
+  ur_fountain_t *fountain = ur_fountain_create();
+  int received = 0;
+
+  if (!chosen || !fountain)
+    goto done;
+  for (uint32_t seq_num = first_seq;
+       received < max_parts && !ur_fountain_is_complete(fountain);
+       seq_num++) {
+    if (rand() % 100 < loss_percent)
+      continue;
+
+    size_t len = encoder_part(enc, seq_num, chosen, cbor);
+    ur_part_t part;
+    if (!ur_part_parse(cbor, len, &part) ||
+        !ur_fountain_receive(fountain, &part))
+      break;
+    received++;
+  }
+
+  size_t len = 0;
+  const uint8_t *message = ur_fountain_message(fountain, &len);
+  if (!message || len != enc->message_len ||
+      memcmp(message, enc->message, len) != 0 ||
+      ur_fountain_progress_permille(fountain) != 1000)
+    received = 0;
+
+done:
+  ur_fountain_destroy(fountain);
+  free(chosen);
+  return received;
+}
+
+static void test_sequences(void) {
+  static const struct {
+    uint32_t seq_len;
+    size_t fragment_len;
+  } sizes[] = {{10, 100}, {50, 100}, {200, 100}, {500, 200}, {1024, 60}};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+    uint32_t n = sizes[s].seq_len;
+    size_t fragment_len = sizes[s].fragment_len;
+    uint32_t message_len = (uint32_t)(n * fragment_len - fragment_len / 3);
+    uint8_t *message = malloc(message_len);
+    encoder_t enc;
+
+    for (uint32_t i = 0; i < message_len; i++)
+      message[i] = (uint8_t)rand();
+    snprintf(current, sizeof(current), "seqLen %u", n);
+    CHECK(encoder_init(&enc, message, message_len, fragment_len));
+    CHECK(enc.seq_len == n);
+
+    // From the start, the simple parts alone carry the message
+    CHECK(decode_sequence(&enc, 1, 0, n) == (int)n);
+
+    // Joining after the simple parts, with and without missed frames. A
+    // random sparse code needs a few parts beyond seqLen, not multiples.
+    int worst = 0;
+    for (int trial = 0; trial < 4; trial++) {
+      uint32_t first_seq = n + 1 + (uint32_t)rand() % (2 * n);
+      int loss = trial % 2 ? FRAME_LOSS_PERCENT : 0;
+      int parts = decode_sequence(&enc, first_seq, loss, 2 * n + 20);
+      CHECK(parts > 0);
+      if (parts > worst)
+        worst = parts;
+    }
+    CHECK(worst <= (int)(n + n / 10 + 20));
+    printf("seqLen %4u: joined late, complete after at most %d parts\n", n,
+           worst);
+
+    encoder_free(&enc);
+    free(message);
+  }
+}
+
+// Repeats add nothing; a part of another message is refused
+static void test_duplicates_and_strangers(void) {
+  static uint8_t cbor[MAX_PART_CBOR];
+  uint8_t message[1024], chosen[11];
+  encoder_t enc, other;
+  ur_part_t part;
+
+  snprintf(current, sizeof(current), "duplicates");
+  wolf_message(message, sizeof(message));
+  CHECK(encoder_init(&enc, message, sizeof(message), 100));
+  CHECK(encoder_init(&other, message, sizeof(message) - 1, 100));
+  ur_fountain_t *fountain = ur_fountain_create();
+
+  size_t len = encoder_part(&enc, 20, chosen, cbor);
+  CHECK(ur_part_parse(cbor, len, &part));
+  CHECK(ur_fountain_receive(fountain, &part));
+  int permille = ur_fountain_progress_permille(fountain);
+  CHECK(ur_fountain_receive(fountain, &part));
+  CHECK(ur_fountain_progress_permille(fountain) == permille);
+  CHECK(ur_fountain_received_count(fountain) == 2);
+
+  len = encoder_part(&other, 3, chosen, cbor);
+  CHECK(ur_part_parse(cbor, len, &part));
+  CHECK(!ur_fountain_receive(fountain, &part));
+
+  ur_fountain_destroy(fountain);
+  encoder_free(&enc);
+  encoder_free(&other);
+}
+
+int main(void) {
+  srand(49);
+  test_reference_vectors();
+  test_duplicates_and_strangers();
+  test_sequences();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("UR fountain: all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Export frames recorded by the scanner's frame recorder.
+
+Read the storage partition back first, for example:
+
+    parttool.py read_partition --partition-name storage --output storage.bin
+
+then convert it into a corpus directory holding one PGM per frame and a
+manifest.json with each frame's decode outcome, oldest frame first:
+
+    tools/frame_recorder_export.py storage.bin corpus/ [--failures-only]
+
+The slot layout matches main/scanner/frame_recorder.h.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import zlib
+
+SLOT_SIZE = 32 * 1024
+MAGIC = 0x5246514B
+VERSION = 1
+HEADER = struct.Struct("<IHHIIHHIIIBBBB")
+
+OUTCOMES = ["blurry", "repeated", "no_code", "unreadable", "decoded",
+            "completed"]
+STRATEGIES = ["normal", "full_threshold", "inverted"]
+FAILURES = {"no_code", "unreadable"}
+
+
+def read_slots(image):
+    for offset in range(0, len(image) - SLOT_SIZE + 1, SLOT_SIZE):
+        (magic, version, header_size, sequence, timestamp_ms, width, height,
+         payload_crc32, dropped, sharpness, outcome, strategy, detected,
+         decoded) = HEADER.unpack_from(image, offset)
+        if magic != MAGIC or version != VERSION:
+            continue
+
+        start = offset + header_size
+        pixels = image[start:start + width * height]
+        if len(pixels) != width * height:
+            continue
+
+        yield {
+            "sequence": sequence,
+            "timestamp_ms": timestamp_ms,
+            "width": width,
+            "height": height,
+            "sharpness": sharpness,
+            "outcome": OUTCOMES[outcome] if outcome < len(OUTCOMES)
+            else str(outcome),
+            "strategy": STRATEGIES[strategy] if strategy < len(STRATEGIES)
+            else str(strategy),
+            "detected": detected,
+            "decoded": decoded,
+            "dropped_before": dropped,
+            "crc_ok": zlib.crc32(pixels) == payload_crc32,
+        }, pixels
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("partition", help="raw dump of the storage partition")
+    parser.add_argument("output", help="corpus directory to create")
+    parser.add_argument("--failures-only", action="store_true",
+                        help="only export frames that failed to decode")
+    args = parser.parse_args()
+
+    with open(args.partition, "rb") as f:
+        image = f.read()
+
+    slots = sorted(read_slots(image), key=lambda slot: slot[0]["sequence"])
+    if not slots:
+        sys.exit("no recorded frames found")
+
+    frames_dir = os.path.join(args.output, "frames")
+    os.makedirs(frames_dir, exist_ok=True)
+
+    manifest = {"source": os.path.basename(args.partition), "frames": []}
+    for meta, pixels in slots:
+        if args.failures_only and meta["outcome"] not in FAILURES:
+            continue
+        name = "%08d.pgm" % meta["sequence"]
+        with open(os.path.join(frames_dir, name), "wb") as f:
+            f.write(b"P5\n%d %d\n255\n" % (meta["width"], meta["height"]))
+            f.write(pixels)
+        meta["file"] = "frames/" + name
+        manifest["frames"].append(meta)
+
+    with open(os.path.join(args.output, "manifest.json"), "w") as f:
+        json.dump(manifest, f, indent=2)
+
+    torn = sum(not meta["crc_ok"] for meta in manifest["frames"])
+    print("exported %d frames (%d with bad CRC) to %s"
+          % (len(manifest["frames"]), torn, args.output))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Render QR payloads into a raw frame file for the virtual camera.
+
+Each line of the input is one frame of an animated sequence (a pMofN, UR or
+BBQr part, or a single code). Frames are drawn the way the virtual camera's
+synthetic source draws them, a screen in a dimmer room, and written back to
+back in the camera's pixel format:
+
+    tools/virtual_camera_frames.py parts.txt frames.raw [--grey]
+
+--gap-frames shows a pattern of random modules without finder patterns
+between parts: a sharp scene with nothing to decode, which exercises the
+scanner's failed-scene schedule.
+
+The file is replayed in a loop with CONFIG_APP_VIDEO_VIRTUAL_SOURCE_FILE, or
+by the host scan benchmark (test/host) with -DVIRTUAL_FRAME_FILE=frames.raw.
+Needs the qrcode package (pip install qrcode).
+"""
+
+import argparse
+import random
+import sys
+
+import qrcode
+
+QR_AREA_PERCENT = 80
+QUIET_ZONE_MODULES = 4
+SCREEN_WHITE = 255
+SCREEN_BLACK = SCREEN_WHITE // 8
+SURROUND = SCREEN_WHITE // 4
+
+
+def qr_matrix(payload):
+    code = qrcode.QRCode(error_correction=qrcode.constants.ERROR_CORRECT_M,
+                         border=0)
+    code.add_data(payload)
+    code.make(fit=True)
+    return code.get_matrix()
+
+
+def noise_matrix(size, rng):
+    return [[rng.random() < 0.5 for _ in range(size)] for _ in range(size)]
+
+
+def render(matrix, width, height):
+    size = len(matrix)
+
+    scale = max(1, min(width, height) * QR_AREA_PERCENT // 100
+                // (size + 2 * QUIET_ZONE_MODULES))
+    left = (width - size * scale) // 2
+    top = (height - size * scale) // 2
+    quiet = QUIET_ZONE_MODULES * scale
+
+    frame = bytearray([SURROUND]) * (width * height)
+    screen = bytes([SCREEN_WHITE]) * (size * scale + 2 * quiet)
+    for y in range(top - quiet, top + size * scale + quiet):
+        start = y * width + left - quiet
+        frame[start:start + len(screen)] = screen
+
+    dark = bytes([SCREEN_BLACK]) * scale
+    for qy, row in enumerate(matrix):
+        for qx, module in enumerate(row):
+            if not module:
+                continue
+            for dy in range(scale):
+                start = (top + qy * scale + dy) * width + left + qx * scale
+                frame[start:start + scale] = dark
+    return frame
+
+
+def to_rgb565(luma):
+    out = bytearray(len(luma) * 2)
+    for i, y in enumerate(luma):
+        pixel = ((y >> 3) << 11) | ((y >> 2) << 5) | (y >> 3)
+        out[2 * i] = pixel & 0xFF
+        out[2 * i + 1] = pixel >> 8
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("parts", help="text file, one payload per line")
+    parser.add_argument("output", help="raw frame file to write")
+    parser.add_argument("--width", type=int, default=800)
+    parser.add_argument("--height", type=int, default=640)
+    parser.add_argument("--frames-per-part", type=int, default=3,
+                        help="frames each payload stays on screen")
+    parser.add_argument("--gap-frames", type=int, default=0,
+                        help="frames of codeless modules after each payload")
+    parser.add_argument("--grey", action="store_true",
+                        help="8-bit greyscale instead of RGB565")
+    args = parser.parse_args()
+
+    with open(args.parts) as f:
+        payloads = [line.rstrip("\n") for line in f if line.strip()]
+    if not payloads:
+        sys.exit("no payloads in %s" % args.parts)
+
+    rng = random.Random(0)
+    with open(args.output, "wb") as f:
+        for payload in payloads:
+            matrix = qr_matrix(payload)
+            frames = [(render(matrix, args.width, args.height),
+                       args.frames_per_part)]
+            if args.gap_frames:
+                frames.append((render(noise_matrix(len(matrix), rng),
+                                      args.width, args.height),
+                               args.gap_frames))
+            for frame, count in frames:
+                if not args.grey:
+                    frame = to_rgb565(frame)
+                for _ in range(count):
+                    f.write(frame)
+
+    print("wrote %d frames of %dx%d %s to %s"
+          % (len(payloads) * (args.frames_per_part + args.gap_frames),
+             args.width, args.height,
+             "GREY" if args.grey else "RGB565", args.output))
+
+
+if __name__ == "__main__":
+    main()